@@ -152,6 +152,8 @@ enum BlockStatus {
     BLOCK_FAILED_VALID = 32, //! stage after last reached validness failed
     BLOCK_FAILED_CHILD = 64, //! descends from failed block
     BLOCK_FAILED_MASK = BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
+
+    BLOCK_POS_AUDITED = 128, //! PoS block passed the RingCT, bulletproof and reward checks repeated by PoA audits
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -174,6 +176,12 @@ public:
     //! pointer to the index of some further predecessor of this block
     CBlockIndex* pskip;
 
+    //! (memory only) pointer to the index of the closest PoA predecessor of this block
+    CBlockIndex* pprevPoA;
+
+    //! (memory only) pointer to the index of the closest PoS predecessor of this block
+    CBlockIndex* pprevPoS;
+
     //ppcoin: trust score of block chain
     uint256 bnChainTrust;
 
@@ -235,6 +243,10 @@ public:
     uint256 minedHash;
     uint256 hashPrevPoABlock;
 
+    //! (memory only) Last PoS block audited by this PoA block, height -1 until known
+    uint256 hashLastAuditedPoS;
+    int nLastAuditedPoSHeight;
+
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
     
@@ -243,6 +255,8 @@ public:
         phashBlock = NULL;
         pprev = NULL;
         pskip = NULL;
+        pprevPoA = NULL;
+        pprevPoS = NULL;
         nHeight = 0;
         nFile = 0;
         nDataPos = 0;
@@ -271,6 +285,8 @@ public:
         hashPoAMerkleRoot = UINT256_ZERO;
         minedHash = UINT256_ZERO;
         hashPrevPoABlock = UINT256_ZERO;
+        hashLastAuditedPoS = UINT256_ZERO;
+        nLastAuditedPoSHeight = -1;
     }
 
     CBlockIndex()
@@ -304,6 +320,10 @@ public:
             hashPrevPoABlock = block.hashPrevPoABlock;
             minedHash = block.minedHash;
             hashPoAMerkleRoot = block.hashPoAMerkleRoot;
+            if (!block.posBlocksAudited.empty()) {
+                hashLastAuditedPoS = block.posBlocksAudited.back().hash;
+                nLastAuditedPoSHeight = block.posBlocksAudited.back().height;
+            }
             prevoutStake.SetNull();
             nStakeTime = 0;
         } else if (block.IsProofOfStake()) {
@@ -476,6 +496,9 @@ public:
     //! Build the skiplist pointer for this entry.
     void BuildSkip();
 
+    //! Build the previous PoA and PoS block pointers for this entry, pprev must have them already.
+    void BuildPrevPoAPoS();
+
     //! Efficiently find an ancestor of this block.
     CBlockIndex* GetAncestor(int height);
     const CBlockIndex* GetAncestor(int height) const;
@@ -64,6 +64,12 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Held by the CCheckQueueControl using the queue, so that only one master adds checks at a time.
+    //! Callers may build a control while holding cs_main, so no code may take cs_main while holding it.
+    boost::mutex ControlMutex;
+
+    friend class CCheckQueueControl<T>;
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
@@ -183,6 +189,7 @@ public:
     {
         // passed queue is supposed to be unused, or NULL
         if (pqueue != NULL) {
+            pqueue->ControlMutex.lock();
             bool isIdle = pqueue->IsIdle();
             assert(isIdle);
         }
@@ -207,6 +214,8 @@ public:
     {
         if (!fDone)
             Wait();
+        if (pqueue != NULL)
+            pqueue->ControlMutex.unlock();
     }
 };
 
@@ -7,7 +7,9 @@
 
 #include <boost/assign/list_of.hpp>
 
+#include "crypto/common.h"
 #include "db.h"
+#include "hash.h"
 #include "kernel.h"
 #include "script/interpreter.h"
 #include "timedata.h"
@@ -298,7 +300,7 @@ bool CheckStake(const CDataStream& ssUniqueID, CAmount nValueIn, const uint64_t
     return stakeTargetHit(hashProofOfStake, nValueIn, bnTarget);
 }
 
-bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int& nTimeTx, uint256& hashProofOfStake)
+bool CKernelSearch::AddInput(CStakeInput* stakeInput, unsigned int nTimeBlockFrom)
 {
     if(!Params().IsRegTestNet()) {
         if (nTimeTx < nTimeBlockFrom)
@@ -308,38 +310,69 @@ bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockF
             return false;
     }
 
-    //grab difficulty
-    uint256 bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
-
     //grab stake modifier
     uint64_t nStakeModifier = 0;
     if (!stakeInput->GetModifier(nStakeModifier))
         return error("%s : failed to get kernel stake modifier", __func__);
 
+    // Same layout as CheckStake, without the timestamp
+    CDataStream ss(SER_GETHASH, 0);
+    ss << nStakeModifier << nTimeBlockFrom << stakeInput->GetUniqueness();
+
+    CKernelInput input;
+    input.stakeInput = stakeInput;
+    input.vchKernel.assign(ss.begin(), ss.end());
+    input.nValue = stakeInput->GetValue();
+    input.fActive = true;
+    vInputs.push_back(std::move(input));
+    return true;
+}
+
+void CKernelSearch::RemoveInput(const CStakeInput* stakeInput)
+{
+    for (CKernelInput& input : vInputs) {
+        if (input.stakeInput == stakeInput)
+            input.fActive = false;
+    }
+}
+
+bool CKernelSearch::Search(unsigned int nBits, unsigned int nTimeMin, CStakeInput*& stakeInput, unsigned int& nTimeFound, uint256& hashProofOfStake) const
+{
+    //grab difficulty
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+
+    // The target of an input only depends on its value
+    std::vector<uint256> vTargets;
+    vTargets.reserve(vInputs.size());
+    for (const CKernelInput& input : vInputs)
+        vTargets.push_back((uint256(input.nValue) / 100) * bnTargetPerCoinDay);
+
     bool fSuccess = false;
-    unsigned int nTryTime = 0;
     int nHeightStart = chainActive.Height();
-    int nHashDrift = 60;
-    CDataStream ssUniqueID = stakeInput->GetUniqueness();
-    CAmount nValueIn = stakeInput->GetValue();
-    for (int i = 0; i < nHashDrift; i++) //iterate the hashing
-    {
+    for (unsigned int nTryTime = nTimeTx + 1; nTryTime <= nTimeTx + STAKE_HASH_DRIFT && !fSuccess; nTryTime++) {
         //new block came in, move on
         if (chainActive.Height() != nHeightStart)
             break;
-
-        //hash this iteration
-        nTryTime = nTimeTx + nHashDrift - i;
-
-        // if stake hash does not meet the target then continue to next iteration
-        if (!CheckStake(ssUniqueID, nValueIn, nStakeModifier, bnTargetPerCoinDay, nTimeBlockFrom, nTryTime, hashProofOfStake))
+        if (nTryTime <= nTimeMin)
             continue;
 
-        fSuccess = true; // if we make it this far then we have successfully created a stake hash
-        //LogPrintf("%s : hashproof=%s\n", __func__, hashProofOfStake.GetHex());
-        nTimeTx = nTryTime;
-        break;
+        unsigned char time[4];
+        WriteLE32(time, nTryTime);
+        for (size_t i = 0; i < vInputs.size(); i++) {
+            const CKernelInput& input = vInputs[i];
+            if (!input.fActive)
+                continue;
+            uint256 hash;
+            CHash256().Write(input.vchKernel.data(), input.vchKernel.size()).Write(time, sizeof(time)).Finalize(hash.begin());
+            if (hash < vTargets[i]) {
+                stakeInput = input.stakeInput;
+                nTimeFound = nTryTime;
+                hashProofOfStake = hash;
+                fSuccess = true;
+                break;
+            }
+        }
     }
 
     mapHashedBlocks.clear();
@@ -347,6 +380,15 @@ bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockF
     return fSuccess;
 }
 
+bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int& nTimeTx, uint256& hashProofOfStake)
+{
+    CKernelSearch search(nTimeTx);
+    if (!search.AddInput(stakeInput, nTimeBlockFrom))
+        return false;
+    CStakeInput* stakeFound = nullptr;
+    return search.Search(nBits, 0, stakeFound, nTimeTx, hashProofOfStake);
+}
+
 // Check kernel hash target and coinstake signature
 bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, std::unique_ptr<CStakeInput>& stake, int nPreviousBlockHeight)
 {
@@ -31,6 +31,41 @@ bool stakeTargetHit(const uint256& hashProofOfStake, const int64_t& nValueIn, co
 
 bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int& nTimeTx, uint256& hashProofOfStake);
 
+// Number of timestamps after the current time tried for a stake kernel
+static const unsigned int STAKE_HASH_DRIFT = 60;
+
+/**
+ * Stake kernel search across several stake inputs. The modifier, block time and uniqueness
+ * that start the kernel hash of an input are serialized once, so a try only appends the
+ * timestamp and hashes a single SHA-256 block twice, without allocating. The timestamps
+ * after nTimeTx are swept earliest first across all inputs.
+ */
+class CKernelSearch
+{
+public:
+    explicit CKernelSearch(unsigned int nTimeTxIn) : nTimeTx(nTimeTxIn) {}
+
+    // Add an input whose origin block has time nTimeBlockFrom; false if it can not stake yet
+    bool AddInput(CStakeInput* stakeInput, unsigned int nTimeBlockFrom);
+    // Stop trying an input, e.g. after failing to build a coinstake with it
+    void RemoveInput(const CStakeInput* stakeInput);
+    // Find the earliest timestamp later than nTimeMin and the first input meeting nBits at it
+    bool Search(unsigned int nBits, unsigned int nTimeMin, CStakeInput*& stakeInput, unsigned int& nTimeFound, uint256& hashProofOfStake) const;
+
+    size_t size() const { return vInputs.size(); }
+
+private:
+    struct CKernelInput {
+        CStakeInput* stakeInput;
+        std::vector<unsigned char> vchKernel;
+        CAmount nValue;
+        bool fActive;
+    };
+
+    unsigned int nTimeTx;
+    std::vector<CKernelInput> vInputs;
+};
+
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
 bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, std::unique_ptr<CStakeInput>& stake, int nPreviousBlockHeight);
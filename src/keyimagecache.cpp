@@ -0,0 +1,116 @@
+// Copyright (c) 2020-2022 The PRivaCY Coin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "keyimagecache.h"
+
+#include "memusage.h"
+#include "random.h"
+#include "txdb.h"
+
+#include <algorithm>
+#include <string.h>
+
+CKeyImageCache* pkeyImageCache = nullptr;
+
+CKeyImageHasher::CKeyImageHasher() : salt(GetRandHash()) {}
+
+size_t CKeyImageHasher::operator()(const CKeyImage& keyImage) const
+{
+    // Key images are curve points, so the bytes after the prefix are already uniform
+    uint256 key;
+    if (keyImage.size() > 1)
+        memcpy(key.begin(), keyImage.begin() + 1, std::min<size_t>(keyImage.size() - 1, key.size()));
+    return key.GetHash(salt);
+}
+
+CKeyImageCache::CKeyImageCache(CBlockTreeDB* baseIn) : base(baseIn), cachedUsage(0) {}
+
+size_t CKeyImageCache::EntryUsage(const CKeyImageCacheEntry& entry)
+{
+    return memusage::DynamicUsage(entry.vBlockHashes);
+}
+
+CKeyImageMap::iterator CKeyImageCache::Fetch(const CKeyImage& keyImage)
+{
+    CKeyImageMap::iterator it = cacheKeyImages.find(keyImage);
+    if (it != cacheKeyImages.end())
+        return it;
+    CKeyImageCacheEntry entry;
+    if (!base->ReadKeyImages(keyImage, entry.vBlockHashes))
+        entry.vBlockHashes.clear();
+    it = cacheKeyImages.insert(std::make_pair(keyImage, entry)).first;
+    cachedUsage += EntryUsage(it->second);
+    return it;
+}
+
+bool CKeyImageCache::GetSpends(const CKeyImage& keyImage, std::vector<uint256>& bhs)
+{
+    LOCK(cs);
+    CKeyImageMap::const_iterator it = Fetch(keyImage);
+    bhs = it->second.vBlockHashes;
+    return !bhs.empty();
+}
+
+void CKeyImageCache::AddSpend(const CKeyImage& keyImage, const uint256& bh)
+{
+    LOCK(cs);
+    CKeyImageMap::iterator it = Fetch(keyImage);
+    std::vector<uint256>& bhs = it->second.vBlockHashes;
+    if (std::find(bhs.begin(), bhs.end(), bh) != bhs.end())
+        return;
+    cachedUsage -= EntryUsage(it->second);
+    bhs.push_back(bh);
+    cachedUsage += EntryUsage(it->second);
+    it->second.flags |= CKeyImageCacheEntry::DIRTY;
+}
+
+void CKeyImageCache::RemoveSpend(const CKeyImage& keyImage, const uint256& bh)
+{
+    LOCK(cs);
+    CKeyImageMap::iterator it = Fetch(keyImage);
+    std::vector<uint256>& bhs = it->second.vBlockHashes;
+    std::vector<uint256>::iterator itHash = std::find(bhs.begin(), bhs.end(), bh);
+    if (itHash == bhs.end())
+        return;
+    cachedUsage -= EntryUsage(it->second);
+    bhs.erase(itHash);
+    cachedUsage += EntryUsage(it->second);
+    it->second.flags |= CKeyImageCacheEntry::DIRTY;
+}
+
+void CKeyImageCache::GetDirty(std::vector<std::pair<CKeyImage, std::vector<uint256> > >& vDirty)
+{
+    LOCK(cs);
+    for (CKeyImageMap::iterator it = cacheKeyImages.begin(); it != cacheKeyImages.end(); it++) {
+        if (it->second.flags & CKeyImageCacheEntry::DIRTY) {
+            vDirty.push_back(std::make_pair(it->first, it->second.vBlockHashes));
+            it->second.flags &= ~CKeyImageCacheEntry::DIRTY;
+        }
+    }
+}
+
+void CKeyImageCache::Uncache()
+{
+    LOCK(cs);
+    for (CKeyImageMap::iterator it = cacheKeyImages.begin(); it != cacheKeyImages.end();) {
+        if (it->second.flags & CKeyImageCacheEntry::DIRTY) {
+            it++;
+            continue;
+        }
+        cachedUsage -= EntryUsage(it->second);
+        it = cacheKeyImages.erase(it);
+    }
+}
+
+size_t CKeyImageCache::GetCacheSize() const
+{
+    LOCK(cs);
+    return cacheKeyImages.size();
+}
+
+size_t CKeyImageCache::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return memusage::DynamicUsage(cacheKeyImages) + cachedUsage;
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2020-2022 The PRivaCY Coin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_KEYIMAGECACHE_H
+#define BITCOIN_KEYIMAGECACHE_H
+
+#include "pubkey.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <utility>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+class CBlockTreeDB;
+
+class CKeyImageHasher
+{
+private:
+    uint256 salt;
+
+public:
+    CKeyImageHasher();
+
+    size_t operator()(const CKeyImage& keyImage) const;
+};
+
+struct CKeyImageCacheEntry {
+    std::vector<uint256> vBlockHashes; // Hashes of the blocks spending the key image; empty if unspent.
+    unsigned char flags;
+
+    enum Flags {
+        DIRTY = (1 << 0), // This cache entry is potentially different from the version in the block tree database.
+    };
+
+    CKeyImageCacheEntry() : vBlockHashes(), flags(0) {}
+};
+
+typedef boost::unordered_map<CKeyImage, CKeyImageCacheEntry, CKeyImageHasher> CKeyImageMap;
+
+/**
+ * In-memory view of the key image index, in front of CBlockTreeDB.
+ *
+ * Lookups are cached, including misses, so repeated IsSpentKeyImage calls for
+ * the same key image do not hit LevelDB. Spends added by ConnectBlock and
+ * removed by DisconnectTip stay dirty until the next FlushStateToDisk writes
+ * them in the block index batch.
+ */
+class CKeyImageCache
+{
+private:
+    CBlockTreeDB* base;
+    mutable Mutex cs;
+    CKeyImageMap cacheKeyImages;
+    size_t cachedUsage;
+
+    CKeyImageMap::iterator Fetch(const CKeyImage& keyImage);
+    static size_t EntryUsage(const CKeyImageCacheEntry& entry);
+
+public:
+    CKeyImageCache(CBlockTreeDB* baseIn);
+
+    /** Hashes of all blocks known to spend keyImage. Returns false if none are known. */
+    bool GetSpends(const CKeyImage& keyImage, std::vector<uint256>& bhs);
+    /** Record that block bh spends keyImage */
+    void AddSpend(const CKeyImage& keyImage, const uint256& bh);
+    /** Undo AddSpend when block bh is disconnected */
+    void RemoveSpend(const CKeyImage& keyImage, const uint256& bh);
+
+    /** Collect the dirty entries for writing and mark them clean. An empty hash list means erase. */
+    void GetDirty(std::vector<std::pair<CKeyImage, std::vector<uint256> > >& vDirty);
+    /** Drop all clean entries */
+    void Uncache();
+
+    size_t GetCacheSize() const;
+    size_t DynamicMemoryUsage() const;
+};
+
+extern CKeyImageCache* pkeyImageCache;
+
+#endif // BITCOIN_KEYIMAGECACHE_H
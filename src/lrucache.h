@@ -0,0 +1,74 @@
+// Copyright (c) 2020-2022 The PRivaCY Coin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_LRUCACHE_H
+#define BITCOIN_LRUCACHE_H
+
+#include <list>
+#include <map>
+#include <utility>
+
+/** STL-like map container that keeps the N most recently used elements. Not thread-safe. */
+template <typename K, typename V>
+class lru_cache
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<key_type, mapped_type> value_type;
+    typedef typename std::list<value_type>::size_type size_type;
+
+protected:
+    std::list<value_type> items; // most recently used first
+    typedef typename std::list<value_type>::iterator list_iterator;
+    std::map<K, list_iterator> map;
+    typedef typename std::map<K, list_iterator>::iterator iterator;
+    size_type nMaxSize;
+
+public:
+    lru_cache(size_type nMaxSizeIn = 0) { nMaxSize = nMaxSizeIn; }
+    size_type size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+    size_type max_size() const { return nMaxSize; }
+    /** Look up k, marking it as most recently used */
+    bool get(const key_type& k, mapped_type& v)
+    {
+        iterator it = map.find(k);
+        if (it == map.end())
+            return false;
+        items.splice(items.begin(), items, it->second);
+        v = it->second->second;
+        return true;
+    }
+    void insert(const key_type& k, const mapped_type& v)
+    {
+        iterator it = map.find(k);
+        if (it != map.end()) {
+            it->second->second = v;
+            items.splice(items.begin(), items, it->second);
+            return;
+        }
+        items.push_front(std::make_pair(k, v));
+        map.insert(std::make_pair(k, items.begin()));
+        if (nMaxSize && items.size() > nMaxSize) {
+            map.erase(items.back().first);
+            items.pop_back();
+        }
+    }
+    void erase(const key_type& k)
+    {
+        iterator it = map.find(k);
+        if (it == map.end())
+            return;
+        items.erase(it->second);
+        map.erase(it);
+    }
+    void clear()
+    {
+        map.clear();
+        items.clear();
+    }
+};
+
+#endif // BITCOIN_LRUCACHE_H
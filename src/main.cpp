@@ -21,6 +21,8 @@
 #include "init.h"
 #include "invalid.h"
 #include "kernel.h"
+#include "keyimagecache.h"
+#include "lrucache.h"
 #include "masternode-budget.h"
 #include "masternode-payments.h"
 #include "masternode-sync.h"
@@ -36,6 +38,7 @@
 #include "utilmoneystr.h"
 #include "validationinterface.h"
 
+#include <atomic>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -82,8 +85,10 @@ std::atomic<bool> fReindex{false};
 bool fTxIndex = true;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
+bool fReauditPoS = DEFAULT_REAUDIT_POS;
 bool fVerifyingBlocks = false;
 size_t nCoinCacheUsage = 5000 * 300;
+size_t nKeyImageCacheUsage = 5000 * 100;
 
 /* If the tip is older than this (in seconds), the node is considered to be in initial block download. */
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -280,11 +285,11 @@ double GetPriority(const CTransaction& tx, int nHeight)
     return 1000000000 + tx.ComputePriority(dResult);
 }
 
-bool IsSpentKeyImage(const std::string& kiHex, const uint256& againsHash)
+bool IsSpentKeyImage(const CKeyImage& keyImage, const uint256& againsHash)
 {
-    if (kiHex.empty()) return false;
+    if (!keyImage.IsValid()) return false;
     std::vector<uint256> bhs;
-    if (!pblocktree->ReadKeyImages(kiHex, bhs)) {
+    if (!pkeyImageCache->GetSpends(keyImage, bhs)) {
         //not spent yet because not found in database
         return false;
     }
@@ -317,12 +322,12 @@ bool IsSpentKeyImage(const std::string& kiHex, const uint256& againsHash)
     return false;
 }
 
-bool CheckKeyImageSpendInMainChain(const std::string& kiHex, int& confirmations)
+bool CheckKeyImageSpendInMainChain(const CKeyImage& keyImage, int& confirmations)
 {
     confirmations = 0;
-    if (kiHex.empty()) return false;
+    if (!keyImage.IsValid()) return false;
     std::vector<uint256> bhs;
-    if (!pblocktree->ReadKeyImages(kiHex, bhs)) {
+    if (!pkeyImageCache->GetSpends(keyImage, bhs)) {
         //not spent yet because not found in database
         return false;
     }
@@ -345,37 +350,84 @@ bool CheckKeyImageSpendInMainChain(const std::string& kiHex, int& confirmations)
     return false;
 }
 
-secp256k1_context2* GetContext()
+/**
+ * secp256k1-mw state shared by bulletproof proving and RingCT validation.
+ * The context and the generators are built once and only read afterwards, so
+ * they can be used from any thread. Scratch spaces keep per-call frame state,
+ * so every concurrent user borrows its own from a pool of reusable ones.
+ */
+static Mutex cs_secp256k1;
+static std::atomic<secp256k1_context2*> secp256k1Context{nullptr};
+static std::atomic<secp256k1_bulletproof_generators*> secp256k1Generators{nullptr};
+static std::vector<secp256k1_scratch_space2*> vFreeScratchSpaces;
+
+void InitContext()
 {
-    static secp256k1_context2* both;
-    if (!both) both = secp256k1_context_create2(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
-    return both;
+    LOCK(cs_secp256k1);
+    if (secp256k1Context) return;
+    secp256k1_context2* ctx = secp256k1_context_create2(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
+    secp256k1Generators = secp256k1_bulletproof_generators_create_with_pregenerated(ctx);
+    secp256k1Context = ctx;
 }
 
-secp256k1_scratch_space2* GetScratch()
+void DestroyContext()
 {
-    static secp256k1_scratch_space2* scratch;
-    if (!scratch) scratch = secp256k1_scratch_space_create(GetContext(), 1024 * 1024 * 512);
-    return scratch;
+    LOCK(cs_secp256k1);
+    if (!secp256k1Context) return;
+    for (secp256k1_scratch_space2* scratch : vFreeScratchSpaces)
+        secp256k1_scratch_space_destroy(scratch);
+    vFreeScratchSpaces.clear();
+    secp256k1_bulletproof_generators_destroy(secp256k1Context, secp256k1Generators);
+    secp256k1_context_destroy(secp256k1Context);
+    secp256k1Generators = nullptr;
+    secp256k1Context = nullptr;
+}
+
+secp256k1_context2* GetContext()
+{
+    if (!secp256k1Context) InitContext();
+    return secp256k1Context;
 }
 
 secp256k1_bulletproof_generators* GetGenerator()
 {
-    static secp256k1_bulletproof_generators* generator;
-    if (!generator) generator = secp256k1_bulletproof_generators_create_with_pregenerated(GetContext());
-    return generator;
+    if (!secp256k1Generators) InitContext();
+    return secp256k1Generators;
 }
 
-void DestroyContext()
+CScratchSpace::CScratchSpace() : scratch(nullptr)
 {
-    secp256k1_bulletproof_generators_destroy(GetContext(), GetGenerator());
-    secp256k1_scratch_space_destroy(GetScratch());
-    secp256k1_context_destroy(GetContext());
+    secp256k1_context2* ctx = GetContext();
+    {
+        LOCK(cs_secp256k1);
+        if (!vFreeScratchSpaces.empty()) {
+            scratch = vFreeScratchSpaces.back();
+            vFreeScratchSpaces.pop_back();
+            return;
+        }
+    }
+    scratch = secp256k1_scratch_space_create(ctx, MAX_BULLETPROOF_SCRATCH_SIZE);
+}
+
+CScratchSpace::~CScratchSpace()
+{
+    LOCK(cs_secp256k1);
+    if (secp256k1Context) {
+        vFreeScratchSpaces.push_back(scratch);
+    } else {
+        secp256k1_scratch_space_destroy(scratch);
+    }
 }
 
 bool VerifyBulletProofAggregate(const CTransaction& tx)
 {
     if (IsInitialBlockDownload()) return true;
+    CScratchSpace scratch;
+    return VerifyBulletProofAggregate(tx, scratch.get());
+}
+
+bool VerifyBulletProofAggregate(const CTransaction& tx, secp256k1_scratch_space2* scratch)
+{
     size_t len = tx.bulletproofs.size();
     if (tx.vout.size() >= 5) return false;
 
@@ -387,17 +439,232 @@ bool VerifyBulletProofAggregate(const CTransaction& tx)
         if (!secp256k1_pedersen_commitment_parse(GetContext(), &commitments[i], &(tx.vout[i].commitment[0])))
             throw std::runtime_error("Failed to parse pedersen commitment");
     }
-    return secp256k1_bulletproof_rangeproof_verify(GetContext(), GetScratch(), GetGenerator(), &(tx.bulletproofs[0]), len, NULL, commitments, tx.vout.size(), 64, &secp256k1_generator_const_h, NULL, 0);
+    return secp256k1_bulletproof_rangeproof_verify(GetContext(), scratch, GetGenerator(), &(tx.bulletproofs[0]), len, NULL, commitments, tx.vout.size(), 64, &secp256k1_generator_const_h, NULL, 0);
+}
+
+bool VerifyBulletProofBatch(const std::vector<const CTransaction*>& vtx, secp256k1_scratch_space2* scratch)
+{
+    // Only proofs over the same number of commitments (and thus of the same length) can share a multi-exponentiation
+    std::map<std::pair<size_t, size_t>, std::vector<const CTransaction*> > mapBatches;
+    for (const CTransaction* ptx : vtx) {
+        if (ptx->vout.size() >= 5 || ptx->bulletproofs.empty())
+            return error("%s : Bulletproof check for transaction %s failed", __func__, ptx->GetHash().ToString());
+        mapBatches[std::make_pair(ptx->vout.size(), ptx->bulletproofs.size())].push_back(ptx);
+    }
+
+    for (const auto& batch : mapBatches) {
+        const size_t nCommits = batch.first.first;
+        const size_t nProofLen = batch.first.second;
+        const std::vector<const CTransaction*>& vBatch = batch.second;
+        for (size_t nStart = 0; nStart < vBatch.size(); nStart += MAX_BULLETPROOF_BATCH_SIZE) {
+            const size_t nProofs = std::min(vBatch.size() - nStart, (size_t)MAX_BULLETPROOF_BATCH_SIZE);
+            std::vector<secp256k1_pedersen_commitment> vCommitments(nProofs * nCommits);
+            std::vector<const secp256k1_pedersen_commitment*> vCommitmentPtrs(nProofs);
+            std::vector<const unsigned char*> vProofPtrs(nProofs);
+            std::vector<secp256k1_generator> vValueGens(nProofs, secp256k1_generator_const_h);
+            bool fParsed = true;
+            for (size_t i = 0; i < nProofs && fParsed; i++) {
+                const CTransaction& tx = *vBatch[nStart + i];
+                for (size_t j = 0; j < nCommits; j++) {
+                    if (tx.vout[j].commitment.size() < 33 ||
+                        !secp256k1_pedersen_commitment_parse(GetContext(), &vCommitments[i * nCommits + j], &(tx.vout[j].commitment[0]))) {
+                        fParsed = false;
+                        break;
+                    }
+                }
+                vCommitmentPtrs[i] = &vCommitments[i * nCommits];
+                vProofPtrs[i] = &(tx.bulletproofs[0]);
+            }
+            if (fParsed && secp256k1_bulletproof_rangeproof_verify_multi(GetContext(), scratch, GetGenerator(), &vProofPtrs[0], nProofs, nProofLen, NULL,
+                               &vCommitmentPtrs[0], nCommits, 64, &vValueGens[0], NULL, NULL))
+                continue;
+
+            // The batch failed as a whole: verify proof by proof to identify the bad transaction
+            for (size_t i = 0; i < nProofs; i++) {
+                const CTransaction& tx = *vBatch[nStart + i];
+                bool fValid = false;
+                try {
+                    fValid = VerifyBulletProofAggregate(tx, scratch);
+                } catch (const std::exception& e) {
+                    LogPrintf("%s : %s\n", __func__, e.what());
+                }
+                if (!fValid)
+                    return error("%s : Bulletproof check for transaction %s failed", __func__, tx.GetHash().ToString());
+            }
+        }
+    }
+    return true;
 }
 
 bool VerifyRingSignatureWithTxFee(const CTransaction& tx, CBlockIndex* pindex)
 {
     if (tx.nTxFee < 0) return false;
     if (IsInitialBlockDownload()) return true;
+    std::vector<std::vector<CRingMember> > vRingMembers;
+    if (!GetRingMembers(tx, pindex, vRingMembers))
+        return false;
+    return VerifyRingSignature(tx, vRingMembers);
+}
+
+/** Outcome of PreVerifyTransaction, valid while the transaction resolves to the same ring members */
+struct CPreVerifiedTx {
+    uint256 hashRingMembers;
+    bool fRingSignatureValid;
+    bool fBulletProofValid;
+};
+
+static Mutex cs_preVerifiedTxs;
+/** Relayed transactions whose proofs were verified before cs_main was taken, valid or not */
+static lru_cache<uint256, CPreVerifiedTx> preVerifiedTxs(PRE_VERIFIED_TX_CACHE_SIZE);
+
+static uint256 GetRingMembersHash(const std::vector<std::vector<CRingMember> >& vRingMembers)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    for (const std::vector<CRingMember>& vRing : vRingMembers) {
+        for (const CRingMember& member : vRing) {
+            ss << member.pubkey << member.commitment;
+        }
+    }
+    return ss.GetHash();
+}
+
+/**
+ * Verify the ring signature and bulletproof of a relayed transaction ahead of AcceptToMemoryPool.
+ * cs_main is only held to resolve the ring members, the curve arithmetic runs without it.
+ * Transactions that AcceptToMemoryPool rejects on cheaper grounds are not verified.
+ * Failed checks are cached too, so that AcceptToMemoryPool does not repeat them.
+ */
+static void PreVerifyTransaction(const CTransaction& tx)
+{
+    AssertLockNotHeld(cs_main);
+    if (tx.IsCoinBase() || tx.IsCoinStake() || tx.IsCoinAudit() || tx.nTxFee < 0)
+        return;
+
+    CValidationState state;
+    if (!CheckTransaction(tx, true, state))
+        return;
+
+    std::vector<std::vector<CRingMember> > vRingMembers;
+    {
+        LOCK(cs_main);
+        if (IsInitialBlockDownload() || mempool.exists(tx.GetHash()))
+            return;
+        assert(recentRejects);
+        if (recentRejects->contains(tx.GetHash()))
+            return;
+        for (const CTxIn& txin : tx.vin) {
+            if (IsSpentKeyImage(txin.keyImage, UINT256_ZERO))
+                return;
+        }
+        if (!GetRingMembers(tx, chainActive.Tip(), vRingMembers))
+            return;
+    }
+
+    CPreVerifiedTx result;
+    result.hashRingMembers = GetRingMembersHash(vRingMembers);
+    result.fRingSignatureValid = false;
+    result.fBulletProofValid = false;
+    try {
+        CScratchSpace scratch;
+        result.fRingSignatureValid = VerifyRingSignature(tx, vRingMembers);
+        result.fBulletProofValid = result.fRingSignatureValid && VerifyBulletProofAggregate(tx, scratch.get());
+    } catch (const std::exception& e) {
+        LogPrint(BCLog::MEMPOOL, "%s : %s\n", __func__, e.what());
+    }
+
+    LOCK(cs_preVerifiedTxs);
+    preVerifiedTxs.insert(tx.GetHash(), result);
+}
+
+/** Look up the PreVerifyTransaction result of tx, if it still resolves to the same ring members at the tip */
+static bool GetPreVerifiedTransaction(const CTransaction& tx, bool& fRingSignatureValid, bool& fBulletProofValid)
+{
+    AssertLockHeld(cs_main);
+    if (tx.nTxFee < 0)
+        return false;
+
+    CPreVerifiedTx result;
+    {
+        LOCK(cs_preVerifiedTxs);
+        if (!preVerifiedTxs.get(tx.GetHash(), result))
+            return false;
+        // A valid transaction is looked up once on its way into the mempool, an invalid one may be relayed again
+        if (result.fBulletProofValid)
+            preVerifiedTxs.erase(tx.GetHash());
+    }
+    std::vector<std::vector<CRingMember> > vRingMembers;
+    if (!GetRingMembers(tx, chainActive.Tip(), vRingMembers) || GetRingMembersHash(vRingMembers) != result.hashRingMembers)
+        return false;
+    fRingSignatureValid = result.fRingSignatureValid;
+    fBulletProofValid = result.fBulletProofValid;
+    return true;
+}
+
+static Mutex cs_ringMemberCache;
+static lru_cache<COutPoint, CDiskRingMember> ringMemberCache(RING_MEMBER_CACHE_SIZE);
+//! Ring member index entries of connected blocks, written together with the block index by FlushStateToDisk
+static std::map<COutPoint, CDiskRingMember> mapDirtyRingMembers;
+
+bool GetRingMemberInfo(const COutPoint& outpoint, CDiskRingMember& member)
+{
+    {
+        LOCK(cs_ringMemberCache);
+        if (ringMemberCache.get(outpoint, member))
+            return true;
+        std::map<COutPoint, CDiskRingMember>::const_iterator it = mapDirtyRingMembers.find(outpoint);
+        if (it != mapDirtyRingMembers.end()) {
+            member = it->second;
+            return true;
+        }
+    }
+    if (!pblocktree->ReadRingMember(outpoint, member)) {
+        // Outputs confirmed before the ring member index existed
+        CTransaction txPrev;
+        uint256 hashBlock;
+        if (!GetTransaction(outpoint.hash, txPrev, hashBlock, true))
+            return false;
+        CBlockIndex* pindexPrev = WITH_LOCK(cs_main, BlockMap::const_iterator mi = mapBlockIndex.find(hashBlock); return mi == mapBlockIndex.end() ? nullptr : mi->second;);
+        if (!pindexPrev)
+            return false;
+        member = CDiskRingMember();
+        member.nHeight = pindexPrev->nHeight;
+        member.hashBlock = hashBlock;
+        member.fGenerated = txPrev.IsCoinBase() || txPrev.IsCoinStake() || txPrev.IsCoinAudit();
+        if (outpoint.n >= txPrev.vout.size())
+            return false;
+        const CTxOut& out = txPrev.vout[outpoint.n];
+        // the caller rejects outputs without a public key, there is no point in caching them
+        if (!ExtractPubKey(out.scriptPubKey, member.pubkey))
+            return true;
+        member.commitment = out.commitment;
+    }
+    LOCK(cs_ringMemberCache);
+    ringMemberCache.insert(outpoint, member);
+    return true;
+}
+
+static Mutex cs_hashToPointCache;
+static lru_cache<CPubKey, secp256k1_pubkey2> hashToPointCache(HASH_TO_POINT_CACHE_SIZE);
+
+/** Hp(P) of a ring member public key. Popular decoys appear in many rings, so the result is cached. */
+static void GetHashToPoint(const CPubKey& pubkey, secp256k1_pubkey2& hp)
+{
+    {
+        LOCK(cs_hashToPointCache);
+        if (hashToPointCache.get(pubkey, hp))
+            return;
+    }
+    secp256k1_mlsag_hash_to_point(GetContext(), &hp, pubkey.begin());
+    LOCK(cs_hashToPointCache);
+    hashToPointCache.insert(pubkey, hp);
+}
+
+bool GetRingMembers(const CTransaction& tx, CBlockIndex* pindex, std::vector<std::vector<CRingMember> >& vRingMembers)
+{
+    AssertLockHeld(cs_main);
     const size_t MAX_VIN = MAX_TX_INPUTS;
     SetRingSize(pindex->nHeight);
     const size_t MAX_DECOYS = MAX_RING_SIZE; //padding 1 for safety reasons
-    const size_t MAX_VOUT = 5;
 
     if (tx.vin.size() > MAX_VIN) {
         LogPrintf("Tx input too many\n");
@@ -419,23 +686,8 @@ bool VerifyRingSignatureWithTxFee(const CTransaction& tx, CBlockIndex* pindex)
         return false; //maximum decoys = 15
     }
 
-    unsigned char allInPubKeys[MAX_VIN + 1][MAX_DECOYS + 1][33];
-    unsigned char allKeyImages[MAX_VIN + 1][33];
-    unsigned char allInCommitments[MAX_VIN][MAX_DECOYS + 1][33];
-    unsigned char allOutCommitments[MAX_VOUT][33];
-
-    unsigned char SIJ[MAX_VIN + 1][MAX_DECOYS + 1][32];
-    unsigned char LIJ[MAX_VIN + 1][MAX_DECOYS + 1][33];
-    unsigned char RIJ[MAX_VIN + 1][MAX_DECOYS + 1][33];
-
-    secp256k1_context2* both = GetContext();
-
-    //generating LIJ and RIJ at PI
-    for (size_t j = 0; j < tx.vin.size(); j++) {
-        memcpy(allKeyImages[j], tx.vin[j].keyImage.begin(), 33);
-    }
-
     //extract all public keys
+    vRingMembers.assign(tx.vin.size(), std::vector<CRingMember>(tx.vin[0].decoys.size() + 1));
     for (size_t i = 0; i < tx.vin.size(); i++) {
         std::vector<COutPoint> decoysForIn;
         decoysForIn.push_back(tx.vin[i].prevout);
@@ -443,36 +695,77 @@ bool VerifyRingSignatureWithTxFee(const CTransaction& tx, CBlockIndex* pindex)
             decoysForIn.push_back(tx.vin[i].decoys[j]);
         }
         for (size_t j = 0; j < tx.vin[0].decoys.size() + 1; j++) {
-            CTransaction txPrev;
-            uint256 hashBlock;
-            if (!GetTransaction(decoysForIn[j].hash, txPrev, hashBlock)) {
+            CDiskRingMember member;
+            if (!GetRingMemberInfo(decoysForIn[j], member)) {
                 LogPrintf("Failed to find transaction %s\n", decoysForIn[j].hash.GetHex());
                 return false;
             }
             CBlockIndex* tip = chainActive.Tip();
             if (!pindex) tip = pindex;
 
-            uint256 hashTip = tip->GetBlockHash();
-            //verify that tip and hashBlock must be in the same fork
-            CBlockIndex* atTheblock = mapBlockIndex[hashBlock];
-            if (!atTheblock) {
+            //verify that tip and the decoy block must be in the same fork
+            BlockMap::const_iterator mi = mapBlockIndex.find(member.hashBlock);
+            CBlockIndex* atTheblock = mi == mapBlockIndex.end() ? nullptr : mi->second;
+            if (!atTheblock || tip->GetAncestor(atTheblock->nHeight) != atTheblock) {
                 LogPrintf("%s: Decoy for transaction %s not in the same chain as block height=%s hash=%s\n", __func__, decoysForIn[j].hash.GetHex(), tip->nHeight, tip->GetBlockHash().GetHex());
                 return false;
-            } else {
-                CBlockIndex* ancestor = tip->GetAncestor(atTheblock->nHeight);
-                if (ancestor != atTheblock) {
-                    LogPrintf("%s: Decoy for transaction %s not in the same chain as block height=%s hash=%s\n", __func__, decoysForIn[j].hash.GetHex(), tip->nHeight, tip->GetBlockHash().GetHex());
-                    return false;
-                }
             }
 
-            CPubKey extractedPub;
-            if (!ExtractPubKey(txPrev.vout[decoysForIn[j].n].scriptPubKey, extractedPub)) {
+            if (!member.pubkey.IsValid()) {
                 LogPrintf("Failed to extract pubkey\n");
                 return false;
             }
-            memcpy(allInPubKeys[i][j], extractedPub.begin(), 33);
-            memcpy(allInCommitments[i][j], &(txPrev.vout[decoysForIn[j].n].commitment[0]), 33);
+            if (member.commitment.size() < 33) {
+                LogPrintf("Commitment can not be null\n");
+                return false;
+            }
+            vRingMembers[i][j].pubkey = member.pubkey;
+            vRingMembers[i][j].commitment = member.commitment;
+        }
+    }
+    return true;
+}
+
+bool VerifyRingSignature(const CTransaction& tx, const std::vector<std::vector<CRingMember> >& vRingMembers)
+{
+    const size_t MAX_VIN = MAX_TX_INPUTS;
+    const size_t MAX_VOUT = 5;
+
+    if (vRingMembers.empty() || vRingMembers.size() != tx.vin.size() || vRingMembers.size() > MAX_VIN ||
+        vRingMembers[0].size() != tx.vin[0].decoys.size() + 1 || tx.vout.size() > MAX_VOUT) {
+        LogPrintf("%s: Ring members do not match transaction %s\n", __func__, tx.GetHash().GetHex());
+        return false;
+    }
+    if (tx.S.size() < vRingMembers[0].size()) {
+        LogPrintf("%s: Transaction %s has too few signature columns\n", __func__, tx.GetHash().GetHex());
+        return false;
+    }
+    for (size_t i = 0; i < vRingMembers[0].size(); i++) {
+        if (tx.S[i].size() < tx.vin.size() + 1) {
+            LogPrintf("%s: Transaction %s has too few signature rows\n", __func__, tx.GetHash().GetHex());
+            return false;
+        }
+    }
+    const size_t MAX_DECOYS = vRingMembers[0].size(); //padding 1 for safety reasons
+
+    unsigned char allInPubKeys[MAX_VIN + 1][MAX_DECOYS + 1][33];
+    unsigned char allKeyImages[MAX_VIN + 1][33];
+    unsigned char allInCommitments[MAX_VIN][MAX_DECOYS + 1][33];
+    unsigned char allOutCommitments[MAX_VOUT][33];
+
+    unsigned char SIJ[MAX_VIN + 1][MAX_DECOYS + 1][32];
+
+    secp256k1_context2* both = GetContext();
+
+    //generating LIJ and RIJ at PI
+    for (size_t j = 0; j < tx.vin.size(); j++) {
+        memcpy(allKeyImages[j], tx.vin[j].keyImage.begin(), 33);
+    }
+
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        for (size_t j = 0; j < tx.vin[0].decoys.size() + 1; j++) {
+            memcpy(allInPubKeys[i][j], vRingMembers[i][j].pubkey.begin(), 33);
+            memcpy(allInCommitments[i][j], &(vRingMembers[i][j].commitment[0]), 33);
         }
     }
     memcpy(allKeyImages[tx.vin.size()], tx.ntxFeeKeyImage.begin(), 33);
@@ -547,134 +840,214 @@ bool VerifyRingSignatureWithTxFee(const CTransaction& tx, CBlockIndex* pindex)
 
 
     //verification
-    unsigned char C[32];
-    memcpy(C, tx.c.begin(), 32);
-    for (size_t j = 0; j < tx.vin[0].decoys.size() + 1; j++) {
-        for (size_t i = 0; i < tx.vin.size() + 1; i++) {
-            //compute LIJ, RIJ
-            unsigned char P[33];
-            memcpy(P, allInPubKeys[i][j], 33);
-            if (!secp256k1_ec_pubkey_tweak_mul(P, 33, C)) {
-                LogPrintf("Failed to mul pubkey\n");
-                return false;
-            }
-
-            if (!secp256k1_ec_pubkey_tweak_add(P, 33, SIJ[i][j])) {
-                LogPrintf("Failed to add pubkey\n");
-                return false;
-            }
-
-            memcpy(LIJ[i][j], P, 33);
-
-            //compute RIJ
-            unsigned char sh[33];
-            CPubKey pkij;
-            pkij.Set(allInPubKeys[i][j], allInPubKeys[i][j] + 33);
-            PointHashingSuccessively(pkij, SIJ[i][j], sh);
+    const size_t nRows = tx.vin.size() + 1;
+    const size_t nCols = tx.vin[0].decoys.size() + 1;
+    std::vector<unsigned char> pubkeys(nRows * nCols * 33);
+    std::vector<unsigned char> keyImages(nRows * 33);
+    std::vector<unsigned char> responses(nRows * nCols * 32);
+    std::vector<secp256k1_pubkey2> hashedPubKeys(nRows * nCols);
+    for (size_t i = 0; i < nRows; i++) {
+        memcpy(&keyImages[i * 33], allKeyImages[i], 33);
+        for (size_t j = 0; j < nCols; j++) {
+            memcpy(&pubkeys[(i * nCols + j) * 33], allInPubKeys[i][j], 33);
+            memcpy(&responses[(i * nCols + j) * 32], SIJ[i][j], 32);
+            // The commitment row is specific to this transaction and not worth caching
+            if (i < tx.vin.size())
+                GetHashToPoint(vRingMembers[i][j].pubkey, hashedPubKeys[i * nCols + j]);
+            else
+                secp256k1_mlsag_hash_to_point(both, &hashedPubKeys[i * nCols + j], allInPubKeys[i][j]);
+        }
+    }
+    uint256 ctsHash = GetTxSignatureHash(tx);
+    return secp256k1_mlsag_verify(both, tx.c.begin(), ctsHash.begin(), &pubkeys[0], &hashedPubKeys[0], &keyImages[0], &responses[0], nRows, nCols) == 1;
+}
 
-            unsigned char ci[33];
-            memcpy(ci, allKeyImages[i], 33);
-            if (!secp256k1_ec_pubkey_tweak_mul(ci, 33, C)) {
-                LogPrintf("Failed to mul tweak\n");
-                return false;
-            }
+/**
+ * Read a PoS block for an audit and queue the curve arithmetic of its ring signatures and
+ * bulletproofs, which do not need cs_main. The checks reference the transactions of block.
+ */
+static bool PreparePoSBlockAudit(CBlockIndex* pindex, CBlock& block, std::vector<CRingCTCheck>& vChecks)
+{
+    AssertLockHeld(cs_main);
+    if (!pindex) return false;
+    if (!ReadBlockFromDisk(block, pindex)) return false;
+    if (!pindex->IsProofOfStake()) return false;
+    const bool fRingCTChecks = !IsInitialBlockDownload();
+    CRingCTCheck bulletProofCheck;
+    bool fBulletProofs = false;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        if (tx.IsCoinStake() || tx.IsCoinAudit())
+            continue;
+        if (tx.nTxFee < 0)
+            return false;
+        if (!fRingCTChecks)
+            continue;
+        std::vector<std::vector<CRingMember> > vRingMembers;
+        if (!GetRingMembers(tx, pindex, vRingMembers))
+            return false;
+        vChecks.emplace_back(tx, vRingMembers);
+        bulletProofCheck.AddBulletProof(tx);
+        fBulletProofs = true;
+    }
+    if (fBulletProofs) {
+        vChecks.emplace_back();
+        vChecks.back().swap(bulletProofCheck);
+    }
+    return true;
+}
 
-            //convert shp into commitment
-            secp256k1_pedersen_commitment SHP_commitment;
-            secp256k1_pedersen_serialized_pubkey_to_commitment(sh, 33, &SHP_commitment);
+/** Coinstake and reward checks of a PoS block audit, once its RingCT checks have passed */
+static bool FinishPoSBlockAudit(CBlockIndex* pindex, const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    CAmount nFees = 0;
+    CAmount nValueIn = 0;
+    CAmount nValueOut = 0;
+    for (const CTransaction& tx : block.vtx) {
+        if (!tx.IsCoinStake())
+            nFees += tx.nTxFee;
+    }
 
-            //convert CI*I into commitment
-            secp256k1_pedersen_commitment cii_commitment;
-            secp256k1_pedersen_serialized_pubkey_to_commitment(ci, 33, &cii_commitment);
+    const CTransaction coinstake = block.vtx[1];
+    CCoinsViewCache view(pcoinsTip);
+    nValueIn = GetValueIn(view, coinstake);
+    nValueOut = coinstake.GetValueOut();
 
-            const secp256k1_pedersen_commitment* twoElements[2];
-            twoElements[0] = &SHP_commitment;
-            twoElements[1] = &cii_commitment;
+    size_t numUTXO = coinstake.vout.size();
+    if (mapBlockIndex.count(block.hashPrevBlock) < 1) {
+        LogPrintf("%s: Previous block not found, received block %s, previous %s, current tip %s\n", __func__, block.GetHash().GetHex(), block.hashPrevBlock.GetHex(), chainActive.Tip()->GetBlockHash().GetHex());
+        return false;
+    }
+    CAmount blockValue = GetBlockValue(mapBlockIndex[block.hashPrevBlock]->nHeight);
+    const CTxOut& mnOut = coinstake.vout[numUTXO - 1];
+    std::string mnsa(mnOut.masternodeStealthAddress.begin(), mnOut.masternodeStealthAddress.end());
+    if (!VerifyDerivedAddress(mnOut, mnsa)) {
+        LogPrintf("%s: Incorrect derived address for masternode rewards\n", __func__);
+        return false;
+    }
 
-            secp256k1_pedersen_commitment sum;
-            if (!secp256k1_pedersen_commitment_sum_pos(both, twoElements, 2, &sum))
-                throw std::runtime_error("failed to compute secp256k1_pedersen_commitment_sum_pos");
-            size_t tempLength;
-            if (!secp256k1_pedersen_commitment_to_serialized_pubkey(&sum, RIJ[i][j], &tempLength))
-                throw std::runtime_error("failed to serialize pedersen commitment");
-        }
+    // track money supply and mint amount info
+    CAmount nMoneySupplyPrev = pindex->pprev ? pindex->pprev->nMoneySupply : 0;
+    pindex->nMoneySupply = nMoneySupplyPrev + nValueOut - nValueIn - nFees;
+    LogPrint(BCLog::SUPPLY, "%s: nMoneySupplyPrev=%d, pindex->nMoneySupply=%d, nFees = %d\n", __func__, nMoneySupplyPrev, pindex->nMoneySupply, nFees);
+    pindex->nMint = pindex->nMoneySupply - nMoneySupplyPrev + nFees;
 
-        //compute C
-        unsigned char tempForHash[2 * (MAX_VIN + 1) * 33 + 32];
-        unsigned char* tempForHashPtr = tempForHash;
-        for (size_t i = 0; i < tx.vin.size() + 1; i++) {
-            memcpy(tempForHashPtr, &(LIJ[i][j][0]), 33);
-            tempForHashPtr += 33;
-            memcpy(tempForHashPtr, &(RIJ[i][j][0]), 33);
-            tempForHashPtr += 33;
-        }
-        uint256 ctsHash = GetTxSignatureHash(tx);
-        memcpy(tempForHashPtr, ctsHash.begin(), 32);
+    //PoW phase redistributed fees to miner. PoS stage destroys fees.
+    CAmount nExpectedMint = GetBlockValue(pindex->pprev->nHeight);
+    nExpectedMint += nFees;
 
-        uint256 temppi1 = Hash(tempForHash, tempForHash + 2 * (tx.vin.size() + 1) * 33 + 32);
-        memcpy(C, temppi1.begin(), 32);
+    if (!IsBlockValueValid(pindex->nHeight, nExpectedMint, pindex->nMint)) {
+        LogPrintf("%s: reward pays too much (actual=%s vs limit=%s)\n", __func__, FormatMoney(pindex->nMint), FormatMoney(nExpectedMint));
+        return false;
     }
-    //LogPrintf("Verifying\n");
-    return HexStr(tx.c.begin(), tx.c.end()) == HexStr(C, C + 32);
+    return true;
 }
 
 bool ReVerifyPoSBlock(CBlockIndex* pindex)
 {
     LOCK(cs_main);
-    {
-        if (!pindex) return false;
+    CBlock block;
+    std::vector<CRingCTCheck> vChecks;
+    if (!PreparePoSBlockAudit(pindex, block, vChecks))
+        return false;
+    for (CRingCTCheck& check : vChecks) {
+        if (!check())
+            return false;
+    }
+    return FinishPoSBlockAudit(pindex, block);
+}
+
+static void SetPoSBlockAudited(CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    // Ring signatures and bulletproofs are not checked during initial block download
+    if (!IsInitialBlockDownload()) {
+        pindex->nStatus |= BLOCK_POS_AUDITED;
+        setDirtyBlockIndex.insert(pindex);
+    }
+}
+
+void RecordPoSBlockChecks(CBlockIndex* pindex, bool fRingCTChecks)
+{
+    AssertLockHeld(cs_main);
+    // With fRingCTChecks, ConnectBlock has run the ring signature, bulletproof, fee, reward address and reward checks of ReVerifyPoSBlock
+    if (!pindex->IsProofOfStake() || !fRingCTChecks || (pindex->nStatus & BLOCK_POS_AUDITED))
+        return;
+    pindex->nStatus |= BLOCK_POS_AUDITED;
+    setDirtyBlockIndex.insert(pindex);
+}
+
+bool IsPoSBlockAudited(CBlockIndex* pindex)
+{
+    if (!pindex)
+        return false;
+    if (!fReauditPoS && WITH_LOCK(cs_main, return (pindex->nStatus & BLOCK_POS_AUDITED) != 0))
+        return true;
+    if (!ReVerifyPoSBlock(pindex))
+        return false;
+    WITH_LOCK(cs_main, SetPoSBlockAudited(pindex));
+    return true;
+}
+
+//! Shared by ConnectBlock and AuditPoSBlocks, whose CCheckQueueControl takes turns on it
+CCheckQueue<CRingCTCheck> ringctcheckqueue(4);
+
+void AuditPoSBlocks(const std::vector<CBlockIndex*>& vIndex, std::vector<bool>& vAudited)
+{
+    struct CPoSBlockAudit {
         CBlock block;
-        if (!ReadBlockFromDisk(block, pindex)) return false;
-        if (!pindex->IsProofOfStake()) return false;
-        CAmount nFees = 0;
-        CAmount nValueIn = 0;
-        CAmount nValueOut = 0;
-        for (unsigned int i = 0; i < block.vtx.size(); i++) {
-            const CTransaction& tx = block.vtx[i];
-            if (!tx.IsCoinStake()) {
-                if (!tx.IsCoinAudit()) {
-                    if (!VerifyRingSignatureWithTxFee(tx, pindex))
-                        return false;
-                    if (!VerifyBulletProofAggregate(tx))
-                        return false;
+        bool fPrepared = false;
+    };
+    std::vector<CPoSBlockAudit> vAudits(vIndex.size());
+    // One flag per block, set by any of its checks that fails
+    std::vector<std::atomic<bool> > vChecksFailed(vIndex.size());
+    std::vector<CRingCTCheck> vChecks;
+    vAudited.assign(vIndex.size(), false);
+
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < vIndex.size(); i++) {
+            vChecksFailed[i] = false;
+            if (!vIndex[i])
+                continue;
+            if (!fReauditPoS && (vIndex[i]->nStatus & BLOCK_POS_AUDITED)) {
+                vAudited[i] = true;
+                continue;
+            }
+            CPoSBlockAudit& audit = vAudits[i];
+            std::vector<CRingCTCheck> vBlockChecks;
+            audit.fPrepared = PreparePoSBlockAudit(vIndex[i], audit.block, vBlockChecks);
+            if (audit.fPrepared) {
+                for (CRingCTCheck& check : vBlockChecks) {
+                    check.SetFailedFlag(&vChecksFailed[i]);
+                    vChecks.emplace_back();
+                    vChecks.back().swap(check);
                 }
-                nFees += tx.nTxFee;
             }
         }
+    }
 
-        const CTransaction coinstake = block.vtx[1];
-        CCoinsViewCache view(pcoinsTip);
-        nValueIn = GetValueIn(view, coinstake);
-        nValueOut = coinstake.GetValueOut();
-
-        size_t numUTXO = coinstake.vout.size();
-        if (mapBlockIndex.count(block.hashPrevBlock) < 1) {
-            LogPrintf("%s: Previous block not found, received block %s, previous %s, current tip %s\n", __func__, block.GetHash().GetHex(), block.hashPrevBlock.GetHex(), chainActive.Tip()->GetBlockHash().GetHex());
-            return false;
-        }
-        CAmount blockValue = GetBlockValue(mapBlockIndex[block.hashPrevBlock]->nHeight);
-        const CTxOut& mnOut = coinstake.vout[numUTXO - 1];
-        std::string mnsa(mnOut.masternodeStealthAddress.begin(), mnOut.masternodeStealthAddress.end());
-        if (!VerifyDerivedAddress(mnOut, mnsa)) {
-            LogPrintf("%s: Incorrect derived address for masternode rewards\n", __func__);
-            return false;
+    // The checks of all blocks share the RingCT check queue workers, like the checks of ConnectBlock.
+    // The control must be released before taking cs_main: ConnectBlock waits for it while holding cs_main.
+    {
+        CCheckQueueControl<CRingCTCheck> control(nScriptCheckThreads ? &ringctcheckqueue : nullptr);
+        if (nScriptCheckThreads) {
+            control.Add(vChecks);
+            control.Wait();
+        } else {
+            for (CRingCTCheck& check : vChecks)
+                check();
         }
+    }
 
-        // track money supply and mint amount info
-        CAmount nMoneySupplyPrev = pindex->pprev ? pindex->pprev->nMoneySupply : 0;
-        pindex->nMoneySupply = nMoneySupplyPrev + nValueOut - nValueIn - nFees;
-        LogPrint(BCLog::SUPPLY, "%s: nMoneySupplyPrev=%d, pindex->nMoneySupply=%d, nFees = %d\n", __func__, nMoneySupplyPrev, pindex->nMoneySupply, nFees);
-        pindex->nMint = pindex->nMoneySupply - nMoneySupplyPrev + nFees;
-
-        //PoW phase redistributed fees to miner. PoS stage destroys fees.
-        CAmount nExpectedMint = GetBlockValue(pindex->pprev->nHeight);
-        nExpectedMint += nFees;
-
-        if (!IsBlockValueValid(pindex->nHeight, nExpectedMint, pindex->nMint)) {
-            LogPrintf("%s: reward pays too much (actual=%s vs limit=%s)\n", __func__, FormatMoney(pindex->nMint), FormatMoney(nExpectedMint));
-            return false;
-        }
-        return true;
+    LOCK(cs_main);
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        CPoSBlockAudit& audit = vAudits[i];
+        if (!audit.fPrepared || vChecksFailed[i] || !FinishPoSBlockAudit(vIndex[i], audit.block))
+            continue;
+        SetPoSBlockAudited(vIndex[i]);
+        vAudited[i] = true;
     }
 }
 
@@ -1415,8 +1788,19 @@ bool VerifyShnorrKeyImageTxIn(const CTxIn& txin, uint256 ctsHash)
     uint256 s(txin.s);
     unsigned char S[33];
     CPubKey P;
-    ExtractPubKey(prev.vout[prevout.n].scriptPubKey, P);
-    PointHashingSuccessively(P, s.begin(), S);
+    if (!ExtractPubKey(prev.vout[prevout.n].scriptPubKey, P))
+        return false;
+    if (P.IsCompressed()) {
+        // S = s * Hp(P)
+        secp256k1_pubkey2 hp;
+        GetHashToPoint(P, hp);
+        if (!secp256k1_ec_pubkey_tweak_mul2(GetContext(), &hp, s.begin()))
+            return false;
+        size_t sLength = 33;
+        secp256k1_ec_pubkey_serialize2(GetContext(), S, &sLength, &hp, SECP256K1_EC_COMPRESSED);
+    } else {
+        PointHashingSuccessively(P, s.begin(), S);
+    }
     CPubKey R(txin.R.begin(), txin.R.end());
 
     //compute H(R)I = eI
@@ -1529,23 +1913,22 @@ bool CheckHaveInputs(const CCoinsViewCache& view, const CTransaction& tx)
 
             alldecoys.push_back(tx.vin[i].prevout);
             for (size_t j = 0; j < alldecoys.size(); j++) {
-                CTransaction prev;
-                uint256 bh;
-                if (!GetTransaction(alldecoys[j].hash, prev, bh, true)) {
+                CDiskRingMember member;
+                if (!GetRingMemberInfo(alldecoys[j], member)) {
                     return false;
                 }
 
-                if (mapBlockIndex.count(bh) < 1) return false;
-                if (prev.IsCoinStake() || prev.IsCoinAudit() || prev.IsCoinBase()) {
-                    if (nSpendHeight - mapBlockIndex[bh]->nHeight < Params().COINBASE_MATURITY()) return false;
+                BlockMap::const_iterator mi = mapBlockIndex.find(member.hashBlock);
+                if (mi == mapBlockIndex.end()) return false;
+                if (member.fGenerated) {
+                    if (nSpendHeight - mi->second->nHeight < Params().COINBASE_MATURITY()) return false;
                 }
 
                 CBlockIndex* tip = chainActive.Tip();
                 if (!pindexPrev) tip = pindexPrev;
 
-                uint256 hashTip = tip->GetBlockHash();
                 //verify that tip and hashBlock must be in the same fork
-                CBlockIndex* atTheblock = mapBlockIndex[bh];
+                CBlockIndex* atTheblock = mi->second;
                 if (!atTheblock) {
                     LogPrintf("%s: Decoy for transaction %s not in the same chain as block height=%s hash=%s\n", __func__, alldecoys[j].hash.GetHex(), tip->nHeight, tip->GetBlockHash().GetHex());
                     return false;
@@ -1636,11 +2019,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                     } else {
                         banscore = 1;
                     }
-                    if (!VerifyRingSignatureWithTxFee(tx, chainActive.Tip())) {
+                    bool fRingSignatureValid = false, fBulletProofValid = false;
+                    const bool fPreVerified = GetPreVerifiedTransaction(tx, fRingSignatureValid, fBulletProofValid);
+                    if (!(fPreVerified ? fRingSignatureValid : VerifyRingSignatureWithTxFee(tx, chainActive.Tip()))) {
                         return state.DoS(banscore, error("AcceptToMemoryPool() : Ring Signature check for transaction %s failed", tx.GetHash().ToString()),
                             REJECT_INVALID, "bad-ring-signature");
                     }
-                    if (!VerifyBulletProofAggregate(tx))
+                    if (!(fPreVerified ? fBulletProofValid : VerifyBulletProofAggregate(tx)))
                         return state.DoS(100, error("AcceptToMemoryPool() : Bulletproof check for transaction %s failed", tx.GetHash().ToString()),
                             REJECT_INVALID, "bad-bulletproof");
                 }
@@ -1649,7 +2034,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
             // Check key images not duplicated with what in db
             for (const CTxIn& txin : tx.vin) {
                 const CKeyImage& keyImage = txin.keyImage;
-                if (IsSpentKeyImage(keyImage.GetHex(), UINT256_ZERO)) {
+                if (IsSpentKeyImage(keyImage, UINT256_ZERO)) {
                     return state.Invalid(error("AcceptToMemoryPool : key image already spent %s", keyImage.GetHex()),
                         REJECT_DUPLICATE, "bad-txns-inputs-spent");
                 }
@@ -1667,12 +2052,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
                 alldecoys.push_back(tx.vin[i].prevout);
                 for (size_t j = 0; j < alldecoys.size(); j++) {
-                    CTransaction prev;
-                    uint256 bh;
-                    if (!GetTransaction(alldecoys[j].hash, prev, bh, true)) {
+                    CDiskRingMember member;
+                    if (!GetRingMemberInfo(alldecoys[j], member)) {
                         return false;
                     }
-                    if (mapBlockIndex.count(bh) < 1) return false;
+                    if (mapBlockIndex.count(member.hashBlock) < 1) return false;
                     if (!ValidOutPoint(alldecoys[j])) {
                         return state.DoS(100, error("%s : tried to spend invalid decoy %s in tx %s", __func__, alldecoys[j].ToString(),
                                                     tx.GetHash().GetHex()), REJECT_INVALID, "bad-txns-invalid-inputs");
@@ -1794,6 +2178,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
                     }
                 }
             }
+            pwalletMain->MarkBalancesDirty();
         }
     }
 
@@ -1887,12 +2272,11 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 
                 alldecoys.push_back(tx.vin[i].prevout);
                 for (size_t j = 0; j < alldecoys.size(); j++) {
-                    CTransaction prev;
-                    uint256 bh;
-                    if (!GetTransaction(alldecoys[j].hash, prev, bh, true)) {
+                    CDiskRingMember member;
+                    if (!GetRingMemberInfo(alldecoys[j], member)) {
                         return false;
                     }
-                    if (mapBlockIndex.count(bh) < 1) return false;
+                    if (mapBlockIndex.count(member.hashBlock) < 1) return false;
                     if (!ValidOutPoint(alldecoys[j])) {
                         return state.DoS(100, error("%s : tried to spend invalid decoy %s in tx %s", __func__, alldecoys[j].ToString(),
                                                     tx.GetHash().GetHex()), REJECT_INVALID, "bad-txns-invalid-inputs");
@@ -2732,6 +3116,37 @@ bool CScriptCheck::operator()()
     return true;
 }
 
+bool CRingCTCheck::operator()()
+{
+    if (Verify())
+        return true;
+    if (!pfFailed)
+        return false;
+    *pfFailed = true;
+    return true;
+}
+
+bool CRingCTCheck::Verify()
+{
+    try {
+        if (ptxTo && !VerifyRingSignature(*ptxTo, vRingMembers)) {
+            if (pfRingSignatureFailed)
+                *pfRingSignatureFailed = true;
+            return ::error("CRingCTCheck(): Ring Signature check for transaction %s failed", ptxTo->GetHash().ToString());
+        }
+        if (!vBulletProofTxs.empty()) {
+            CScratchSpace scratch;
+            if (!VerifyBulletProofBatch(vBulletProofTxs, scratch.get()))
+                return ::error("CRingCTCheck(): Bulletproof batch check failed");
+        }
+    } catch (const std::exception& e) {
+        if (ptxTo && pfRingSignatureFailed)
+            *pfRingSignatureFailed = true;
+        return ::error("CRingCTCheck(): %s", e.what());
+    }
+    return true;
+}
+
 std::map<COutPoint, COutPoint> mapInvalidOutPoints;
 
 // Populate global map (mapInvalidOutPoints) of invalid/fraudulent OutPoints that are banned from being used on the chain.
@@ -2999,6 +3414,12 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+void ThreadRingCTCheck()
+{
+    util::ThreadRename("prcycoin-ringctch");
+    ringctcheckqueue.Thread();
+}
+
 bool RecalculatePRCYSupply(int nHeightStart)
 {
     const int chainHeight = chainActive.Height();
@@ -3166,6 +3587,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    // Ring signatures and bulletproofs are skipped during initial block download
+    bool fRingCTChecks = !IsInitialBlockDownload();
+    std::atomic<bool> fRingSignatureFailed(false);
+    CCheckQueueControl<CRingCTCheck> ringctcontrol(fRingCTChecks && nScriptCheckThreads ? &ringctcheckqueue : nullptr);
+    std::vector<const CTransaction*> vBulletProofTxs;
+    std::vector<CKeyImage> vKeyImages;
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
@@ -3174,6 +3601,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
+    std::vector<std::pair<COutPoint, CDiskRingMember> > vRingMemberIndex;
     CBlockUndo blockundo;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     CAmount nValueOut = 0;
@@ -3190,12 +3618,25 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!block.IsPoABlockByVersion() && !tx.IsCoinBase()) {
             if (!tx.IsCoinStake()) {
                 if (!tx.IsCoinAudit()) {
-                    if (!VerifyRingSignatureWithTxFee(tx, pindex))
+                    if (tx.nTxFee < 0)
                         return state.DoS(100, error("ConnectBlock() : Ring Signature check for transaction %s failed", tx.GetHash().ToString()),
                             REJECT_INVALID, "bad-ring-signature");
-                    if (!VerifyBulletProofAggregate(tx))
-                        return state.DoS(100, error("ConnectBlock() : Bulletproof check for transaction %s failed", tx.GetHash().ToString()),
-                            REJECT_INVALID, "bad-bulletproof");
+                    if (fRingCTChecks) {
+                        std::vector<std::vector<CRingMember> > vRingMembers;
+                        if (!GetRingMembers(tx, pindex, vRingMembers))
+                            return state.DoS(100, error("ConnectBlock() : Ring Signature check for transaction %s failed", tx.GetHash().ToString()),
+                                REJECT_INVALID, "bad-ring-signature");
+                        CRingCTCheck check(tx, vRingMembers, &fRingSignatureFailed);
+                        if (nScriptCheckThreads) {
+                            std::vector<CRingCTCheck> vRingCTChecks(1);
+                            check.swap(vRingCTChecks[0]);
+                            ringctcontrol.Add(vRingCTChecks);
+                        } else if (!check()) {
+                            return state.DoS(100, error("ConnectBlock() : Ring Signature check for transaction %s failed", tx.GetHash().ToString()),
+                                REJECT_INVALID, "bad-ring-signature");
+                        }
+                        vBulletProofTxs.push_back(&tx);
+                    }
                 }
             }
 
@@ -3203,16 +3644,16 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             uint256 bh = pindex->GetBlockHash();
             for (const CTxIn& in : tx.vin) {
                 const CKeyImage& keyImage = in.keyImage;
-                std::string kh = keyImage.GetHex();
-                if (IsSpentKeyImage(kh, bh)) {
+                if (IsSpentKeyImage(keyImage, bh)) {
                     //remove transaction from the pool?
                     return state.Invalid(error("ConnectBlock() : key image already spent"),
                         REJECT_DUPLICATE, "bad-txns-inputs-spent");
                 }
-                pblocktree->WriteKeyImage(keyImage.GetHex(), bh);
+                vKeyImages.push_back(keyImage);
                 if (pwalletMain != NULL && !pwalletMain->IsLocked()) {
                     if (pwalletMain->GetDebit(in, ISMINE_ALL)) {
                         pwalletMain->keyImagesSpends[keyImage.GetHex()] = true;
+                        pwalletMain->MarkBalancesDirty();
                     }
                     pwalletMain->pendingKeyImages.remove(keyImage.GetHex());
                 }
@@ -3229,12 +3670,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
                 alldecoys.push_back(tx.vin[i].prevout);
                 for (size_t j = 0; j < alldecoys.size(); j++) {
-                    CTransaction prev;
-                    uint256 bh;
-                    if (!GetTransaction(alldecoys[j].hash, prev, bh, true)) {
+                    CDiskRingMember member;
+                    if (!GetRingMemberInfo(alldecoys[j], member)) {
                         return false;
                     }
-                    if (mapBlockIndex.count(bh) < 1) return false;
+                    if (mapBlockIndex.count(member.hashBlock) < 1) return false;
                     if (!ValidOutPoint(alldecoys[j]) && nHeight > Params().FixChecks()) {
                         return state.DoS(100, error("%s : tried to spend invalid decoy %s in tx %s", __func__, alldecoys[j].ToString(),
                                                     tx.GetHash().GetHex()), REJECT_INVALID, "bad-txns-invalid-inputs");
@@ -3270,6 +3710,34 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
         vPos.emplace_back(tx.GetHash(), pos);
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            CDiskRingMember member;
+            if (!ExtractPubKey(tx.vout[j].scriptPubKey, member.pubkey))
+                continue;
+            member.commitment = tx.vout[j].commitment;
+            member.nHeight = nHeight;
+            member.hashBlock = pindex->GetBlockHash();
+            member.fGenerated = tx.IsCoinBase() || tx.IsCoinStake() || tx.IsCoinAudit();
+            vRingMemberIndex.emplace_back(COutPoint(tx.GetHash(), j), member);
+        }
+    }
+
+    // Batch-verify the bulletproofs of the block, one batch per verification thread
+    if (!vBulletProofTxs.empty()) {
+        const size_t nBatches = std::min(vBulletProofTxs.size(), (size_t)std::max(nScriptCheckThreads, 1));
+        std::vector<CRingCTCheck> vRingCTChecks(nBatches);
+        for (size_t i = 0; i < vBulletProofTxs.size(); i++)
+            vRingCTChecks[i % nBatches].AddBulletProof(*vBulletProofTxs[i]);
+        if (nScriptCheckThreads) {
+            ringctcontrol.Add(vRingCTChecks);
+        } else {
+            for (CRingCTCheck& check : vRingCTChecks) {
+                if (!check())
+                    return state.DoS(100, error("ConnectBlock() : Bulletproof check for block %s failed", block.GetHash().ToString()),
+                        REJECT_INVALID, "bad-bulletproof");
+            }
+        }
     }
 
     if (block.IsProofOfStake()) {
@@ -3318,6 +3786,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (!control.Wait())
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+    if (!ringctcontrol.Wait()) {
+        // reject with the reason the checks give when run inline
+        if (fRingSignatureFailed)
+            return state.DoS(100, error("%s: RingCT CheckQueue failed on a ring signature", __func__), REJECT_INVALID, "bad-ring-signature");
+        return state.DoS(100, error("%s: RingCT CheckQueue failed on a bulletproof", __func__), REJECT_INVALID, "bad-bulletproof");
+    }
     int64_t nTime2 = GetTimeMicros();
     nTimeVerify += nTime2 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1,
@@ -3328,6 +3802,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (fJustCheck)
         return true;
 
+    // Record that the checks PoA blocks repeat for their audited PoS blocks have passed
+    RecordPoSBlockChecks(pindex, fRingCTChecks);
+
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         if (pindex->GetUndoPos().IsNull()) {
@@ -3350,6 +3827,19 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
+    {
+        // Staged for the next block index flush. A transaction confirmed again after a reorg has moved to another block.
+        LOCK(cs_ringMemberCache);
+        for (const auto& entry : vRingMemberIndex) {
+            ringMemberCache.erase(entry.first);
+            mapDirtyRingMembers[entry.first] = entry.second;
+        }
+    }
+
+    // Key image spends are staged and written together with the block index
+    for (const CKeyImage& keyImage : vKeyImages)
+        pkeyImageCache->AddSpend(keyImage, pindex->GetBlockHash());
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -3399,10 +3889,11 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             nLastSetChain = nNow;
         }
         size_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        size_t keyImageCacheSize = pkeyImageCache->DynamicMemoryUsage();
         // The cache is large and close to the limit, but we have time now (not in the middle of a block processing).
-        bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize * (10.0/9) > nCoinCacheUsage;
+        bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && (cacheSize * (10.0/9) > nCoinCacheUsage || keyImageCacheSize * (10.0/9) > nKeyImageCacheUsage);
         // The cache is over the limit, we have to write now.
-        bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nCoinCacheUsage;
+        bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && (cacheSize > nCoinCacheUsage || keyImageCacheSize > nKeyImageCacheUsage);
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
         bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
         // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
@@ -3430,10 +3921,22 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                     vBlocks.push_back(*it);
                     setDirtyBlockIndex.erase(it++);
                 }
+                std::vector<std::pair<CKeyImage, std::vector<uint256> > > vKeyImages;
+                pkeyImageCache->GetDirty(vKeyImages);
+                std::vector<std::pair<COutPoint, CDiskRingMember> > vRingMembers;
+                {
+                    LOCK(cs_ringMemberCache);
+                    vRingMembers.assign(mapDirtyRingMembers.begin(), mapDirtyRingMembers.end());
+                }
 
-                if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
+                if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks, vKeyImages, vRingMembers)) {
                     return AbortNode(state, "Files to write to block index database");
                 }
+                {
+                    LOCK(cs_ringMemberCache);
+                    for (const auto& entry : vRingMembers)
+                        mapDirtyRingMembers.erase(entry.first);
+                }
             }
             nLastWrite = nNow;
         }
@@ -3450,6 +3953,9 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             // Flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
+            // Key image spends were written with the block index above; drop the clean entries if over budget.
+            if (pkeyImageCache->DynamicMemoryUsage() > nKeyImageCacheUsage)
+                pkeyImageCache->Uncache();
             nLastFlush = nNow;
         }
         if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
@@ -3478,6 +3984,9 @@ void static UpdateTip(CBlockIndex* pindexNew)
     // New best block
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
+    // Depths and maturity of the wallet coins move with the tip
+    if (pwalletMain)
+        pwalletMain->MarkBalancesDirty();
 
     {
         LOCK(g_best_block_mutex);
@@ -3530,6 +4039,15 @@ bool static DisconnectTip(CValidationState& state)
             return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
     }
+    // Undo the key image spends recorded by ConnectBlock
+    if (!block.IsPoABlockByVersion()) {
+        for (const CTransaction& tx : block.vtx) {
+            if (tx.IsCoinBase())
+                continue;
+            for (const CTxIn& in : tx.vin)
+                pkeyImageCache->RemoveSpend(in.keyImage, pindexDelete->GetBlockHash());
+        }
+    }
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
@@ -3546,6 +4064,11 @@ bool static DisconnectTip(CValidationState& state)
     mempool.check(pcoinsTip);
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
+    // Outputs spent in the disconnected block are spendable again, its own outputs are no decoys anymore
+    if (pwalletMain) {
+        pwalletMain->MarkSpendableOutputsDirty();
+        pwalletMain->RemoveBlockDecoys(block, pindexDelete->nHeight);
+    }
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:void
 
@@ -3625,6 +4148,8 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     mempool.check(pcoinsTip);
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
+    if (pwalletMain)
+        pwalletMain->AddBlockDecoys(*pblock);
     // Tell wallet about transactions that went from mempool
     // to conflicted:
     for (const CTransaction& tx : txConflicted) {
@@ -3696,9 +4221,8 @@ void RemoveInvalidTransactionsFromMempool()
     for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it) {
         const CTransaction& tx = it->second.GetTx();
         for(size_t i = 0; i < tx.vin.size(); i++) {
-            std::string kiHex = tx.vin[i].keyImage.GetHex();
             int confirm = 0;
-            if (CheckKeyImageSpendInMainChain(kiHex, confirm)) {
+            if (CheckKeyImageSpendInMainChain(tx.vin[i].keyImage, confirm)) {
                 if (confirm > Params().MaxReorganizationDepth()) {
                     tobeRemoveds.push_back(tx);
                     break;
@@ -4063,6 +4587,7 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         pindexNew->pprev = (*miPrev).second;
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
+        pindexNew->BuildPrevPoAPoS();
 
         //update previous block pointer
         pindexNew->pprev->pnext = pindexNew;
@@ -4733,7 +5258,7 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
                 if(hasPRCYInputs)
                     // Check if coinstake input is double spent inside the same block
                     for (const CTxIn& prcyIn : prcyInputs){
-                        if (IsSpentKeyImage(prcyIn.keyImage.GetHex(), block.GetHash())) {
+                        if (IsSpentKeyImage(prcyIn.keyImage, block.GetHash())) {
                             // double spent coinstake input inside block
                             return error("%s: double spent coinstake input: %s, KeyImage: %s inside block: %s", __func__, prcyIn.prevout.hash.GetHex(), prcyIn.keyImage.GetHex(), block.GetHash().GetHex());
                         }
@@ -4771,7 +5296,7 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
 
                             // First regular staking check
                             if(hasPRCYInputs) {
-                                if (IsSpentKeyImage(stakeIn.keyImage.GetHex(), bl.GetHash())) {
+                                if (IsSpentKeyImage(stakeIn.keyImage, bl.GetHash())) {
                                     return state.DoS(100, error("%s: input: %s already spent on a previous block: %s", __func__, stakeIn.keyImage.GetHex(), bl.GetHash().GetHex()));
                                 }
                             }
@@ -4887,6 +5412,14 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+void CBlockIndex::BuildPrevPoAPoS()
+{
+    if (pprev) {
+        pprevPoA = pprev->IsProofOfAudit() ? pprev : pprev->pprevPoA;
+        pprevPoS = pprev->IsProofOfStake() ? pprev : pprev->pprevPoS;
+    }
+}
+
 bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp)
 {
     AssertLockNotHeld(cs_main);
@@ -4900,14 +5433,22 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
 
     if (pblock->GetHash() != Params().HashGenesisBlock() && pfrom != NULL) {
         //if we get this far, check if the prev block is our prev block, if not then request sync and return false
-        BlockMap::iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
-        if (mi == mapBlockIndex.end() || (mi != mapBlockIndex.end() && mi->second == NULL)) {
-            mapBlockIndex.erase(pblock->hashPrevBlock);
+        CBlockIndex* pindexPrev = NULL;
+        {
+            // Blocks from other peers may be processed at the same time
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
+            if (mi == mapBlockIndex.end() || mi->second == NULL)
+                mapBlockIndex.erase(pblock->hashPrevBlock);
+            else
+                pindexPrev = mi->second;
+        }
+        if (!pindexPrev) {
             pfrom->PushMessage(NetMsgType::GETBLOCKS, chainActive.GetLocator(), UINT256_ZERO);
             return false;
         } else {
             CBlock r;
-            if (!ReadBlockFromDisk(r, mapBlockIndex[pblock->hashPrevBlock])) {
+            if (!ReadBlockFromDisk(r, pindexPrev)) {
                 pfrom->PushMessage(NetMsgType::GETBLOCKS, chainActive.GetLocator(), UINT256_ZERO);
                 return false;
             }
@@ -4938,6 +5479,7 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
                 if (pblock->IsProofOfStake()) {
                     if (pwalletMain->IsMine(pblock->vtx[1].vin[0])) {
                         pwalletMain->mapWallet.erase(pblock->vtx[1].GetHash());
+                        pwalletMain->MarkBalancesDirty();
                     }
                 }
             }
@@ -4998,87 +5540,6 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
         pwalletMain->resetPendingOutPoints();
     }
 
-    //Block is accepted, let's update decoys pool
-    //First, update user decoy pool
-    int userTxStartIdx = 1;
-    int coinbaseIdx = 0;
-    if (pwalletMain) {
-        LOCK2(cs_main, pwalletMain->cs_wallet);
-        {
-            if (pblock->IsProofOfStake()) {
-                userTxStartIdx = 2;
-                coinbaseIdx = 1;
-            }
-
-            if (pblock->IsProofOfStake()) {
-                if (pwalletMain->userDecoysPool.count(pblock->vtx[1].vin[0].prevout) == 1) {
-                    pwalletMain->userDecoysPool.erase(pblock->vtx[1].vin[0].prevout);
-                }
-
-                if (pwalletMain->coinbaseDecoysPool.count(pblock->vtx[1].vin[0].prevout) == 1) {
-                    pwalletMain->coinbaseDecoysPool.erase(pblock->vtx[1].vin[0].prevout);
-                }
-            }
-
-            if ((int)pblock->vtx.size() > userTxStartIdx) {
-                for (int i = userTxStartIdx; i < (int)pblock->vtx.size(); i++) {
-                    for (int j = 0; j < (int)pblock->vtx[i].vout.size(); j++) {
-                        if (!pblock->vtx[i].vout[j].commitment.empty() && (secp256k1_rand32() % 100) <= CWallet::PROBABILITY_NEW_COIN_SELECTED) {
-                            COutPoint newOutPoint(pblock->vtx[i].GetHash(), j);
-                            if (pwalletMain->userDecoysPool.count(newOutPoint) == 1) {
-                                continue;
-                            }
-                            //add new user transaction to the pool
-                            if ((int32_t)pwalletMain->userDecoysPool.size() >= CWallet::MAX_DECOY_POOL) {
-                                int selected = secp256k1_rand32() % CWallet::MAX_DECOY_POOL;
-                                std::map<COutPoint, uint256>::const_iterator it = std::next(pwalletMain->userDecoysPool.begin(), selected);
-                                pwalletMain->userDecoysPool.erase(it->first);
-                                pwalletMain->userDecoysPool[newOutPoint] = pblock->GetHash();
-                            } else {
-                                pwalletMain->userDecoysPool[newOutPoint] = pblock->GetHash();
-                            }
-                        }
-                    }
-                }
-            }
-
-            if (chainActive.Height() > Params().COINBASE_MATURITY()) {
-                //read block chainActive.Height() - Params().COINBASE_MATURITY()
-                CBlockIndex* p = chainActive[chainActive.Height() - Params().COINBASE_MATURITY()];
-                CBlock b;
-                if (ReadBlockFromDisk(b, p)) {
-                    coinbaseIdx = 0;
-                    if (p->IsProofOfStake()) {
-                        coinbaseIdx = 1;
-                    }
-                    CTransaction& coinbase = b.vtx[coinbaseIdx];
-                    if (b.posBlocksAudited.size() == 0) {
-                        for (int i = 0; i < (int)coinbase.vout.size(); i++) {
-                            if (!coinbase.vout[i].IsNull() && !coinbase.vout[i].commitment.empty() && coinbase.vout[i].nValue > 0 && !coinbase.vout[i].IsEmpty()) {
-                                if ((secp256k1_rand32() % 100) <= CWallet::PROBABILITY_NEW_COIN_SELECTED) {
-                                    COutPoint newOutPoint(coinbase.GetHash(), i);
-                                    if (pwalletMain->coinbaseDecoysPool.count(newOutPoint) == 1) {
-                                        continue;
-                                    }
-                                    //add new coinbase transaction to the pool
-                                    if ((int)pwalletMain->coinbaseDecoysPool.size() >= CWallet::MAX_DECOY_POOL) {
-                                        int selected = secp256k1_rand32() % CWallet::MAX_DECOY_POOL;
-                                        std::map<COutPoint, uint256>::const_iterator it = std::next(pwalletMain->coinbaseDecoysPool.begin(), selected);
-                                        pwalletMain->coinbaseDecoysPool.erase(it->first);
-                                        pwalletMain->coinbaseDecoysPool[newOutPoint] = pblock->GetHash();
-                                    } else {
-                                        pwalletMain->coinbaseDecoysPool[newOutPoint] = pblock->GetHash();
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-            LogPrintf("%s: Coinbase decoys = %d, user decoys = %d\n", __func__, pwalletMain->coinbaseDecoysPool.size(), pwalletMain->userDecoysPool.size());
-        }
-    }
-
     LogPrintf("%s: ACCEPTED in %ld milliseconds with size=%d, height=%d\n", __func__, GetTimeMillis() - nStartTime,
         pblock->GetSerializeSize(SER_DISK, CLIENT_VERSION), chainActive.Height());
 
@@ -5221,8 +5682,10 @@ bool static LoadBlockIndexDB(std::string& strError)
         if (pindex->nStatus & BLOCK_FAILED_MASK &&
             (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
             pindexBestInvalid = pindex;
-        if (pindex->pprev)
+        if (pindex->pprev) {
             pindex->BuildSkip();
+            pindex->BuildPrevPoAPoS();
+        }
         if (pindex->IsValid(BLOCK_VALID_TREE) &&
             (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
@@ -5404,6 +5867,11 @@ void UnloadBlockIndex()
     nPreferredDownload = 0;
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
+    {
+        LOCK(cs_ringMemberCache);
+        mapDirtyRingMembers.clear();
+        ringMemberCache.clear();
+    }
     mapNodeState.clear();
     recentRejects.reset(nullptr);
 
@@ -5775,6 +6243,40 @@ std::string GetWarnings(std::string strFor)
 // Messages
 //
 
+/**
+ * With -msghandlerthreads above 1 the message handler threads work on different peers at the same
+ * time. Block, transaction, header and address messages take cs_main or their own locks where they
+ * touch shared state, so they run without a handler lock. The masternode, payment, budget, sync and
+ * SwiftX gossip keeps its state outside of cs_main and was written for a single thread, so
+ * cs_processGossip serializes it. SwiftX also holds cs_main, because mempool acceptance and block
+ * validation read its locks. inv, getdata and SendMessages look into the gossip maps through
+ * AlreadyHave() and ProcessGetData(), so they hold cs_processGossip there.
+ *
+ * Lock order: CNode::cs_msgProcessing, CNode::cs_vRecvMsg or CNode::cs_sendProcessing, cs_processGossip,
+ * cs_main, then the locks of the masternode managers. Transactions are pre-verified before cs_main is taken.
+ */
+static RecursiveMutex cs_processGossip;
+
+static bool IsSwiftTXCommand(const std::string& strCommand)
+{
+    return strCommand == NetMsgType::IX ||
+           strCommand == NetMsgType::IXLOCKVOTE;
+}
+
+static bool IsMasternodeGossipCommand(const std::string& strCommand)
+{
+    return strCommand == NetMsgType::DSEG ||
+           strCommand == NetMsgType::MNBROADCAST ||
+           strCommand == NetMsgType::MNPING ||
+           strCommand == NetMsgType::MNWINNER ||
+           strCommand == NetMsgType::GETMNWINNERS ||
+           strCommand == NetMsgType::BUDGETPROPOSAL ||
+           strCommand == NetMsgType::BUDGETVOTE ||
+           strCommand == NetMsgType::BUDGETVOTESYNC ||
+           strCommand == NetMsgType::FINALBUDGET ||
+           strCommand == NetMsgType::FINALBUDGETVOTE ||
+           strCommand == NetMsgType::SYNCSTATUSCOUNT;
+}
 
 bool static AlreadyHave(const CInv& inv)
 {
@@ -6434,6 +6936,9 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
+        // Verify the proofs before cs_main is taken, so that the curve arithmetic of one peer does not hold up the others
+        PreVerifyTransaction(tx);
+
         LOCK(cs_main);
 
         bool fMissingInputs = false;
@@ -6605,8 +7110,15 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         CInv inv(MSG_BLOCK, hashBlock);
         LogPrint(BCLog::NET, "received block %s peer=%d, height=%d\n", inv.hash.ToString(), pfrom->id, chainActive.Height());
 
+        bool fHavePrev, fHaveBlock;
+        {
+            LOCK(cs_main);
+            fHavePrev = mapBlockIndex.count(block.hashPrevBlock);
+            fHaveBlock = mapBlockIndex.count(hashBlock);
+        }
+
         //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
-        if (!mapBlockIndex.count(block.hashPrevBlock)) {
+        if (!fHavePrev) {
             if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 //we already asked for this block, so lets work backwards and ask for the previous block
                 pfrom->PushMessage(NetMsgType::GETBLOCKS, chainActive.GetLocator(), block.hashPrevBlock);
@@ -6619,7 +7131,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         } else {
             pfrom->AddInventoryKnown(inv);
             CValidationState state;
-            if (!mapBlockIndex.count(block.GetHash())) {
+            if (!fHaveBlock) {
                 ProcessNewBlock(state, pfrom, &block);
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
@@ -6857,8 +7369,10 @@ bool ProcessMessages(CNode* pfrom)
     //
     bool fOk = true;
 
-    if (!pfrom->vRecvGetData.empty())
+    if (!pfrom->vRecvGetData.empty()) {
+        LOCK(cs_processGossip);
         ProcessGetData(pfrom);
+    }
 
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
@@ -6910,7 +7424,16 @@ bool ProcessMessages(CNode* pfrom)
         // Process message
         bool fRet = false;
         try {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            if (IsSwiftTXCommand(strCommand)) {
+                LOCK2(cs_processGossip, cs_main);
+                fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            } else if (IsMasternodeGossipCommand(strCommand) ||
+                       strCommand == NetMsgType::INV || strCommand == NetMsgType::GETDATA) {
+                LOCK(cs_processGossip);
+                fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            } else {
+                fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            }
             boost::this_thread::interruption_point();
         } catch (const std::ios_base::failure& e) {
             pfrom->PushMessage(NetMsgType::REJECT, strCommand, REJECT_MALFORMED, std::string("error parsing message"));
@@ -6947,11 +7470,11 @@ bool ProcessMessages(CNode* pfrom)
 
 bool SendMessages(CNode* pto)
 {
-    {
-        // Don't send anything until we get their version message
-        if (pto->nVersion == 0)
-            return true;
+    // Don't send anything until we get their version message
+    if (pto->nVersion == 0)
+        return true;
 
+    {
         //
         // Message: ping
         //
@@ -7148,9 +7671,24 @@ bool SendMessages(CNode* pto)
             }
         }
 
-        //
-        // Message: getdata (non-blocks)
-        //
+        if (!vGetData.empty())
+            pto->PushMessage(NetMsgType::GETDATA, vGetData);
+    }
+
+    //
+    // Message: getdata (non-blocks)
+    //
+    {
+        // AlreadyHave() looks into the gossip maps, and cs_processGossip comes before cs_main
+        TRY_LOCK(cs_processGossip, lockProcessGossip);
+        if (!lockProcessGossip)
+            return true;
+        TRY_LOCK(cs_main, lockMain);
+        if (!lockMain)
+            return true;
+
+        int64_t nNow = GetTimeMicros();
+        std::vector<CInv> vGetData;
         while (!pto->fDisconnect && !pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow) {
             const CInv& inv = (*pto->mapAskFor.begin()).second;
             if (!AlreadyHave(inv)) {
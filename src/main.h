@@ -33,6 +33,7 @@
 #include "bignum.h"
 
 #include <algorithm>
+#include <atomic>
 #include <exception>
 #include <map>
 #include <set>
@@ -46,6 +47,7 @@
 #include "secp256k1_bulletproofs.h"
 #include "secp256k1_commitment.h"
 #include "secp256k1_generator.h"
+#include "secp256k1_mlsag.h"
 #include "secp256k1.h"
 #include "secp256k1-mw/src/hash_impl.h"
 
@@ -53,6 +55,7 @@ class CBlockIndex;
 class CBlockTreeDB;
 class CBloomFilter;
 class CInv;
+class CRingCTCheck;
 class CScriptCheck;
 class CValidationInterface;
 class CValidationState;
@@ -83,6 +86,18 @@ static const int COINBASE_MATURITY = 100;
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Upper bound on the memory a bulletproof scratch space may allocate for a single proving or verification call */
+static const size_t MAX_BULLETPROOF_SCRATCH_SIZE = 1024 * 1024 * 512;
+/** Maximum number of bulletproofs verified together in one multi-exponentiation */
+static const unsigned int MAX_BULLETPROOF_BATCH_SIZE = 64;
+/** Number of resolved ring members kept in memory in front of the ring member index */
+static const unsigned int RING_MEMBER_CACHE_SIZE = 100000;
+/** Number of hashed-to-curve ring member public keys kept in memory */
+static const unsigned int HASH_TO_POINT_CACHE_SIZE = 100000;
+/** Number of relayed transactions whose proofs are remembered as verified until they reach the mempool */
+static const unsigned int PRE_VERIFIED_TX_CACHE_SIZE = 5000;
+/** Default for -reauditpos */
+static const bool DEFAULT_REAUDIT_POS = false;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -149,7 +164,11 @@ extern int nScriptCheckThreads;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
+/** Re-verify audited PoS blocks instead of using the status recorded when they were connected */
+extern bool fReauditPoS;
 extern size_t nCoinCacheUsage;
+/** Memory budget for the in-memory key image cache */
+extern size_t nKeyImageCacheUsage;
 extern CFeeRate minRelayTxFee;
 extern int64_t nMaxTipAge;
 extern bool fVerifyingBlocks;
@@ -182,14 +201,46 @@ void RegisterNodeSignals(CNodeSignals& nodeSignals);
 /** Unregister a network node */
 void UnregisterNodeSignals(CNodeSignals& nodeSignals);
 
+/** Build the shared secp256k1-mw context and bulletproof generators (done lazily if not called) */
+void InitContext();
 secp256k1_context2* GetContext();
-secp256k1_scratch_space2* GetScratch();
 secp256k1_bulletproof_generators* GetGenerator();
+
+/** RAII handle to a bulletproof scratch space borrowed from a pool of reusable ones */
+class CScratchSpace
+{
+private:
+    secp256k1_scratch_space2* scratch;
+
+    CScratchSpace(const CScratchSpace&);
+    CScratchSpace& operator=(const CScratchSpace&);
+
+public:
+    CScratchSpace();
+    ~CScratchSpace();
+
+    secp256k1_scratch_space2* get() const { return scratch; }
+};
+
 bool VerifyBulletProofAggregate(const CTransaction& tx);
+bool VerifyBulletProofAggregate(const CTransaction& tx, secp256k1_scratch_space2* scratch);
+/**
+ * Verify the bulletproofs of several transactions at once. Proofs of the same shape are
+ * checked together in a single multi-exponentiation; if a batch fails, its proofs are
+ * re-verified one by one so the offending transaction is logged.
+ */
+bool VerifyBulletProofBatch(const std::vector<const CTransaction*>& vtx, secp256k1_scratch_space2* scratch);
 bool VerifyRingSignatureWithTxFee(const CTransaction& tx, CBlockIndex* pindex);
+/** Release the secp256k1-mw context, generators and pooled scratch spaces */
 void DestroyContext();
 bool VerifyDerivedAddress(const CTxOut& out, std::string stealth);
 bool ReVerifyPoSBlock(CBlockIndex* pindex);
+/** Record that ConnectBlock checked a PoS block as a PoA audit would, if fRingCTChecks */
+void RecordPoSBlockChecks(CBlockIndex* pindex, bool fRingCTChecks);
+/** Audit result of a PoS block for PoA mining and validation, re-verifying it only if it has no recorded status */
+bool IsPoSBlockAudited(CBlockIndex* pindex);
+/** Audit results of several PoS blocks, re-verifying those without a recorded status on -par worker threads */
+void AuditPoSBlocks(const std::vector<CBlockIndex*>& vIndex, std::vector<bool>& vAudited);
 
 /**
  * Process an incoming block. This only returns after the best known valid
@@ -232,6 +283,8 @@ bool VerifyZeroBlindCommitment(const CTxOut& out);
 bool SendMessages(CNode* pto);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the RingCT (ring signature and bulletproof) checking thread */
+void ThreadRingCTCheck();
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
@@ -272,8 +325,8 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool isDSTX = false);
 
-bool IsSpentKeyImage(const std::string& kiHex, const uint256& againsHash);
-bool CheckKeyImageSpendInMainChain(const std::string& kiHex, int& confirmations);
+bool IsSpentKeyImage(const CKeyImage& keyImage, const uint256& againsHash);
+bool CheckKeyImageSpendInMainChain(const CKeyImage& keyImage, int& confirmations);
 
 double GetPriority(const CTransaction& tx, int nHeight);
 
@@ -378,6 +431,95 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/** Public key and commitment of one ring member (real input or decoy) */
+struct CRingMember {
+    CPubKey pubkey;
+    std::vector<unsigned char> commitment;
+};
+
+/** Ring member data of a confirmed output, as stored in the ring member index */
+struct CDiskRingMember {
+    CPubKey pubkey;
+    std::vector<unsigned char> commitment;
+    int nHeight;
+    uint256 hashBlock;
+    bool fGenerated; // output of a coinbase, coinstake or coin audit transaction
+
+    CDiskRingMember() : nHeight(0), fGenerated(false) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(pubkey);
+        READWRITE(commitment);
+        READWRITE(nHeight);
+        READWRITE(hashBlock);
+        READWRITE(fGenerated);
+    }
+};
+
+/**
+ * Look up the ring member data of a confirmed output. Served from an in-memory LRU
+ * cache, then the ring member index, and finally the txindex for outputs confirmed
+ * before the index existed. Returns false if the output is not in a known block.
+ */
+bool GetRingMemberInfo(const COutPoint& outpoint, CDiskRingMember& member);
+
+/**
+ * Resolve the public keys and commitments of every ring member of tx, indexed as
+ * [input][ring column]. Requires cs_main, as it reads the block index and txindex.
+ */
+bool GetRingMembers(const CTransaction& tx, CBlockIndex* pindex, std::vector<std::vector<CRingMember> >& vRingMembers);
+
+/** Verify the MLSAG ring signature of tx against already resolved ring members. Does not lock cs_main. */
+bool VerifyRingSignature(const CTransaction& tx, const std::vector<std::vector<CRingMember> >& vRingMembers);
+
+/**
+ * Closure representing RingCT verification work: the ring signature of one transaction
+ * and/or a batch of bulletproofs. The ring members are resolved up front, so the check
+ * itself only does the curve arithmetic and can run on a worker thread without holding
+ * cs_main.
+ * A failed ring signature is flagged in *pfRingSignatureFailed when given, so that the
+ * caller of a check queue can tell it from a failed bulletproof.
+ * With SetFailedFlag, any failure is flagged in *pfFailed instead and the check reports
+ * success, so that a check queue goes on with the checks of other blocks.
+ * Note that this stores references to the verified transactions.
+ */
+class CRingCTCheck
+{
+private:
+    const CTransaction* ptxTo;
+    std::vector<std::vector<CRingMember> > vRingMembers;
+    std::vector<const CTransaction*> vBulletProofTxs;
+    std::atomic<bool>* pfRingSignatureFailed;
+    std::atomic<bool>* pfFailed;
+
+    bool Verify();
+
+public:
+    CRingCTCheck() : ptxTo(0), pfRingSignatureFailed(0), pfFailed(0) {}
+    CRingCTCheck(const CTransaction& txToIn, std::vector<std::vector<CRingMember> >& vRingMembersIn, std::atomic<bool>* pfRingSignatureFailedIn = 0) : ptxTo(&txToIn), pfRingSignatureFailed(pfRingSignatureFailedIn), pfFailed(0)
+    {
+        vRingMembers.swap(vRingMembersIn);
+    }
+
+    void AddBulletProof(const CTransaction& tx) { vBulletProofTxs.push_back(&tx); }
+    void SetFailedFlag(std::atomic<bool>* pfFailedIn) { pfFailed = pfFailedIn; }
+
+    bool operator()();
+
+    void swap(CRingCTCheck& check)
+    {
+        std::swap(ptxTo, check.ptxTo);
+        vRingMembers.swap(check.vRingMembers);
+        vBulletProofTxs.swap(check.vBulletProofTxs);
+        std::swap(pfRingSignatureFailed, check.pfRingSignatureFailed);
+        std::swap(pfFailed, check.pfFailed);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
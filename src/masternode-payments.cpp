@@ -457,11 +457,59 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
         }
     }
 
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(1, winnerIn.vinMasternode.masternodeStealthAddress);
+    {
+        LOCK(cs_mapMasternodeBlocks);
+        CMasternodeBlockPayees& blockPayees = mapMasternodeBlocks[winnerIn.nBlockHeight];
+        blockPayees.AddPayee(1, winnerIn.vinMasternode.masternodeStealthAddress);
+        if (blockPayees.HasPayeeWithVotes(winnerIn.vinMasternode.masternodeStealthAddress, 2))
+            mapPayeeVotedHeights[winnerIn.vinMasternode.masternodeStealthAddress].insert(winnerIn.nBlockHeight);
+    }
 
     return true;
 }
 
+void CMasternodePayments::EraseBlockPayees(int nBlockHeight)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(nBlockHeight);
+    if (it == mapMasternodeBlocks.end()) return;
+
+    for (CMasternodePayee& payee : it->second.vecPayments) {
+        std::map<std::vector<unsigned char>, std::set<int> >::iterator mi = mapPayeeVotedHeights.find(payee.masternodeStealthAddress);
+        if (mi == mapPayeeVotedHeights.end()) continue;
+        mi->second.erase(nBlockHeight);
+        if (mi->second.empty()) mapPayeeVotedHeights.erase(mi);
+    }
+    mapMasternodeBlocks.erase(it);
+}
+
+void CMasternodePayments::RebuildPayeeVotedHeights()
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+
+    mapPayeeVotedHeights.clear();
+    for (std::pair<const int, CMasternodeBlockPayees>& blockPayees : mapMasternodeBlocks) {
+        for (CMasternodePayee& payee : blockPayees.second.vecPayments) {
+            if (payee.nVotes >= 2)
+                mapPayeeVotedHeights[payee.masternodeStealthAddress].insert(blockPayees.first);
+        }
+    }
+}
+
+int CMasternodePayments::GetLastVotedHeight(const std::vector<unsigned char>& payee, int nMinHeight, int nMaxHeight)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    std::map<std::vector<unsigned char>, std::set<int> >::iterator mi = mapPayeeVotedHeights.find(payee);
+    if (mi == mapPayeeVotedHeights.end()) return -1;
+
+    std::set<int>::iterator it = mi->second.upper_bound(nMaxHeight);
+    if (it == mi->second.begin()) return -1;
+    --it;
+    return *it >= nMinHeight ? *it : -1;
+}
+
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 {
     LOCK2(cs_main, cs_vecPayments);
@@ -573,7 +621,7 @@ void CMasternodePayments::CleanPaymentList()
             LogPrint(BCLog::MASTERNODE, "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
             masternodeSync.mapSeenSyncMNW.erase((*it).first);
             mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
+            EraseBlockPayees(winner.nBlockHeight);
         } else {
             ++it;
         }
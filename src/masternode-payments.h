@@ -233,6 +233,11 @@ class CMasternodePayments
 private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
+    // heights of mapMasternodeBlocks at which each payee has at least two votes
+    std::map<std::vector<unsigned char>, std::set<int> > mapPayeeVotedHeights;
+
+    void EraseBlockPayees(int nBlockHeight);
+    void RebuildPayeeVotedHeights();
 
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
@@ -250,6 +255,7 @@ public:
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
+        mapPayeeVotedHeights.clear();
     }
 
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
@@ -258,6 +264,8 @@ public:
     void Sync(CNode* node, int nCountNeeded);
     void CleanPaymentList();
     int LastPayment(CMasternode& mn);
+    /// Highest height from nMinHeight to nMaxHeight at which payee has at least two votes, or -1
+    int GetLastVotedHeight(const std::vector<unsigned char>& payee, int nMinHeight, int nMaxHeight);
 
     bool GetBlockPayee(int nBlockHeight, std::vector<unsigned char>& payee);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
@@ -293,6 +301,10 @@ public:
     {
         READWRITE(mapMasternodePayeeVotes);
         READWRITE(mapMasternodeBlocks);
+        if (ser_action.ForRead()) {
+            LOCK(cs_mapMasternodeBlocks);
+            RebuildPayeeVotedHeights();
+        }
     }
 };
 
@@ -31,14 +31,6 @@ struct CompareLastPaid {
     }
 };
 
-struct CompareScoreTxIn {
-    bool operator()(const std::pair<int64_t, CTxIn>& t1,
-        const std::pair<int64_t, CTxIn>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 struct CompareScoreMN {
     bool operator()(const std::pair<int64_t, CMasternode>& t1,
         const std::pair<int64_t, CMasternode>& t2) const
@@ -203,6 +195,67 @@ CMasternodeMan::CMasternodeMan()
     nDsqCount = 0;
 }
 
+void CMasternodeMan::IndexMasternode(std::list<CMasternode>::iterator it)
+{
+    CMasternodeIndexEntry& entry = mapMasternodesByVin[it->vin.prevout];
+    entry.it = it;
+    entry.pubKeyMasternode = it->pubKeyMasternode;
+    entry.payee = GetScriptForDestination(it->pubKeyCollateralAddress);
+    mapMasternodesByPubKey.insert(std::make_pair(entry.pubKeyMasternode, &(*it)));
+    mapMasternodesByPayee.insert(std::make_pair(entry.payee, &(*it)));
+}
+
+template <typename K>
+static void EraseIndexEntry(std::multimap<K, CMasternode*>& mapIndex, const K& key, const CMasternode* pmn)
+{
+    auto range = mapIndex.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == pmn) {
+            mapIndex.erase(it);
+            return;
+        }
+    }
+}
+
+void CMasternodeMan::UnindexMasternode(std::list<CMasternode>::iterator it)
+{
+    std::map<COutPoint, CMasternodeIndexEntry>::iterator mi = mapMasternodesByVin.find(it->vin.prevout);
+    if (mi == mapMasternodesByVin.end() || mi->second.it != it) return;
+    const CMasternode* pmn = &(*it);
+    EraseIndexEntry(mapMasternodesByPubKey, mi->second.pubKeyMasternode, pmn);
+    EraseIndexEntry(mapMasternodesByPayee, mi->second.payee, pmn);
+    mapMasternodesByVin.erase(mi);
+}
+
+void CMasternodeMan::RebuildIndexes()
+{
+    mapScoresByHeight.clear();
+    mapMasternodesByVin.clear();
+    mapMasternodesByPubKey.clear();
+    mapMasternodesByPayee.clear();
+    std::list<CMasternode>::iterator it = listMasternodes.begin();
+    while (it != listMasternodes.end()) {
+        // keep the first of any duplicates in mncache.dat, the one the linear search used to find
+        if (mapMasternodesByVin.count(it->vin.prevout)) {
+            it = listMasternodes.erase(it);
+            continue;
+        }
+        IndexMasternode(it);
+        ++it;
+    }
+}
+
+void CMasternodeMan::UpdateIndexes(const CTxIn& vin)
+{
+    LOCK(cs);
+
+    std::map<COutPoint, CMasternodeIndexEntry>::iterator mi = mapMasternodesByVin.find(vin.prevout);
+    if (mi == mapMasternodesByVin.end()) return;
+    std::list<CMasternode>::iterator it = mi->second.it;
+    UnindexMasternode(it);
+    IndexMasternode(it);
+}
+
 bool CMasternodeMan::Add(CMasternode& mn)
 {
     LOCK(cs);
@@ -213,7 +266,8 @@ bool CMasternodeMan::Add(CMasternode& mn)
     CMasternode* pmn = Find(mn.vin);
     if (pmn == NULL) {
         LogPrint(BCLog::MASTERNODE, "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
-        vMasternodes.push_back(mn);
+        IndexMasternode(listMasternodes.insert(listMasternodes.end(), mn));
+        mapScoresByHeight.clear();
         return true;
     }
 
@@ -242,7 +296,7 @@ void CMasternodeMan::Check()
 {
     LOCK(cs);
 
-    for (CMasternode& mn : vMasternodes) {
+    for (CMasternode& mn : listMasternodes) {
         mn.Check();
     }
 }
@@ -254,8 +308,8 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     LOCK(cs);
 
     //remove inactive and outdated
-    std::vector<CMasternode>::iterator it = vMasternodes.begin();
-    while (it != vMasternodes.end()) {
+    std::list<CMasternode>::iterator it = listMasternodes.begin();
+    while (it != listMasternodes.end()) {
         if ((*it).activeState == CMasternode::MASTERNODE_REMOVE ||
             (*it).activeState == CMasternode::MASTERNODE_VIN_SPENT ||
             (forceExpiredRemoval && (*it).activeState == CMasternode::MASTERNODE_EXPIRED) ||
@@ -285,7 +339,9 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
                 }
             }
 
-            it = vMasternodes.erase(it);
+            UnindexMasternode(it);
+            mapScoresByHeight.clear();
+            it = listMasternodes.erase(it);
         } else {
             ++it;
         }
@@ -346,7 +402,11 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
 void CMasternodeMan::Clear()
 {
     LOCK(cs);
-    vMasternodes.clear();
+    listMasternodes.clear();
+    mapMasternodesByVin.clear();
+    mapMasternodesByPubKey.clear();
+    mapMasternodesByPayee.clear();
+    mapScoresByHeight.clear();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -362,7 +422,7 @@ int CMasternodeMan::stable_size ()
     int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
     int64_t nMasternode_Age = 0;
 
-    for (CMasternode& mn : vMasternodes) {
+    for (CMasternode& mn : listMasternodes) {
         if (mn.protocolVersion < nMinProtocol) {
             continue; // Skip obsolete versions
         }
@@ -381,7 +441,7 @@ int CMasternodeMan::CountEnabled(int protocolVersion)
     int i = 0;
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
-    for (CMasternode& mn : vMasternodes) {
+    for (CMasternode& mn : listMasternodes) {
         mn.Check();
         if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
         i++;
@@ -394,7 +454,7 @@ void CMasternodeMan::CountNetworks(int protocolVersion, int& ipv4, int& ipv6, in
 {
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
-    for (CMasternode& mn : vMasternodes) {
+    for (CMasternode& mn : listMasternodes) {
         mn.Check();
         std::string strHost;
         int port;
@@ -440,25 +500,17 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
 CMasternode* CMasternodeMan::Find(const CScript& payee)
 {
     LOCK(cs);
-    CScript payee2;
 
-    for (CMasternode& mn : vMasternodes) {
-        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress);
-        if (payee2 == payee)
-            return &mn;
-    }
-    return NULL;
+    std::multimap<CScript, CMasternode*>::iterator it = mapMasternodesByPayee.find(payee);
+    return it == mapMasternodesByPayee.end() ? NULL : it->second;
 }
 
 CMasternode* CMasternodeMan::Find(const CTxIn& vin)
 {
     LOCK(cs);
 
-    for (CMasternode& mn : vMasternodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
-    return NULL;
+    std::map<COutPoint, CMasternodeIndexEntry>::iterator it = mapMasternodesByVin.find(vin.prevout);
+    return it == mapMasternodesByVin.end() ? NULL : &(*it->second.it);
 }
 
 
@@ -466,11 +518,34 @@ CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 {
     LOCK(cs);
 
-    for (CMasternode& mn : vMasternodes) {
-        if (mn.pubKeyMasternode == pubKeyMasternode)
-            return &mn;
-    }
-    return NULL;
+    std::multimap<CPubKey, CMasternode*>::iterator it = mapMasternodesByPubKey.find(pubKeyMasternode);
+    return it == mapMasternodesByPubKey.end() ? NULL : it->second;
+}
+
+const CMasternodeMan::CMasternodeScores& CMasternodeMan::GetScores(int64_t nBlockHeight, const uint256& hashBlock)
+{
+    AssertLockHeld(cs);
+
+    std::map<int64_t, CMasternodeScores>::iterator it = mapScoresByHeight.find(nBlockHeight);
+    // a different hash means the block at this height was reorganized away
+    if (it != mapScoresByHeight.end() && it->second.hashBlock == hashBlock)
+        return it->second;
+
+    if (it == mapScoresByHeight.end() && mapScoresByHeight.size() >= MASTERNODES_SCORE_CACHE_HEIGHTS)
+        mapScoresByHeight.erase(mapScoresByHeight.begin());
+
+    CMasternodeScores& scores = mapScoresByHeight[nBlockHeight];
+    scores.hashBlock = hashBlock;
+    scores.vecRanked.clear();
+    scores.mapScores.clear();
+    for (CMasternode& mn : listMasternodes) {
+        uint256 n = mn.CalculateScore(hashBlock);
+        scores.mapScores[mn.vin.prevout] = n;
+        scores.vecRanked.push_back(std::make_pair(n.GetCompact(false), &mn));
+    }
+    std::stable_sort(scores.vecRanked.begin(), scores.vecRanked.end(),
+        [](const std::pair<int64_t, CMasternode*>& a, const std::pair<int64_t, CMasternode*>& b) { return a.first > b.first; });
+    return scores;
 }
 
 //
@@ -478,6 +553,9 @@ CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 //
 CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount)
 {
+    uint256 hashScoreBlock;
+    bool fHaveScoreBlock = GetBlockHash(hashScoreBlock, nBlockHeight - 100);
+
     LOCK(cs);
 
     CMasternode* pBestMasternode = NULL;
@@ -488,7 +566,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     */
 
     int nMnCount = CountEnabled();
-    for (CMasternode& mn : vMasternodes) {
+    for (CMasternode& mn : listMasternodes) {
         mn.Check();
         if (!mn.IsEnabled()) continue;
 
@@ -504,7 +582,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
         //make sure it has as many confirmations as there are masternodes
         if (mn.GetMasternodeInputAge() < nMnCount) continue;
 
-        vecMasternodeLastPaid.push_back(std::make_pair(mn.SecondsSincePayment(), mn.vin));
+        vecMasternodeLastPaid.push_back(std::make_pair(mn.SecondsSincePayment(nMnCount * 1.25), mn.vin));
     }
 
     nCount = (int)vecMasternodeLastPaid.size();
@@ -522,11 +600,16 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     int nTenthNetwork = CountEnabled() / 10;
     int nCountTenth = 0;
     uint256 nHigh;
+    const CMasternodeScores* pscores = fHaveScoreBlock ? &GetScores(nBlockHeight - 100, hashScoreBlock) : NULL;
     for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeLastPaid) {
         CMasternode* pmn = Find(s.second);
         if (!pmn) break;
 
-        uint256 n = pmn->CalculateScore(1, nBlockHeight - 100);
+        uint256 n;
+        if (pscores) {
+            std::map<COutPoint, uint256>::const_iterator mi = pscores->mapScores.find(pmn->vin.prevout);
+            if (mi != pscores->mapScores.end()) n = mi->second;
+        }
         if (n > nHigh) {
             nHigh = n;
             pBestMasternode = pmn;
@@ -543,7 +626,7 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
     CMasternode* winner = NULL;
 
     // scan for winner
-    for (CMasternode& mn : vMasternodes) {
+    for (CMasternode& mn : listMasternodes) {
         mn.Check();
         if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
 
@@ -563,16 +646,16 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
 
 int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
-    int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
-    int64_t nMasternode_Age = 0;
-
     //make sure we know about this block
     uint256 hash;
     if (!GetBlockHash(hash, nBlockHeight)) return -1;
 
-    // scan for winner
-    for (CMasternode& mn : vMasternodes) {
+    LOCK(cs);
+
+    // walk the scores from the highest down, ranking the Masternodes that pass the filters
+    int rank = 0;
+    for (const PAIRTYPE(int64_t, CMasternode*) & s : GetScores(nBlockHeight, hash).vecRanked) {
+        CMasternode& mn = *s.second;
         if (mn.protocolVersion < minProtocol) {
             LogPrint(BCLog::MASTERNODE,"Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
             continue;                                                       // Skip obsolete versions
@@ -582,18 +665,9 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
             mn.Check();
             if (!mn.IsEnabled()) continue;
         }
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
 
-        vecMasternodeScores.push_back(std::make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeScores) {
         rank++;
-        if (s.second.prevout == vin.prevout) {
+        if (mn.vin.prevout == vin.prevout) {
             return rank;
         }
     }
@@ -610,8 +684,11 @@ std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int
     uint256 hash;
     if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
 
+    LOCK(cs);
+
     // scan for winner
-    for (CMasternode& mn : vMasternodes) {
+    for (const PAIRTYPE(int64_t, CMasternode*) & s : GetScores(nBlockHeight, hash).vecRanked) {
+        CMasternode& mn = *s.second;
         mn.Check();
 
         if (mn.protocolVersion < minProtocol) continue;
@@ -621,10 +698,7 @@ std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int
             continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(std::make_pair(n2, mn));
+        vecMasternodeScores.push_back(std::make_pair(s.first, mn));
     }
 
     sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
@@ -640,29 +714,24 @@ std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
+    //make sure we know about this block
+    uint256 hash;
+    if (!GetBlockHash(hash, nBlockHeight)) return NULL;
 
-    // scan for winner
-    for (CMasternode& mn : vMasternodes) {
+    LOCK(cs);
+
+    int rank = 0;
+    for (const PAIRTYPE(int64_t, CMasternode*) & s : GetScores(nBlockHeight, hash).vecRanked) {
+        CMasternode& mn = *s.second;
         if (mn.protocolVersion < minProtocol) continue;
         if (fOnlyActive) {
             mn.Check();
             if (!mn.IsEnabled()) continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(std::make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeScores) {
         rank++;
         if (rank == nRank) {
-            return Find(s.second);
+            return &mn;
         }
     }
 
@@ -773,7 +842,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
 
         int nInvCount = 0;
-        for (CMasternode& mn : vMasternodes) {
+        for (CMasternode& mn : listMasternodes) {
             if (mn.addr.IsRFC1918()) continue; //local network
 
             if (mn.IsEnabled()) {
@@ -805,14 +874,13 @@ void CMasternodeMan::Remove(CTxIn vin)
 {
     LOCK(cs);
 
-    std::vector<CMasternode>::iterator it = vMasternodes.begin();
-    while (it != vMasternodes.end()) {
-        if ((*it).vin == vin) {
-            LogPrint(BCLog::MASTERNODE, "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
-            vMasternodes.erase(it);
-            break;
-        }
-        ++it;
+    std::map<COutPoint, CMasternodeIndexEntry>::iterator mi = mapMasternodesByVin.find(vin.prevout);
+    if (mi != mapMasternodesByVin.end() && mi->second.it->vin == vin) {
+        std::list<CMasternode>::iterator it = mi->second.it;
+        LogPrint(BCLog::MASTERNODE, "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
+        UnindexMasternode(it);
+        mapScoresByHeight.clear();
+        listMasternodes.erase(it);
     }
 }
 
@@ -831,6 +899,7 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
             masternodeSync.AddedMasternodeList(mnb.GetHash());
         }
     } else if (pmn->UpdateFromNewBroadcast(mnb)) {
+        UpdateIndexes(mnb.vin);
         masternodeSync.AddedMasternodeList(mnb.GetHash());
     }
 }
@@ -839,7 +908,7 @@ std::string CMasternodeMan::ToString() const
 {
     std::ostringstream info;
 
-    info << "Masternodes: " << (int)vMasternodes.size() << ", peers who asked us for Masternode list: " << (int)mAskedUsForMasternodeList.size() << ", peers we asked for Masternode list: " << (int)mWeAskedForMasternodeList.size() << ", entries in Masternode list we asked for: " << (int)mWeAskedForMasternodeListEntry.size();
+    info << "Masternodes: " << (int)listMasternodes.size() << ", peers who asked us for Masternode list: " << (int)mAskedUsForMasternodeList.size() << ", peers we asked for Masternode list: " << (int)mWeAskedForMasternodeList.size() << ", entries in Masternode list we asked for: " << (int)mWeAskedForMasternodeListEntry.size();
 
     return info.str();
 }
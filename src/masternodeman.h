@@ -16,8 +16,12 @@
 #include "sync.h"
 #include "util.h"
 
+#include <list>
+#include <map>
+
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MASTERNODES_SCORE_CACHE_HEIGHTS 50
 
 
 class CMasternodeMan;
@@ -62,8 +66,17 @@ private:
     // critical section to protect the inner data structures specifically on messaging
     mutable RecursiveMutex cs_process_message;
 
-    // map to hold all MNs
-    std::vector<CMasternode> vMasternodes;
+    // list to hold all MNs, so that the pointers handed out by Find stay valid until the entry is removed
+    std::list<CMasternode> listMasternodes;
+    // the keys an entry of listMasternodes was indexed under, by collateral outpoint
+    struct CMasternodeIndexEntry {
+        std::list<CMasternode>::iterator it;
+        CPubKey pubKeyMasternode;
+        CScript payee;
+    };
+    std::map<COutPoint, CMasternodeIndexEntry> mapMasternodesByVin;
+    std::multimap<CPubKey, CMasternode*> mapMasternodesByPubKey;
+    std::multimap<CScript, CMasternode*> mapMasternodesByPayee;
     // who's asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
@@ -71,6 +84,21 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    // scores of all MNs at a block height, highest first, with the block hash they were calculated from
+    struct CMasternodeScores {
+        uint256 hashBlock;
+        std::vector<std::pair<int64_t, CMasternode*> > vecRanked;
+        std::map<COutPoint, uint256> mapScores;
+    };
+    // score tables of recently ranked heights, cleared whenever MNs are added or removed
+    std::map<int64_t, CMasternodeScores> mapScoresByHeight;
+
+    const CMasternodeScores& GetScores(int64_t nBlockHeight, const uint256& hashBlock);
+
+    void IndexMasternode(std::list<CMasternode>::iterator it);
+    void UnindexMasternode(std::list<CMasternode>::iterator it);
+    void RebuildIndexes();
+
 public:
     // Keep track of all broadcasts I've seen
     std::map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -87,7 +115,16 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
         LOCK(cs);
+        // the list is stored as the vector it used to be, so that mncache.dat keeps its format
+        std::vector<CMasternode> vMasternodes;
+        if (!ser_action.ForRead())
+            vMasternodes.assign(listMasternodes.begin(), listMasternodes.end());
         READWRITE(vMasternodes);
+        if (ser_action.ForRead()) {
+            listMasternodes.assign(vMasternodes.begin(), vMasternodes.end());
+            // drops duplicate entries, so that every entry of the list is indexed
+            RebuildIndexes();
+        }
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
         READWRITE(mWeAskedForMasternodeListEntry);
@@ -135,7 +172,8 @@ public:
     std::vector<CMasternode> GetFullMasternodeVector()
     {
         Check();
-        return vMasternodes;
+        LOCK(cs);
+        return std::vector<CMasternode>(listMasternodes.begin(), listMasternodes.end());
     }
 
     std::vector<std::pair<int, CMasternode> > GetMasternodeRanks(int64_t nBlockHeight, int minProtocol = 0);
@@ -145,7 +183,7 @@ public:
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
     /// Return the number of (unique) Masternodes
-    int size() { return vMasternodes.size(); }
+    int size() { return listMasternodes.size(); }
 
     /// Return the number of Masternodes older than (default) 8000 seconds
     int stable_size ();
@@ -154,6 +192,9 @@ public:
 
     void Remove(CTxIn vin);
 
+    /// Index an entry again after its masternode pubkey or collateral address may have changed
+    void UpdateIndexes(const CTxIn& vin);
+
     /// Update masternode list and maps using provided CMasternodeBroadcast
     void UpdateMasternodeList(CMasternodeBroadcast mnb);
 };
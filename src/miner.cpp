@@ -41,27 +41,6 @@ extern CWallet* pwalletMain;
 // PRCYcoinMiner
 //
 
-//
-// Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
-//
-class COrphan
-{
-public:
-    const CTransaction* ptx;
-    std::set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
-
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
-    {
-    }
-};
-
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 int64_t nLastCoinStakeSearchInterval = 0;
@@ -104,47 +83,42 @@ uint32_t GetListOfPoSInfo(uint32_t currentHeight, std::vector<PoSBlockSummary>&
 {
     //A PoA block should be mined only after at least 59 PoS blocks have not been audited
     //Look for the previous PoA block
-    uint32_t nloopIdx = currentHeight;
-    while (nloopIdx >= Params().START_POA_BLOCK()) {
-        if (chainActive[nloopIdx]->GetBlockHeader().IsPoABlockByVersion()) {
-            break;
-        }
-        nloopIdx--;
-    }
+    CBlockIndex* pindexTip = chainActive[currentHeight];
+    CBlockIndex* pindexPoA = pindexTip->IsProofOfAudit() ? pindexTip : pindexTip->pprevPoA;
+    uint32_t nloopIdx = Params().START_POA_BLOCK() - 1;
+    if (pindexPoA && pindexPoA->nHeight >= Params().START_POA_BLOCK())
+        nloopIdx = pindexPoA->nHeight;
+    //The audits are verified together once the list is complete
+    const size_t nFirstAudit = audits.size();
+    std::vector<CBlockIndex*> vAuditedIndex;
     if (nloopIdx <= Params().START_POA_BLOCK()) {
         //this is the first PoA block ==> take all PoS blocks from LAST_POW_BLOCK up to currentHeight - 60 inclusive
         for (int i = Params().LAST_POW_BLOCK() + 1; i <= Params().LAST_POW_BLOCK() + (size_t)Params().MAX_NUM_POS_BLOCKS_AUDITED(); i++) {
             PoSBlockSummary pos;
             pos.hash = chainActive[i]->GetBlockHash();
-            CBlockIndex* pindex = mapBlockIndex[pos.hash];
-            pos.nTime = ReVerifyPoSBlock(pindex) ? chainActive[i]->GetBlockHeader().nTime : 0;
+            pos.nTime = chainActive[i]->GetBlockHeader().nTime;
             pos.height = i;
             audits.push_back(pos);
+            vAuditedIndex.push_back(mapBlockIndex[pos.hash]);
         }
     } else {
         //Find the previous PoA block
         uint32_t start = nloopIdx;
         if (start > Params().START_POA_BLOCK()) {
-            CBlockIndex* pblockindex = chainActive[start];
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pblockindex))
+            uint256 lastAuditedHash;
+            int lastAuditedHeight;
+            if (!GetLastAuditedPoSBlock(chainActive[start], lastAuditedHash, lastAuditedHeight))
                 throw std::runtime_error("Can't read block from disk");
-            PoSBlockSummary back = block.posBlocksAudited.back();
-            uint32_t lastAuditedHeight = back.height;
             uint32_t nextAuditHeight = lastAuditedHeight + 1;
 
             while (nextAuditHeight <= currentHeight) {
-                CBlockIndex* posIndex = chainActive[nextAuditHeight];
-                CBlock posBlock;
-                if (!ReadBlockFromDisk(posBlock, posIndex))
-                    throw std::runtime_error("Can't read block from disk");
-                if (posBlock.IsProofOfStake()) {
+                if (chainActive[nextAuditHeight]->IsProofOfStake()) {
                     PoSBlockSummary pos;
                     pos.hash = chainActive[nextAuditHeight]->GetBlockHash();
-                    CBlockIndex* pindex = mapBlockIndex[pos.hash];
-                    pos.nTime = ReVerifyPoSBlock(pindex) ? chainActive[nextAuditHeight]->GetBlockHeader().nTime : 0;
+                    pos.nTime = chainActive[nextAuditHeight]->GetBlockHeader().nTime;
                     pos.height = nextAuditHeight;
                     audits.push_back(pos);
+                    vAuditedIndex.push_back(mapBlockIndex[pos.hash]);
                 }
                 //The current number of PoS blocks audited in a PoA block is changed from 59 to MAX
                 if (audits.size() == (size_t)Params().MAX_NUM_POS_BLOCKS_AUDITED()) {
@@ -154,9 +128,236 @@ uint32_t GetListOfPoSInfo(uint32_t currentHeight, std::vector<PoSBlockSummary>&
             }
         }
     }
+    //Blocks that fail the audit are listed with a zero time
+    std::vector<bool> vAuditResults;
+    AuditPoSBlocks(vAuditedIndex, vAuditResults);
+    for (size_t i = 0; i < vAuditResults.size(); i++) {
+        if (!vAuditResults[i])
+            audits[nFirstAudit + i].nTime = 0;
+    }
     return nloopIdx;
 }
 
+/** Checks of a mempool transaction that only depend on the chain tip */
+struct CTxSelectionEntry {
+    //! Key images unspent and inputs available
+    bool fInputsAvailable;
+    //! Result of CheckInputs: -1 if not run yet
+    int nInputsValid;
+    double dPriority;
+    unsigned int nTxSize;
+};
+
+/**
+ * Mempool transactions selected for the next block. The selection is rebuilt only when the
+ * tip or the mempool changed, and the checks of transactions that stay in the mempool are
+ * kept until the tip changes, so a rebuild only checks new transactions. The stake minter
+ * refreshes it between kernel searches, leaving a kernel hit to add and sign the coinstake.
+ * Guarded by cs_main and mempool.cs.
+ */
+struct CBlockTxSelection {
+    uint256 hashPrevBlock;
+    unsigned int nTransactionsUpdated = 0;
+    int64_t nTime = 0;
+    std::map<uint256, CTxSelectionEntry> mapEntries;
+
+    std::vector<CTransaction> vtx;
+    std::vector<CAmount> vTxFees;
+    CAmount nFees = 0;
+    uint64_t nBlockSize = 0;
+};
+
+static CBlockTxSelection blockTxSelection;
+
+//! Seconds after which the selection is rebuilt even without changes, for time locked transactions
+static const int64_t BLOCK_TX_SELECTION_MAX_AGE = 60;
+
+static void UpdateBlockTxSelection(CBlockTxSelection& selection)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    const int nHeight = pindexPrev->nHeight + 1;
+    if (selection.hashPrevBlock != pindexPrev->GetBlockHash()) {
+        selection.hashPrevBlock = pindexPrev->GetBlockHash();
+        selection.mapEntries.clear();
+    } else if (selection.nTransactionsUpdated == mempool.GetTransactionsUpdated() &&
+               GetTime() - selection.nTime < BLOCK_TX_SELECTION_MAX_AGE) {
+        return;
+    }
+    selection.nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    selection.nTime = GetTime();
+    selection.vtx.clear();
+    selection.vTxFees.clear();
+    selection.nFees = 0;
+
+    // Largest block you're willing to create:
+    unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
+    // Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
+    unsigned int nBlockMaxSizeNetwork = MAX_BLOCK_SIZE_CURRENT;
+    nBlockMaxSize = std::max((unsigned int)1000, std::min((nBlockMaxSizeNetwork - 1000), nBlockMaxSize));
+
+    // How much of the block should be dedicated to high-priority transactions,
+    // included regardless of the fees they pay
+    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
+    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
+
+    // Minimum block size you want to create; block will be filled with free transactions
+    // until there are no more or the block reaches this size:
+    unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
+    nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
+
+    CCoinsViewCache view(pcoinsTip);
+
+    bool fPrintPriority = GetBoolArg("-printpriority", false);
+
+    // Forget transactions that left the mempool
+    for (std::map<uint256, CTxSelectionEntry>::iterator it = selection.mapEntries.begin(); it != selection.mapEntries.end();) {
+        if (!mempool.mapTx.count(it->first))
+            selection.mapEntries.erase(it++);
+        else
+            ++it;
+    }
+
+    // This vector will be sorted into a priority queue:
+    std::vector<TxPriority> vecPriority;
+    vecPriority.reserve(mempool.mapTx.size());
+    std::set<CKeyImage> keyImages;
+    for (std::map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
+         mi != mempool.mapTx.end(); ++mi) {
+        const CTransaction& tx = mi->second.GetTx();
+        if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)) {
+            continue;
+        }
+        uint256 hash = tx.GetHash();
+        std::map<uint256, CTxSelectionEntry>::iterator itEntry = selection.mapEntries.find(hash);
+        if (itEntry == selection.mapEntries.end()) {
+            CTxSelectionEntry entry;
+            entry.fInputsAvailable = true;
+            entry.nInputsValid = -1;
+            // Check key images not duplicated with what in db
+            for (const CTxIn& txin : tx.vin) {
+                const CKeyImage& keyImage = txin.keyImage;
+                if (IsSpentKeyImage(keyImage, UINT256_ZERO)) {
+                    entry.fInputsAvailable = false;
+                    break;
+                }
+                //Check for invalid/fraudulent inputs. They shouldn't make it through mempool, but check anyways.
+                if (invalid_out::ContainsOutPoint(txin.prevout)) {
+                    LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
+                    break;
+                }
+            }
+            if (entry.fInputsAvailable && !CheckHaveInputs(view, tx))
+                entry.fInputsAvailable = false;
+
+            // Priority is sum(valuein * age) / modified_txsize
+            entry.nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            entry.dPriority = GetPriority(tx, chainActive.Height());
+            itEntry = selection.mapEntries.insert(std::make_pair(hash, entry)).first;
+        }
+        const CTxSelectionEntry& entry = itEntry->second;
+        if (!entry.fInputsAvailable) {
+            continue;
+        }
+
+        double dPriority = entry.dPriority;
+        CAmount nTotalIn = 0;
+        mempool.ApplyDeltas(hash, dPriority, nTotalIn);
+
+        CFeeRate feeRate(tx.nTxFee, entry.nTxSize);
+
+        bool isDuplicate = false;
+        for (const CTxIn& txin : tx.vin) {
+            const CKeyImage& keyImage = txin.keyImage;
+            if (keyImages.count(keyImage)) {
+                isDuplicate = true;
+                break;
+            }
+            keyImages.insert(keyImage);
+        }
+        if (isDuplicate) continue;
+        vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
+    }
+
+    LogPrint(BCLog::STAKING, "Selecting %d transactions from mempool\n", vecPriority.size());
+    // Collect transactions into block
+    uint64_t nBlockSize = 1000;
+    bool fSortedByFee = (nBlockPrioritySize <= 0);
+
+    TxPriorityCompare comparer(fSortedByFee);
+    std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+
+    while (!vecPriority.empty()) {
+        // Take highest priority transaction off the priority queue:
+        double dPriority = vecPriority.front().get<0>();
+        CFeeRate feeRate = vecPriority.front().get<1>();
+        const CTransaction& tx = *(vecPriority.front().get<2>());
+
+        std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        vecPriority.pop_back();
+
+        // Size limits
+        const uint256& hash = tx.GetHash();
+        CTxSelectionEntry& entry = selection.mapEntries[hash];
+        unsigned int nTxSize = entry.nTxSize;
+        if (nBlockSize + nTxSize >= nBlockMaxSize)
+            continue;
+
+        // Skip free transactions if we're past the minimum block size:
+        CFeeRate customMinRelayTxFee = CFeeRate(5000);
+        if (fSortedByFee && (feeRate < customMinRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
+            continue;
+
+        // Prioritise by fee once past the priority size or we run out of high-priority
+        // transactions:
+        if (!fSortedByFee &&
+            ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
+            fSortedByFee = true;
+            comparer = TxPriorityCompare(fSortedByFee);
+            std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        }
+
+        CAmount nTxFees = tx.nTxFee;
+
+        // Note that flags: we don't want to set mempool/IsStandard()
+        // policy here, but we still have to ensure that the block we
+        // create only contains transactions that are valid in new blocks.
+
+        if (entry.nInputsValid < 0) {
+            CValidationState state;
+            entry.nInputsValid = CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true);
+        }
+        if (!entry.nInputsValid)
+            continue;
+
+        // Added
+        selection.vtx.push_back(tx);
+        selection.vTxFees.push_back(nTxFees);
+        nBlockSize += nTxSize;
+        selection.nFees += nTxFees;
+
+        if (fPrintPriority) {
+            LogPrintf("priority %.1f fee %s txid %s\n",
+                dPriority, feeRate.ToString(), tx.GetHash().ToString());
+        }
+    }
+    selection.nBlockSize = nBlockSize;
+}
+
+#ifdef ENABLE_WALLET
+/** Bring the transaction selection up to date between kernel searches, without waiting for cs_main */
+static void RefreshBlockTxSelection()
+{
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain)
+        return;
+    LOCK(mempool.cs);
+    UpdateBlockTxSelection(blockTxSelection);
+}
+#endif // ENABLE_WALLET
+
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, const CPubKey& txPub, const CKey& txPriv, CWallet* pwallet, bool fProofOfStake)
 {
     CReserveKey reservekey(pwallet);
@@ -232,22 +433,6 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, const CPubKey& txP
         }
     }
 
-    // Largest block you're willing to create:
-    unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
-    // Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
-    unsigned int nBlockMaxSizeNetwork = MAX_BLOCK_SIZE_CURRENT;
-    nBlockMaxSize = std::max((unsigned int)1000, std::min((nBlockMaxSizeNetwork - 1000), nBlockMaxSize));
-
-    // How much of the block should be dedicated to high-priority transactions,
-    // included regardless of the fees they pay
-    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
-    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
-
-    // Minimum block size you want to create; block will be filled with free transactions
-    // until there are no more or the block reaches this size:
-    unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
-    nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
-
     // Collect memory pool transactions into the block
     CAmount nFees = 0;
 
@@ -256,161 +441,14 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, const CPubKey& txP
 
         CBlockIndex* pindexPrev = chainActive.Tip();
         const int nHeight = pindexPrev->nHeight + 1;
-        CCoinsViewCache view(pcoinsTip);
-
-        // Priority order to process transactions
-        std::list<COrphan> vOrphan; // list memory doesn't move
-        std::map<uint256, std::vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", false);
-
-        // This vector will be sorted into a priority queue:
-        std::vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        std::set<CKeyImage> keyImages;
-        for (std::map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)) {
-                continue;
-            }
-            bool fKeyImageCheck = true;
-            // Check key images not duplicated with what in db
-            for (const CTxIn& txin : tx.vin) {
-                const CKeyImage& keyImage = txin.keyImage;
-                if (IsSpentKeyImage(keyImage.GetHex(), UINT256_ZERO)) {
-                    fKeyImageCheck = false;
-                    break;
-                }
-                //Check for invalid/fraudulent inputs. They shouldn't make it through mempool, but check anyways.
-                if (invalid_out::ContainsOutPoint(txin.prevout)) {
-                    LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
-                    break;
-                }
-            }
-
-            if (!fKeyImageCheck) {
-                continue;
-            }
-
-            if (!CheckHaveInputs(view, tx)) continue;
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = GetPriority(tx, chainActive.Height());
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(tx.nTxFee, nTxSize);
-
-            bool isDuplicate = false;
-            for (const CTxIn& txin : tx.vin) {
-                const CKeyImage& keyImage = txin.keyImage;
-                if (keyImages.count(keyImage)) {
-                    isDuplicate = true;
-                    break;
-                }
-                keyImages.insert(keyImage);
-            }
-            if (isDuplicate) continue;
-            vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
-        }
-
-        LogPrint(BCLog::STAKING, "Selecting %d transactions from mempool\n", vecPriority.size());
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        std::vector<CBigNum> vBlockSerials;
-        std::vector<CBigNum> vTxSerials;
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            CFeeRate customMinRelayTxFee = CFeeRate(5000);
-            if (fSortedByFee && (feeRate < customMinRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            if (!CheckHaveInputs(view, tx))
-                continue;
-
-            CAmount nTxFees = tx.nTxFee;
 
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-
-            CValidationState state;
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
-                continue;
-
-            CTxUndo txundo;
-            if (tx.IsCoinStake()) {
-                UpdateCoins(tx, view, txundo, nHeight);
-            }
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
+        UpdateBlockTxSelection(blockTxSelection);
+        for (size_t i = 0; i < blockTxSelection.vtx.size(); i++) {
+            pblock->vtx.push_back(blockTxSelection.vtx[i]);
+            pblocktemplate->vTxFees.push_back(blockTxSelection.vTxFees[i]);
             pblocktemplate->vTxSigOps.push_back(0);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nFees += nTxFees;
-
-            for (const CBigNum& bnSerial : vTxSerials)
-                vBlockSerials.emplace_back(bnSerial);
-
-            if (fPrintPriority) {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
-            }
-
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                for (COrphan* porphan : mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
-            }
         }
+        nFees = blockTxSelection.nFees;
 
         if (!fProofOfStake) {
             //Masternode and general budget payments
@@ -426,8 +464,8 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, const CPubKey& txP
             }
         }
 
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
+        nLastBlockTx = blockTxSelection.vtx.size();
+        nLastBlockSize = blockTxSelection.nBlockSize;
 
         // Compute final coinbase transaction.
         pblock->vtx[0].vin[0].scriptSig = CScript() << nHeight << OP_0;
@@ -779,6 +817,9 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
         if (!pindexPrev)
             continue;
 
+        if (fProofOfStake)
+            RefreshBlockTxSelection();
+
         std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlockWithKey(reservekey, pwallet, fProofOfStake));
         if (!pblocktemplate.get())
             continue;
@@ -38,8 +38,13 @@
 
 #include <boost/thread.hpp>
 
+#include <limits>
 #include <math.h>
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 // Dump addresses to peers.dat and banlist.dat every 15 minutes (900s)
 #define DUMP_ADDRESSES_INTERVAL 900
 
@@ -111,7 +116,28 @@ NodeId nLastNodeId = 0;
 RecursiveMutex cs_nLastNodeId;
 
 static CSemaphore *semOutbound = NULL;
+#ifdef USE_EPOLL
+// epoll instance of the socket handler. Node sockets are registered under the node id, listening
+// sockets under EPOLL_LISTEN_SOCKET_ID, and a node leaves it before its socket is closed. Only the
+// socket handler thread creates and closes it, under cs_hEpollSocketHandler, which other threads hold
+// while they use it.
+static Mutex cs_hEpollSocketHandler;
+static int hEpollSocketHandler = -1;
+static const uint64_t EPOLL_LISTEN_SOCKET_ID = std::numeric_limits<uint64_t>::max();
+#endif
 boost::condition_variable messageHandlerCondition;
+// set when a node has a complete message, so that the message handler does not sleep through it
+static boost::mutex mutexMsgProc;
+static bool fMsgProcWake = false;
+
+static void WakeMessageHandler()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(mutexMsgProc);
+        fMsgProcWake = true;
+    }
+    messageHandlerCondition.notify_one();
+}
 
 // Signals for message handling
 static CNodeSignals g_signals;
@@ -428,9 +454,21 @@ static void DumpBanlist()
 
 void CNode::CloseSocketDisconnect() {
     fDisconnect = true;
-    if (hSocket != INVALID_SOCKET) {
-        LogPrint(BCLog::NET, "disconnecting peer=%d\n", id);
-        CloseSocket(hSocket);
+    {
+        LOCK(cs_hSocket);
+        if (hSocket != INVALID_SOCKET) {
+            LogPrint(BCLog::NET, "disconnecting peer=%d\n", id);
+#ifdef USE_EPOLL
+            // a forked child may still hold the descriptor, so closing it does not unregister it
+            if (nSocketEvents != -1) {
+                LOCK(cs_hEpollSocketHandler);
+                if (hEpollSocketHandler != -1)
+                    epoll_ctl(hEpollSocketHandler, EPOLL_CTL_DEL, hSocket, NULL);
+            }
+            nSocketEvents = -1;
+#endif
+            CloseSocket(hSocket);
+        }
     }
 
     // in case this fails, we'll empty the recv buffer when the CNode is deleted
@@ -718,7 +756,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes) {
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            WakeMessageHandler();
         }
     }
 
@@ -1015,8 +1053,189 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+static const int SOCKET_EVENT_RECV = 1;
+static const int SOCKET_EVENT_SEND = 2;
+static const int SOCKET_EVENT_ERROR = 4;
+
+#ifdef USE_EPOLL
+/**
+ * Wait up to nTimeoutMillis for the sockets of the nodes in vWanted to become ready for the
+ * SOCKET_EVENT_* they want, and append the nodes that are ready to vReady. A socket that hung up
+ * or failed without data left to read is reported as SOCKET_EVENT_ERROR. Returns whether a
+ * listening socket has a connection to accept.
+ */
+static bool WaitForSocketEvents(const std::vector<std::pair<CNode*, int> >& vWanted, std::vector<std::pair<CNode*, int> >& vReady, int64_t nTimeoutMillis)
+{
+    if (hEpollSocketHandler == -1) {
+        int hEpoll = epoll_create1(EPOLL_CLOEXEC);
+        if (hEpoll == -1) {
+            LogPrintf("socket epoll_create1 error %s\n", NetworkErrorString(WSAGetLastError()));
+            MilliSleep(nTimeoutMillis);
+            return false;
+        }
+        {
+            LOCK(cs_hEpollSocketHandler);
+            hEpollSocketHandler = hEpoll;
+        }
+        for (const ListenSocket &hListenSocket : vhListenSocket) {
+            if (hListenSocket.socket == INVALID_SOCKET)
+                continue;
+            struct epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.u64 = EPOLL_LISTEN_SOCKET_ID;
+            if (epoll_ctl(hEpollSocketHandler, EPOLL_CTL_ADD, hListenSocket.socket, &event) == SOCKET_ERROR)
+                LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(WSAGetLastError()));
+        }
+    }
+
+    // Only touch the kernel for nodes whose wanted events changed since the last wait. Nodes that
+    // want nothing leave the epoll set, as hangups and errors would be reported regardless.
+    std::map<NodeId, CNode*> mapWanted;
+    for (const std::pair<CNode*, int>& wanted : vWanted) {
+        CNode* pnode = wanted.first;
+        mapWanted[pnode->id] = pnode;
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET || pnode->nSocketEvents == (wanted.second ? wanted.second : -1))
+            continue;
+        int nOp = EPOLL_CTL_DEL;
+        if (wanted.second)
+            nOp = pnode->nSocketEvents == -1 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+        struct epoll_event event = {};
+        event.events = (wanted.second & SOCKET_EVENT_RECV ? (uint32_t)EPOLLIN : 0) | (wanted.second & SOCKET_EVENT_SEND ? (uint32_t)EPOLLOUT : 0);
+        event.data.u64 = pnode->id;
+        if (epoll_ctl(hEpollSocketHandler, nOp, pnode->hSocket, &event) == SOCKET_ERROR) {
+            LogPrint(BCLog::NET, "socket epoll_ctl error %s for peer=%d\n", NetworkErrorString(WSAGetLastError()), pnode->id);
+            pnode->fDisconnect = true;
+            continue;
+        }
+        pnode->nSocketEvents = wanted.second ? wanted.second : -1;
+    }
+
+    struct epoll_event events[256];
+    int nEvents = epoll_wait(hEpollSocketHandler, events, ARRAYLEN(events), nTimeoutMillis);
+    if (nEvents == SOCKET_ERROR) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR)
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+        MilliSleep(nTimeoutMillis);
+        return false;
+    }
+
+    bool fListenReady = false;
+    for (int i = 0; i < nEvents; i++) {
+        if (events[i].data.u64 == EPOLL_LISTEN_SOCKET_ID) {
+            fListenReady = true;
+            continue;
+        }
+        // only hand out nodes the caller holds a reference to
+        std::map<NodeId, CNode*>::const_iterator it = mapWanted.find((NodeId)events[i].data.u64);
+        if (it == mapWanted.end())
+            continue;
+        int nReady = 0;
+        // a hangup with data still queued is seen by recv() once the data has been read
+        if (events[i].events & EPOLLIN)
+            nReady |= SOCKET_EVENT_RECV;
+        else if (events[i].events & (EPOLLERR | EPOLLHUP))
+            nReady |= SOCKET_EVENT_ERROR;
+        if (events[i].events & EPOLLOUT)
+            nReady |= SOCKET_EVENT_SEND;
+        vReady.push_back(std::make_pair(it->second, nReady));
+    }
+    return fListenReady;
+}
+
+static void CloseEpollSocketHandler()
+{
+    LOCK(cs_hEpollSocketHandler);
+    if (hEpollSocketHandler != -1) {
+        close(hEpollSocketHandler);
+        hEpollSocketHandler = -1;
+    }
+}
+#else
+/**
+ * Wait up to nTimeoutMillis for the sockets of the nodes in vWanted to become ready for the
+ * SOCKET_EVENT_* they want, and append the nodes that are ready to vReady. Socket errors are
+ * reported as ready to receive. Returns whether a listening socket has a connection to accept.
+ */
+static bool WaitForSocketEvents(const std::vector<std::pair<CNode*, int> >& vWanted, std::vector<std::pair<CNode*, int> >& vReady, int64_t nTimeoutMillis)
+{
+    struct timeval timeout = MillisToTimeval(nTimeoutMillis);
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    for (const ListenSocket &hListenSocket : vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    for (const std::pair<CNode*, int>& wanted : vWanted) {
+        SOCKET hSocket = wanted.first->hSocket;
+        if (hSocket == INVALID_SOCKET)
+            continue;
+        FD_SET(hSocket, &fdsetError);
+        hSocketMax = std::max(hSocketMax, hSocket);
+        have_fds = true;
+        if (wanted.second & SOCKET_EVENT_SEND)
+            FD_SET(hSocket, &fdsetSend);
+        if (wanted.second & SOCKET_EVENT_RECV)
+            FD_SET(hSocket, &fdsetRecv);
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+
+    if (nSelect == SOCKET_ERROR) {
+        if (have_fds) {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        MilliSleep(nTimeoutMillis);
+    }
+
+    bool fListenReady = false;
+    for (const ListenSocket &hListenSocket : vhListenSocket) {
+        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            fListenReady = true;
+    }
+
+    for (const std::pair<CNode*, int>& wanted : vWanted) {
+        SOCKET hSocket = wanted.first->hSocket;
+        if (hSocket == INVALID_SOCKET)
+            continue;
+        int nReady = 0;
+        if (FD_ISSET(hSocket, &fdsetRecv) || FD_ISSET(hSocket, &fdsetError))
+            nReady |= SOCKET_EVENT_RECV;
+        if (FD_ISSET(hSocket, &fdsetSend))
+            nReady |= SOCKET_EVENT_SEND;
+        if (nReady)
+            vReady.push_back(std::make_pair(wanted.first, nReady));
+    }
+    return fListenReady;
+}
+#endif
+
 void ThreadSocketHandler() {
+#ifdef USE_EPOLL
+    // the epoll instance lives as long as the socket handler
+    struct CEpollCloser {
+        ~CEpollCloser() { CloseEpollSocketHandler(); }
+    } epollCloser;
+#endif
     unsigned int nPrevNodeCount = 0;
+    int64_t nLastInactivityCheck = 0;
     while (true) {
         //
         // Disconnect nodes
@@ -1085,111 +1304,88 @@ void ThreadSocketHandler() {
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
+        int64_t nTimeoutMillis = 50; // frequency to poll pnode->vSend
 
-        for (const ListenSocket &hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
+        std::vector<CNode*> vNodesCopy;
+        {
+            LOCK(cs_vNodes);
+            vNodesCopy = vNodes;
+            for (CNode * pnode : vNodesCopy)
+            pnode->AddRef();
         }
 
+        // Implement the following logic:
+        // * If there is data to send, wait for sending data. As this only
+        //   happens when optimistic write failed, we choose to first drain the
+        //   write buffer in this case before receiving more. This avoids
+        //   needlessly queueing received data, if the remote peer is not themselves
+        //   receiving data. This means properly utilizing TCP flow control signalling.
+        // * Otherwise, if there is no (complete) message in the receive buffer,
+        //   or there is space left in the buffer, wait for receiving data.
+        // * (if neither of the above applies, there is certainly one message
+        //   in the receiver buffer ready to be processed).
+        // Together, that means that at least one of the following is always possible,
+        // so we don't deadlock:
+        // * We send some data.
+        // * We wait for data to be received (and disconnect after timeout).
+        // * We process a message in the buffer (message handler thread).
+        std::vector<std::pair<CNode*, int> > vWanted;
+        for (CNode * pnode : vNodesCopy)
         {
-            LOCK(cs_vNodes);
-            for (CNode * pnode : vNodes)
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            int nEvents = 0;
             {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    LOCK(pnode->cs_vSend);
-                    if (!pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                                     pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
+                LOCK(pnode->cs_vSend);
+                if (!pnode->vSendMsg.empty())
+                    nEvents = SOCKET_EVENT_SEND;
             }
+            if (!nEvents) {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                                 pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+                    nEvents = SOCKET_EVENT_RECV;
+            }
+            vWanted.push_back(std::make_pair(pnode, nEvents));
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        // Nodes whose sockets are ready, and whether to receive or send
+        std::vector<std::pair<CNode*, int> > vReady;
+        bool fListenReady = WaitForSocketEvents(vWanted, vReady, nTimeoutMillis);
         boost::this_thread::interruption_point();
 
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
-        }
-
         //
         // Accept new connections
         //
-        for (const ListenSocket &hListenSocket : vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
-                AcceptConnection(hListenSocket);
+        if (fListenReady) {
+            // listening sockets are non-blocking, so the ones without a connection return straight away
+            for (const ListenSocket &hListenSocket : vhListenSocket) {
+                if (hListenSocket.socket != INVALID_SOCKET) {
+                    AcceptConnection(hListenSocket);
+                }
             }
         }
 
         //
-        // Service each socket
+        // Service each socket that is ready
         //
-        std::vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode * pnode : vNodesCopy)
-            pnode->AddRef();
-        }
-        for (CNode * pnode : vNodesCopy)
+        for (const std::pair<CNode*, int>& ready : vReady)
         {
             boost::this_thread::interruption_point();
+            CNode* pnode = ready.first;
 
             //
             // Receive
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
+            if (ready.second & SOCKET_EVENT_ERROR) {
+                if (!pnode->fDisconnect)
+                    LogPrint(BCLog::NET, "socket hung up or failed, peer=%d\n", pnode->id);
+                pnode->CloseSocketDisconnect();
+                continue;
+            }
+            if (ready.second & SOCKET_EVENT_RECV) {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv) {
                     {
@@ -1226,31 +1422,39 @@ void ThreadSocketHandler() {
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+            if (ready.second & SOCKET_EVENT_SEND) {
                 LOCK(pnode->cs_vSend);
                 SocketSendData(pnode);
             }
+        }
 
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60) {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
-                    LogPrint(BCLog::NET, "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0,
-                             pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastRecv >
-                           (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                } else if (pnode->nPingNonceSent &&
-                           pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
+        //
+        // Inactivity checking
+        //
+        int64_t nTime = GetTime();
+        if (nTime != nLastInactivityCheck) {
+            nLastInactivityCheck = nTime;
+            for (CNode * pnode : vNodesCopy)
+            {
+                if (pnode->hSocket == INVALID_SOCKET)
+                    continue;
+                if (nTime - pnode->nTimeConnected > 60) {
+                    if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
+                        LogPrint(BCLog::NET, "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0,
+                                 pnode->nLastSend != 0, pnode->id);
+                        pnode->fDisconnect = true;
+                    } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
+                        LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+                        pnode->fDisconnect = true;
+                    } else if (nTime - pnode->nLastRecv >
+                               (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
+                        LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+                        pnode->fDisconnect = true;
+                    } else if (pnode->nPingNonceSent &&
+                               pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
+                        LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+                        pnode->fDisconnect = true;
+                    }
                 }
             }
         }
@@ -1710,9 +1914,6 @@ bool OpenNetworkConnection(const CAddress& addrConnect, bool fCountFailure, CSem
 }
 
 void ThreadMessageHandler() {
-    boost::mutex condition_mutex;
-    boost::unique_lock<boost::mutex> lock(condition_mutex);
-
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (true) {
         std::vector<CNode*> vNodesCopy;
@@ -1730,6 +1931,10 @@ void ThreadMessageHandler() {
         {
             if (pnode->fDisconnect)
                 continue;
+            // Another handler thread is working on this node
+            TRY_LOCK(pnode->cs_msgProcessing, lockProcessing);
+            if (!lockProcessing)
+                continue;
             // Receive messages
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
@@ -1760,9 +1965,12 @@ void ThreadMessageHandler() {
             pnode->Release();
         }
 
+        boost::unique_lock<boost::mutex> lock(mutexMsgProc);
         if (fSleep)
             messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() +
-                                                     boost::posix_time::milliseconds(100));
+                                                     boost::posix_time::milliseconds(100),
+                                               [] { return fMsgProcWake; });
+        fMsgProcWake = false;
     }
 }
 
@@ -1974,8 +2182,11 @@ void StartNode(boost::thread_group &threadGroup, CScheduler &scheduler) {
     if (!mapArgs.count("-connect") || mapMultiArgs["-connect"].size() != 1 || mapMultiArgs["-connect"][0] != "0")
         threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
-    // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    // Process messages, each peer is handled by one thread at a time
+    int nMsgHandlerThreads = std::max(1, std::min((int)GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS), MAX_MSGHANDLER_THREADS));
+    LogPrintf("Using %d threads for message handling\n", nMsgHandlerThreads);
+    for (int i = 0; i < nMsgHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
 
     // Dump network addresses
     scheduler.scheduleEvery(&DumpData, DUMP_ADDRESSES_INTERVAL);
@@ -2009,6 +2220,9 @@ public:
         if (hListenSocket.socket != INVALID_SOCKET)
             if (!CloseSocket(hListenSocket.socket))
                 LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
+#ifdef USE_EPOLL
+        CloseEpollSocketHandler();
+#endif
 
         // clean up some globals (to help leak detection)
         for (CNode * pnode : vNodes)
@@ -2262,6 +2476,7 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nServices = NODE_NONE;
     nServicesExpected = NODE_NONE;
     hSocket = hSocketIn;
+    nSocketEvents = -1;
     nRecvVersion = INIT_PROTO_VERSION;
     nLastSend = 0;
     nLastRecv = 0;
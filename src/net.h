@@ -69,6 +69,10 @@ static const bool DEFAULT_UPNP = false;
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
+/** -msghandlerthreads default (number of threads processing peer messages) */
+static const int DEFAULT_MSGHANDLER_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHANDLER_THREADS = 16;
 
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
@@ -118,6 +122,8 @@ struct CNodeSignals
 
 CNodeSignals& GetNodeSignals();
 
+void ThreadMessageHandler();
+
 
 enum {
     LOCAL_NONE,   // unknown
@@ -310,6 +316,10 @@ public:
     ServiceFlags nServices;
     ServiceFlags nServicesExpected;
     SOCKET hSocket;
+    // held while hSocket is closed, so that the socket handler never registers a closed (or reused) descriptor
+    RecursiveMutex cs_hSocket;
+    // events the socket handler has registered for hSocket with epoll, -1 before registration
+    int nSocketEvents;
     CDataStream ssSend;
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
@@ -318,6 +328,9 @@ public:
     RecursiveMutex cs_vSend;
 
     RecursiveMutex cs_sendProcessing;
+    // held by the message handler thread working on this node, so that its messages are processed in order.
+    // Taken before any other lock of the node, see cs_processGossip in main.cpp for the full order.
+    RecursiveMutex cs_msgProcessing;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
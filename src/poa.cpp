@@ -184,8 +184,27 @@ uint256 GetBlockProof(const CBlockIndex& block)
 }
 
 CBlockIndex* FindPrevPoSBlock(CBlockIndex* p) {
-    if (!p || !p->pprev) return NULL;
-    return p->pprev->IsProofOfStake()?p->pprev:FindPrevPoSBlock(p->pprev);
+    return p ? p->pprevPoS : NULL;
+}
+
+//Find the closest PoA block at or before pindex
+static CBlockIndex* FindLastPoABlock(CBlockIndex* pindex) {
+    return pindex->IsProofOfAudit() ? pindex : pindex->pprevPoA;
+}
+
+bool GetLastAuditedPoSBlock(CBlockIndex* pindexPoA, uint256& hash, int& nHeight)
+{
+    LOCK(cs_main);
+    if (pindexPoA->nLastAuditedPoSHeight < 0) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindexPoA) || block.posBlocksAudited.empty())
+            return false;
+        pindexPoA->hashLastAuditedPoS = block.posBlocksAudited.back().hash;
+        pindexPoA->nLastAuditedPoSHeight = block.posBlocksAudited.back().height;
+    }
+    hash = pindexPoA->hashLastAuditedPoS;
+    nHeight = pindexPoA->nLastAuditedPoSHeight;
+    return true;
 }
 
 //If blockheight = -1, the to-be-checked block is not included yet in the chain, otherwise, that is the height of the poa block
@@ -198,37 +217,29 @@ bool CheckPoAContainRecentHash(const CBlock& block)
         return error("CheckPoAContainRecentHash(): Previous block not found");
     }
     //Find the previous PoA block
-    CBlockIndex* pindex = currentTip;
-    nHeight = pindex->nHeight;
-    while (pindex->nHeight >= Params().START_POA_BLOCK()) {
-        if (pindex->GetBlockHeader().IsPoABlockByVersion()) {
-            break;
-        }
-        pindex = pindex->pprev;
-    }
+    CBlockIndex* pindex = FindLastPoABlock(currentTip);
+    nHeight = currentTip->nHeight;
     bool ret = true;
-    if (pindex->nHeight <= Params().START_POA_BLOCK()) {
+    if (!pindex || pindex->nHeight <= Params().START_POA_BLOCK()) {
         //this is the first PoA block ==> check all PoS blocks from LAST_POW_BLOCK up to currentHeight - POA_BLOCK_PERIOD - 1 inclusive
-        int index = 0;
-        for (size_t i = Params().LAST_POW_BLOCK() + 1; i <= Params().LAST_POW_BLOCK() + block.posBlocksAudited.size(); i++) {
-            PoSBlockSummary pos = block.posBlocksAudited.at(index);
+        std::vector<CBlockIndex*> vAuditedIndex;
+        for (const PoSBlockSummary& pos : block.posBlocksAudited) {
             CBlockIndex* pidxInChain = mapBlockIndex[pos.hash];
             if (!pidxInChain) {
                 return error("CheckPoAContainRecentHash(): Audited blocks not found");
             }
             if (pos.hash != pidxInChain->GetBlockHash() || pos.nTime != pidxInChain->nTime || pos.height != (uint32_t)pidxInChain->nHeight) {
+                return false;
+            }
+            vAuditedIndex.push_back(pidxInChain);
+        }
+        std::vector<bool> vAuditResults;
+        AuditPoSBlocks(vAuditedIndex, vAuditResults);
+        for (size_t i = 0; i < vAuditResults.size(); i++) {
+            if (!vAuditResults[i] && block.posBlocksAudited[i].nTime) {
                 ret = false;
                 break;
             }
-            CBlockIndex* p = mapBlockIndex[pos.hash];
-            bool auditResult = ReVerifyPoSBlock(p);
-            if (!auditResult) {
-                if (pos.nTime) {
-                    ret = false;
-                    break;
-                }
-            }
-            index++;
         }
     } else {
         if (pindex->nHeight >= Params().START_POA_BLOCK()) {
@@ -236,12 +247,10 @@ bool CheckPoAContainRecentHash(const CBlock& block)
             if (pindex->nHeight == 17077 || pindex->nHeight == 17154 || pindex->nHeight == 135887 || pindex->nHeight == 311272) {
                 return true;
             }
-            CBlock prevPoablock;
-            CBlockIndex* pblockindex = pindex;
-            if (!ReadBlockFromDisk(prevPoablock, pblockindex))
+            uint256 lastAuditedPoSHash;
+            int lastAuditedPoSHeight;
+            if (!GetLastAuditedPoSBlock(pindex, lastAuditedPoSHash, lastAuditedPoSHeight))
                 throw std::runtime_error("Can't read block from disk");
-            PoSBlockSummary lastAuditedPoSBlockInfo = prevPoablock.posBlocksAudited.back();
-            uint256 lastAuditedPoSHash = lastAuditedPoSBlockInfo.hash;
             if (mapBlockIndex.count(lastAuditedPoSHash) < 1 && !IsWrongAudit(lastAuditedPoSHash.GetHex(), nHeight)) {
                 return error("CheckPoAContainRecentHash(): Audited blocks not found");
             }
@@ -253,23 +262,22 @@ bool CheckPoAContainRecentHash(const CBlock& block)
             }
             CBlockIndex* pCurrentFirstPoSAuditedIndex = mapBlockIndex[currentFirstPoSAuditedHash];
             CBlockIndex* pCurrentLastPoSAuditedIndex = mapBlockIndex[currentLastPoSAuditedHash];
-            uint256 fixedPoSAuditedHash = pCurrentFirstPoSAuditedIndex->GetAncestor(lastAuditedPoSBlockInfo.height)->GetBlockHash();
+            uint256 fixedPoSAuditedHash = pCurrentFirstPoSAuditedIndex->GetAncestor(lastAuditedPoSHeight)->GetBlockHash();
             //check lastAuditedPoSHash and currentFirstPoSAuditedHash must be on the same fork
             //that lastAuditedPoSHash must be parent block of currentFirstPoSAuditedHash
-            if (pCurrentFirstPoSAuditedIndex->GetAncestor(lastAuditedPoSBlockInfo.height)->GetBlockHash() != lastAuditedPoSHash && !IsFixedAudit(fixedPoSAuditedHash.GetHex(), nHeight)) {
+            if (pCurrentFirstPoSAuditedIndex->GetAncestor(lastAuditedPoSHeight)->GetBlockHash() != lastAuditedPoSHash && !IsFixedAudit(fixedPoSAuditedHash.GetHex(), nHeight)) {
                 return error("CheckPoAContainRecentHash(): PoA block is not on the same fork with the previous poa block");
             }
 
             //check there is no pos block between lastAuditedPoSHash and currentFirstPoSAuditedHash
-            CBlockIndex* pIndexLoop = pCurrentFirstPoSAuditedIndex->pprev;
-            while(pIndexLoop && !pIndexLoop->IsProofOfStake()) {
-                pIndexLoop = pIndexLoop->pprev;
-            }
+            CBlockIndex* pIndexLoop = pCurrentFirstPoSAuditedIndex->pprevPoS;
             if (!pIndexLoop || (pIndexLoop->GetBlockHash() != lastAuditedPoSHash && !IsFixedAudit(fixedPoSAuditedHash.GetHex(), nHeight))) {
                 return error("CheckPoAContainRecentHash(): Some PoS block between %s and %s is not audited\n", lastAuditedPoSHash.GetHex(), currentFirstPoSAuditedHash.GetHex());
             }
 
             //alright, check all pos blocks audited in the block is conseutive in the chain
+            std::vector<CBlockIndex*> vAuditedIndex(block.posBlocksAudited.size());
+            vAuditedIndex[0] = pCurrentFirstPoSAuditedIndex;
             for(size_t i = block.posBlocksAudited.size() - 1; i > 0; i--) {
                 uint256 thisPoSAduditedHash = block.posBlocksAudited[i].hash;
                 if (mapBlockIndex.count(thisPoSAduditedHash) < 1) {
@@ -286,8 +294,15 @@ bool CheckPoAContainRecentHash(const CBlock& block)
                     previousPoSIndex->GetBlockTime() != previousSummary.nTime) {
                     return error("CheckPoAContainRecentHash(): PoS block info not matched for %s\n", thisPoSAduditedHash.GetHex());
                 }
-                bool auditResult = ReVerifyPoSBlock(thisPoSAuditedIndex);
-                if (!auditResult) {
+                vAuditedIndex[i] = thisPoSAuditedIndex;
+            }
+
+            //audit the blocks in parallel, then judge them in the order above
+            std::vector<bool> vAuditResults;
+            AuditPoSBlocks(vAuditedIndex, vAuditResults);
+            for(size_t i = block.posBlocksAudited.size() - 1; i > 0; i--) {
+                PoSBlockSummary previousSummary = block.posBlocksAudited[i - 1];
+                if (!vAuditResults[i]) {
                     if (previousSummary.nTime) {
                         ret = false;
                         LogPrintf("%s: Failed to reverify block %s\n", __func__, previousSummary.hash.GetHex());
@@ -296,7 +311,7 @@ bool CheckPoAContainRecentHash(const CBlock& block)
                 }
             }
             if (ret) {
-                bool auditResult = ReVerifyPoSBlock(pCurrentFirstPoSAuditedIndex);
+                bool auditResult = vAuditResults[0];
                 if (!auditResult) {
                     if (block.posBlocksAudited[0].nTime) {
                         ret = false;
@@ -363,19 +378,11 @@ bool CheckPrevPoABlockHash(const CBlockHeader& block)
         return error("CheckPrevPoABlockHash(): Previous block not found");
     }
     //Find the previous PoA block
-    CBlockIndex* pindex = currentTip;
-    while (pindex->nHeight > Params().START_POA_BLOCK()) {
-        if (pindex->GetBlockHeader().IsPoABlockByVersion()) {
-            break;
-        }
-        pindex = pindex->pprev;
-    }
+    CBlockIndex* pindex = FindLastPoABlock(currentTip);
     bool ret = false;
 
-    if (pindex->nHeight > Params().START_POA_BLOCK()) {
-        CBlockHeader header = pindex->GetBlockHeader();
-        uint256 poaBlockHash = header.GetHash();
-        if (poaBlockHash == block.hashPrevPoABlock) {
+    if (pindex && pindex->nHeight > Params().START_POA_BLOCK()) {
+        if (pindex->GetBlockHash() == block.hashPrevPoABlock) {
             ret = true;
         }
     } else {
@@ -510,9 +517,6 @@ bool CheckPoABlockPaddingAmount(const CBlock& block, const CBlockIndex* pindex)
         ret = false;
         if (mapBlockIndex.count(block.hashPrevPoABlock) != 0) {
             CBlockIndex* pPrevPoAIndex = mapBlockIndex[block.hashPrevPoABlock];
-            CBlock prevPoablock;
-            if (!ReadBlockFromDisk(prevPoablock, pPrevPoAIndex))
-                throw std::runtime_error("Can't read block from disk");
             prevPoAHeight = pPrevPoAIndex->nHeight;
             for (size_t i = 0; i < block.posBlocksAudited.size(); i++) {
                 lastPoSHeight = block.posBlocksAudited[i].height;
@@ -41,6 +41,8 @@ bool CheckPoAMerkleRoot(const CBlock& block, bool* fMutate = NULL);
 bool CheckPoABlockMinedHash(const CBlockHeader& block);
 
 bool CheckPoAContainRecentHash(const CBlock& block);
+/** Last PoS block audited by a PoA block, read from disk only if its index does not know it yet */
+bool GetLastAuditedPoSBlock(CBlockIndex* pindexPoA, uint256& hash, int& nHeight);
 bool CheckNumberOfAuditedPoSBlocks(const CBlock& block, const CBlockIndex* pindex);
 bool CheckPoABlockNotContainingPoABlockInfo(const CBlock& block, const CBlockIndex* pindex);
 
@@ -41,6 +41,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"rescanwallettransactions", 0},
         {"sendtostealthaddress", 1},
         {"sendtostealthaddress", 2},
+        {"sendtostealthaddress", 3},
+        {"getsendjob", 0},
         {"sendalltostealthaddress", 1},
         {"settxfee", 0},
         {"getreceivedbyaddress", 1},
@@ -0,0 +1,66 @@
+#ifndef SECP256K1_MLSAG_H
+#define SECP256K1_MLSAG_H
+
+#include "secp256k1_2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Hash a compressed public key to a curve point, Hp(P) as used by secp256k1_mlsag_verify.
+ *
+ *  Hp(P) depends only on P, so callers that see the same public keys in many
+ *  rings can compute it once and pass it to secp256k1_mlsag_verify.
+ *
+ *  Returns: 1 always.
+ *  Args:    ctx:   pointer to a context object (cannot be NULL)
+ *  Out:     hp:    pointer to a public key object receiving Hp(P) (cannot be NULL)
+ *  In:      pub33: 33-byte compressed public key P (cannot be NULL)
+ */
+SECP256K1_API int secp256k1_mlsag_hash_to_point(
+  const secp256k1_context2* ctx,
+  secp256k1_pubkey2 *hp,
+  const unsigned char *pub33
+) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3);
+
+/** Verify an MLSAG ring signature over a matrix of n_rows x n_cols public keys.
+ *
+ *  Starting from c_0 = c, every column j computes, for each row i,
+ *      L_ij = c_j * P_ij + s_ij * G
+ *      R_ij = s_ij * Hp(P_ij) + c_j * I_i
+ *  and c_{j+1} = SHA256d(L_0j || R_0j || ... || L_(n_rows-1)j || R_(n_rows-1)j || msg32),
+ *  with points serialized compressed. The signature is valid if c_{n_cols} == c.
+ *  Hp(P) is the first valid x coordinate, taken with the parity of P, in the
+ *  sequence x_0 = SHA256d(P), x_k+1 = SHA256d(P[0] || x_k).
+ *
+ *  Returns: 1: the signature is valid
+ *           0: the signature is invalid, or a point or scalar could not be parsed
+ *  Args:    ctx:       pointer to a context object initialized for verification (cannot be NULL)
+ *  In:      c:         32-byte initial challenge of the signature
+ *           msg32:     32-byte message hash the signature commits to
+ *           pubkeys:   n_rows * n_cols 33-byte compressed public keys, row-major:
+ *                      P_ij starts at pubkeys + 33 * (i * n_cols + j)
+ *           hashed_pubkeys: n_rows * n_cols precomputed Hp(P_ij) in the same layout as pubkeys,
+ *                      or NULL to compute them from pubkeys
+ *           keyimages: n_rows 33-byte compressed key images
+ *           s:         n_rows * n_cols 32-byte responses, in the same layout as pubkeys
+ *           n_rows:    number of rows (keys signed for per ring member)
+ *           n_cols:    number of columns (ring size)
+ */
+SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_mlsag_verify(
+  const secp256k1_context2* ctx,
+  const unsigned char *c,
+  const unsigned char *msg32,
+  const unsigned char *pubkeys,
+  const secp256k1_pubkey2 *hashed_pubkeys,
+  const unsigned char *keyimages,
+  const unsigned char *s,
+  size_t n_rows,
+  size_t n_cols
+) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(4) SECP256K1_ARG_NONNULL(6) SECP256K1_ARG_NONNULL(7);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SECP256K1_MLSAG_H */
@@ -0,0 +1,41 @@
+#ifndef SECP256K1_STEALTH_H
+#define SECP256K1_STEALTH_H
+
+#include "secp256k1_2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Compute the stealth destinations of a batch of transaction public keys for one account.
+ *
+ *  For every transaction public key R_k the destination is
+ *      P_k = SHA256d(a * R_k) * G + B
+ *  where a is the private view key, B the public spend key and a * R_k is hashed
+ *  in its 33-byte compressed serialization. An output paid to the account has
+ *  P_k as its public key.
+ *
+ *  Returns: 1: view and spend_pubkey33 are valid and the destinations were computed
+ *           0: view is out of range or zero, or spend_pubkey33 could not be parsed
+ *  Args:    ctx:            pointer to a context object initialized for signing and verification (cannot be NULL)
+ *  Out:     destinations:   n 33-byte compressed destinations (cannot be NULL); the entry of an
+ *                           R_k that could not be parsed, or whose destination is undefined, is all zeroes
+ *  In:      view:           32-byte private view key a (cannot be NULL)
+ *           spend_pubkey33: 33-byte compressed public spend key B (cannot be NULL)
+ *           tx_pubkeys:     n 33-byte compressed transaction public keys (cannot be NULL)
+ *           n:              number of transaction public keys
+ */
+SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_stealth_destinations(
+  const secp256k1_context2* ctx,
+  unsigned char *destinations,
+  const unsigned char *view,
+  const unsigned char *spend_pubkey33,
+  const unsigned char *tx_pubkeys,
+  size_t n
+) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(4) SECP256K1_ARG_NONNULL(5);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SECP256K1_STEALTH_H */
@@ -0,0 +1,172 @@
+/**********************************************************************
+ * Copyright (c) 2020-2022 The PRivaCY Coin Developers                *
+ * Distributed under the MIT software license, see the accompanying   *
+ * file COPYING or http://www.opensource.org/licenses/mit-license.php.*
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/secp256k1_2.h"
+#include "include/secp256k1_mlsag.h"
+#include "util.h"
+#include "hash_impl.h"
+#include "bench.h"
+
+#define BENCH_MLSAG_ROWS 2
+#define BENCH_MLSAG_MAX_COLS 33
+
+typedef struct {
+    secp256k1_context2 *ctx;
+    unsigned char c[32];
+    unsigned char msg32[32];
+    unsigned char pubkeys[BENCH_MLSAG_ROWS * BENCH_MLSAG_MAX_COLS * 33];
+    unsigned char keyimages[BENCH_MLSAG_ROWS * 33];
+    unsigned char s[BENCH_MLSAG_ROWS * BENCH_MLSAG_MAX_COLS * 32];
+    secp256k1_pubkey2 hps[BENCH_MLSAG_ROWS * BENCH_MLSAG_MAX_COLS];
+    size_t n_cols;
+    int iters;
+} bench_mlsag_data;
+
+static void bench_sha256d(unsigned char *out32, const unsigned char *data, size_t len) {
+    secp256k1_sha256 sha;
+    unsigned char tmp[32];
+    secp256k1_sha256_initialize(&sha);
+    secp256k1_sha256_write(&sha, data, len);
+    secp256k1_sha256_finalize(&sha, tmp);
+    secp256k1_sha256_initialize(&sha);
+    secp256k1_sha256_write(&sha, tmp, 32);
+    secp256k1_sha256_finalize(&sha, out32);
+}
+
+static void bench_mlsag_random_point(const secp256k1_context2 *ctx, unsigned char *out33, unsigned int seed) {
+    unsigned char key[32];
+    secp256k1_pubkey2 pub;
+    size_t len = 33;
+    memset(key, 0, 32);
+    memcpy(key, &seed, sizeof(seed));
+    key[31] = 1;
+    CHECK(secp256k1_ec_pubkey_create2(ctx, &pub, key));
+    CHECK(secp256k1_ec_pubkey_serialize2(ctx, out33, &len, &pub, SECP256K1_EC_COMPRESSED));
+}
+
+/* The challenges of random data do not close the ring, but verification walks
+ * every column regardless, so this times the same work as a valid signature. */
+static void bench_mlsag_setup(void* arg) {
+    bench_mlsag_data *data = (bench_mlsag_data*)arg;
+    size_t i;
+
+    for (i = 0; i < 32; i++) {
+        data->c[i] = i + 1;
+        data->msg32[i] = 255 - i;
+    }
+    for (i = 0; i < BENCH_MLSAG_ROWS * data->n_cols; i++) {
+        bench_mlsag_random_point(data->ctx, &data->pubkeys[33 * i], i + 1);
+        memset(&data->s[32 * i], 0, 32);
+        data->s[32 * i + 30] = i + 1;
+        data->s[32 * i + 31] = 7;
+        CHECK(secp256k1_mlsag_hash_to_point(data->ctx, &data->hps[i], &data->pubkeys[33 * i]));
+    }
+    for (i = 0; i < BENCH_MLSAG_ROWS; i++) {
+        bench_mlsag_random_point(data->ctx, &data->keyimages[33 * i], 1000 + i);
+    }
+}
+
+static void bench_mlsag_verify(void* arg) {
+    bench_mlsag_data *data = (bench_mlsag_data*)arg;
+    int i;
+
+    for (i = 0; i < data->iters; i++) {
+        CHECK(secp256k1_mlsag_verify(data->ctx, data->c, data->msg32, data->pubkeys, NULL, data->keyimages, data->s, BENCH_MLSAG_ROWS, data->n_cols) == 0);
+    }
+}
+
+static void bench_mlsag_verify_hashed(void* arg) {
+    bench_mlsag_data *data = (bench_mlsag_data*)arg;
+    int i;
+
+    for (i = 0; i < data->iters; i++) {
+        CHECK(secp256k1_mlsag_verify(data->ctx, data->c, data->msg32, data->pubkeys, data->hps, data->keyimages, data->s, BENCH_MLSAG_ROWS, data->n_cols) == 0);
+    }
+}
+
+/* The previous verifier: every operation parses and re-serializes 33-byte points */
+static void bench_mlsag_hash_to_point_serialized(const secp256k1_context2 *ctx, secp256k1_pubkey2 *out, const unsigned char *pub33) {
+    unsigned char buf[33];
+    buf[0] = pub33[0];
+    bench_sha256d(&buf[1], pub33, 33);
+    while (!secp256k1_ec_pubkey_parse2(ctx, out, buf, 33)) {
+        unsigned char hash[32];
+        bench_sha256d(hash, buf, 33);
+        memcpy(&buf[1], hash, 32);
+    }
+}
+
+static void bench_mlsag_verify_serialized(void* arg) {
+    bench_mlsag_data *data = (bench_mlsag_data*)arg;
+    unsigned char buf[2 * BENCH_MLSAG_ROWS * 33 + 32];
+    unsigned char c[32];
+    int it;
+    size_t i, j;
+
+    for (it = 0; it < data->iters; it++) {
+        memcpy(c, data->c, 32);
+        for (j = 0; j < data->n_cols; j++) {
+            for (i = 0; i < BENCH_MLSAG_ROWS; i++) {
+                const unsigned char *pub = &data->pubkeys[33 * (i * data->n_cols + j)];
+                const unsigned char *sij = &data->s[32 * (i * data->n_cols + j)];
+                const secp256k1_pubkey2 *terms[2];
+                secp256k1_pubkey2 p, hp, ki, r;
+                size_t len = 33;
+
+                CHECK(secp256k1_ec_pubkey_parse2(data->ctx, &p, pub, 33));
+                CHECK(secp256k1_ec_pubkey_tweak_mul2(data->ctx, &p, c));
+                CHECK(secp256k1_ec_pubkey_serialize2(data->ctx, &buf[66 * i], &len, &p, SECP256K1_EC_COMPRESSED));
+                CHECK(secp256k1_ec_pubkey_parse2(data->ctx, &p, &buf[66 * i], 33));
+                CHECK(secp256k1_ec_pubkey_tweak_add2(data->ctx, &p, sij));
+                CHECK(secp256k1_ec_pubkey_serialize2(data->ctx, &buf[66 * i], &len, &p, SECP256K1_EC_COMPRESSED));
+
+                bench_mlsag_hash_to_point_serialized(data->ctx, &hp, pub);
+                CHECK(secp256k1_ec_pubkey_tweak_mul2(data->ctx, &hp, sij));
+                CHECK(secp256k1_ec_pubkey_parse2(data->ctx, &ki, &data->keyimages[33 * i], 33));
+                CHECK(secp256k1_ec_pubkey_tweak_mul2(data->ctx, &ki, c));
+                terms[0] = &hp;
+                terms[1] = &ki;
+                CHECK(secp256k1_ec_pubkey_combine2(data->ctx, &r, terms, 2));
+                CHECK(secp256k1_ec_pubkey_serialize2(data->ctx, &buf[66 * i + 33], &len, &r, SECP256K1_EC_COMPRESSED));
+            }
+            memcpy(&buf[66 * BENCH_MLSAG_ROWS], data->msg32, 32);
+            bench_sha256d(c, buf, 66 * BENCH_MLSAG_ROWS + 32);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    bench_mlsag_data data;
+    static const size_t ring_sizes[] = {12, 16, 28, 33};
+    size_t i;
+    char name[64];
+
+    data.ctx = secp256k1_context_create2(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
+    data.iters = 20;
+
+    for (i = 0; i < sizeof(ring_sizes) / sizeof(ring_sizes[0]); i++) {
+        data.n_cols = ring_sizes[i];
+        if (have_flag(argc, argv, "mlsag") || have_flag(argc, argv, "serialized")) {
+            sprintf(name, "mlsag_verify_serialized_%ix%i", BENCH_MLSAG_ROWS, (int)data.n_cols);
+            run_benchmark(name, bench_mlsag_verify_serialized, bench_mlsag_setup, NULL, &data, 10, data.iters);
+        }
+        if (have_flag(argc, argv, "mlsag") || have_flag(argc, argv, "verify")) {
+            sprintf(name, "mlsag_verify_%ix%i", BENCH_MLSAG_ROWS, (int)data.n_cols);
+            run_benchmark(name, bench_mlsag_verify, bench_mlsag_setup, NULL, &data, 10, data.iters);
+        }
+        if (have_flag(argc, argv, "mlsag") || have_flag(argc, argv, "hashed")) {
+            sprintf(name, "mlsag_verify_hashed_%ix%i", BENCH_MLSAG_ROWS, (int)data.n_cols);
+            run_benchmark(name, bench_mlsag_verify_hashed, bench_mlsag_setup, NULL, &data, 10, data.iters);
+        }
+    }
+
+    secp256k1_context_destroy(data.ctx);
+    return 0;
+}
@@ -0,0 +1,112 @@
+/**********************************************************************
+ * Copyright (c) 2020-2022 The PRivaCY Coin Developers                *
+ * Distributed under the MIT software license, see the accompanying   *
+ * file COPYING or http://www.opensource.org/licenses/mit-license.php.*
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/secp256k1_2.h"
+#include "include/secp256k1_stealth.h"
+#include "util.h"
+#include "hash_impl.h"
+#include "bench.h"
+
+#define BENCH_STEALTH_MAX_OUTPUTS 128
+
+typedef struct {
+    secp256k1_context2 *ctx;
+    unsigned char view[32];
+    unsigned char spend33[33];
+    unsigned char tx_pubkeys[BENCH_STEALTH_MAX_OUTPUTS * 33];
+    unsigned char destinations[BENCH_STEALTH_MAX_OUTPUTS * 33];
+    size_t n;
+    int iters;
+} bench_stealth_data;
+
+static void bench_stealth_setup(void* arg) {
+    bench_stealth_data *data = (bench_stealth_data*)arg;
+    unsigned char key[32];
+    secp256k1_pubkey2 pub;
+    size_t i, len;
+
+    for (i = 0; i < 32; i++) {
+        data->view[i] = i + 1;
+        key[i] = 255 - i;
+    }
+    len = 33;
+    CHECK(secp256k1_ec_pubkey_create2(data->ctx, &pub, key));
+    CHECK(secp256k1_ec_pubkey_serialize2(data->ctx, data->spend33, &len, &pub, SECP256K1_EC_COMPRESSED));
+    for (i = 0; i < data->n; i++) {
+        key[0] = i;
+        len = 33;
+        CHECK(secp256k1_ec_pubkey_create2(data->ctx, &pub, key));
+        CHECK(secp256k1_ec_pubkey_serialize2(data->ctx, &data->tx_pubkeys[33 * i], &len, &pub, SECP256K1_EC_COMPRESSED));
+    }
+}
+
+static void bench_stealth_destinations(void* arg) {
+    bench_stealth_data *data = (bench_stealth_data*)arg;
+    int i;
+
+    for (i = 0; i < data->iters; i++) {
+        CHECK(secp256k1_stealth_destinations(data->ctx, data->destinations, data->view, data->spend33, data->tx_pubkeys, data->n));
+    }
+}
+
+/* The previous scanner: one output at a time through serialized public keys */
+static void bench_stealth_destinations_serialized(void* arg) {
+    bench_stealth_data *data = (bench_stealth_data*)arg;
+    int i;
+    size_t k;
+
+    for (i = 0; i < data->iters; i++) {
+        for (k = 0; k < data->n; k++) {
+            secp256k1_pubkey2 ar, dest;
+            unsigned char ar33[33];
+            unsigned char hs[32];
+            size_t len = 33;
+            secp256k1_sha256 sha;
+
+            CHECK(secp256k1_ec_pubkey_parse2(data->ctx, &ar, &data->tx_pubkeys[33 * k], 33));
+            CHECK(secp256k1_ec_pubkey_tweak_mul2(data->ctx, &ar, data->view));
+            CHECK(secp256k1_ec_pubkey_serialize2(data->ctx, ar33, &len, &ar, SECP256K1_EC_COMPRESSED));
+            secp256k1_sha256_initialize(&sha);
+            secp256k1_sha256_write(&sha, ar33, 33);
+            secp256k1_sha256_finalize(&sha, hs);
+            secp256k1_sha256_initialize(&sha);
+            secp256k1_sha256_write(&sha, hs, 32);
+            secp256k1_sha256_finalize(&sha, hs);
+            CHECK(secp256k1_ec_pubkey_parse2(data->ctx, &dest, data->spend33, 33));
+            CHECK(secp256k1_ec_pubkey_tweak_add2(data->ctx, &dest, hs));
+            CHECK(secp256k1_ec_pubkey_serialize2(data->ctx, &data->destinations[33 * k], &len, &dest, SECP256K1_EC_COMPRESSED));
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    bench_stealth_data data;
+    static const size_t batch_sizes[] = {1, 2, 16, 128};
+    size_t i;
+    char name[64];
+
+    data.ctx = secp256k1_context_create2(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
+    data.iters = 20;
+
+    for (i = 0; i < sizeof(batch_sizes) / sizeof(batch_sizes[0]); i++) {
+        data.n = batch_sizes[i];
+        if (have_flag(argc, argv, "stealth") || have_flag(argc, argv, "serialized")) {
+            sprintf(name, "stealth_destinations_serialized_%i", (int)data.n);
+            run_benchmark(name, bench_stealth_destinations_serialized, bench_stealth_setup, NULL, &data, 10, data.iters * data.n);
+        }
+        if (have_flag(argc, argv, "stealth") || have_flag(argc, argv, "batch")) {
+            sprintf(name, "stealth_destinations_%i", (int)data.n);
+            run_benchmark(name, bench_stealth_destinations, bench_stealth_setup, NULL, &data, 10, data.iters * data.n);
+        }
+    }
+
+    secp256k1_context_destroy(data.ctx);
+    return 0;
+}
@@ -0,0 +1,183 @@
+/**********************************************************************
+ * Copyright (c) 2020-2022 The PRivaCY Coin Developers                *
+ * Distributed under the MIT software license, see the accompanying   *
+ * file COPYING or http://www.opensource.org/licenses/mit-license.php.*
+ **********************************************************************/
+
+#ifndef SECP256K1_MODULE_MLSAG_MAIN_H
+#define SECP256K1_MODULE_MLSAG_MAIN_H
+
+#include "group.h"
+#include "scalar.h"
+#include "hash.h"
+#include "eckey.h"
+#include "ecmult.h"
+
+#include "include/secp256k1_mlsag.h"
+
+static void secp256k1_mlsag_sha256d(unsigned char *out32, const unsigned char *data, size_t len) {
+    secp256k1_sha256 sha;
+    unsigned char tmp[32];
+
+    secp256k1_sha256_initialize(&sha);
+    secp256k1_sha256_write(&sha, data, len);
+    secp256k1_sha256_finalize(&sha, tmp);
+    secp256k1_sha256_initialize(&sha);
+    secp256k1_sha256_write(&sha, tmp, 32);
+    secp256k1_sha256_finalize(&sha, out32);
+}
+
+/* Hash a compressed public key to a curve point by hashing successively until
+ * the prefix of the key followed by the hash parses as a compressed point. */
+static void secp256k1_mlsag_hash_to_ge(secp256k1_ge *r, const unsigned char *pub33) {
+    unsigned char buf[33];
+    secp256k1_fe x;
+
+    buf[0] = pub33[0];
+    secp256k1_mlsag_sha256d(&buf[1], pub33, 33);
+    while (!secp256k1_fe_set_b32(&x, &buf[1]) || !secp256k1_ge_set_xo_var(r, &x, buf[0] == SECP256K1_TAG_PUBKEY_ODD)) {
+        unsigned char hash[32];
+        secp256k1_mlsag_sha256d(hash, buf, 33);
+        memcpy(&buf[1], hash, 32);
+    }
+}
+
+/* r = na[0] * a[0] + na[1] * a[1], sharing the doublings between both points. */
+static void secp256k1_mlsag_ecmult2(const secp256k1_ecmult_context *ctx, secp256k1_gej *r, const secp256k1_gej *a, const secp256k1_scalar *na) {
+    secp256k1_gej prej[2 * ECMULT_TABLE_SIZE(WINDOW_A)];
+    secp256k1_fe zr[2 * ECMULT_TABLE_SIZE(WINDOW_A)];
+    secp256k1_ge pre_a[2 * ECMULT_TABLE_SIZE(WINDOW_A)];
+    struct secp256k1_strauss_point_state ps[2];
+#ifdef USE_ENDOMORPHISM
+    secp256k1_ge pre_a_lam[2 * ECMULT_TABLE_SIZE(WINDOW_A)];
+#endif
+    struct secp256k1_strauss_state state;
+
+    state.prej = prej;
+    state.zr = zr;
+    state.pre_a = pre_a;
+#ifdef USE_ENDOMORPHISM
+    state.pre_a_lam = pre_a_lam;
+#endif
+    state.ps = ps;
+    secp256k1_ecmult_strauss_wnaf(ctx, &state, r, 2, a, na, NULL);
+}
+
+int secp256k1_mlsag_hash_to_point(const secp256k1_context2* ctx, secp256k1_pubkey2 *hp, const unsigned char *pub33) {
+    secp256k1_ge ge;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(hp != NULL);
+    ARG_CHECK(pub33 != NULL);
+
+    secp256k1_mlsag_hash_to_ge(&ge, pub33);
+    secp256k1_pubkey2_save(hp, &ge);
+    return 1;
+}
+
+/* Parse a 32-byte challenge or response; zero and out-of-range values are rejected. */
+static int secp256k1_mlsag_scalar_parse(secp256k1_scalar *r, const unsigned char *b32) {
+    int overflow = 0;
+    secp256k1_scalar_set_b32(r, b32, &overflow);
+    return !overflow && !secp256k1_scalar_is_zero(r);
+}
+
+int secp256k1_mlsag_verify(const secp256k1_context2* ctx, const unsigned char *c, const unsigned char *msg32, const unsigned char *pubkeys, const secp256k1_pubkey2 *hashed_pubkeys, const unsigned char *keyimages, const unsigned char *s, size_t n_rows, size_t n_cols) {
+    secp256k1_ge *ki;
+    secp256k1_gej *lr;
+    secp256k1_ge *lr_ge;
+    unsigned char *buf;
+    unsigned char cj_b32[32];
+    secp256k1_scalar cj;
+    size_t buflen;
+    size_t i, j;
+    int ret = 0;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(c != NULL);
+    ARG_CHECK(msg32 != NULL);
+    ARG_CHECK(pubkeys != NULL);
+    ARG_CHECK(keyimages != NULL);
+    ARG_CHECK(s != NULL);
+
+    if (n_rows == 0 || n_cols == 0) {
+        return 0;
+    }
+    if (!secp256k1_mlsag_scalar_parse(&cj, c)) {
+        return 0;
+    }
+
+    buflen = 2 * n_rows * 33 + 32;
+    ki = (secp256k1_ge *)checked_malloc(&ctx->error_callback, n_rows * sizeof(*ki));
+    lr = (secp256k1_gej *)checked_malloc(&ctx->error_callback, 2 * n_rows * sizeof(*lr));
+    lr_ge = (secp256k1_ge *)checked_malloc(&ctx->error_callback, 2 * n_rows * sizeof(*lr_ge));
+    buf = (unsigned char *)checked_malloc(&ctx->error_callback, buflen);
+
+    for (i = 0; i < n_rows; i++) {
+        if (!secp256k1_eckey_pubkey_parse(&ki[i], &keyimages[33 * i], 33)) {
+            goto done;
+        }
+    }
+    memcpy(&buf[2 * n_rows * 33], msg32, 32);
+
+    for (j = 0; j < n_cols; j++) {
+        for (i = 0; i < n_rows; i++) {
+            const unsigned char *pub = &pubkeys[33 * (i * n_cols + j)];
+            secp256k1_ge p, hp;
+            secp256k1_gej pj, a[2];
+            secp256k1_scalar sij, na[2];
+
+            if (!secp256k1_eckey_pubkey_parse(&p, pub, 33) ||
+                !secp256k1_mlsag_scalar_parse(&sij, &s[32 * (i * n_cols + j)])) {
+                goto done;
+            }
+
+            /* L_ij = c_j * P_ij + s_ij * G */
+            secp256k1_gej_set_ge(&pj, &p);
+            secp256k1_ecmult(&ctx->ecmult_ctx, &lr[2 * i], &pj, &cj, &sij);
+
+            /* R_ij = s_ij * Hp(P_ij) + c_j * I_i */
+            if (hashed_pubkeys != NULL) {
+                if (!secp256k1_pubkey2_load(ctx, &hp, &hashed_pubkeys[i * n_cols + j])) {
+                    goto done;
+                }
+            } else {
+                secp256k1_mlsag_hash_to_ge(&hp, pub);
+            }
+            secp256k1_gej_set_ge(&a[0], &hp);
+            secp256k1_gej_set_ge(&a[1], &ki[i]);
+            na[0] = sij;
+            na[1] = cj;
+            secp256k1_mlsag_ecmult2(&ctx->ecmult_ctx, &lr[2 * i + 1], a, na);
+
+            if (secp256k1_gej_is_infinity(&lr[2 * i]) || secp256k1_gej_is_infinity(&lr[2 * i + 1])) {
+                goto done;
+            }
+        }
+
+        /* One field inversion for all points of the column */
+        secp256k1_ge_set_all_gej_var(lr_ge, lr, 2 * n_rows, &ctx->error_callback);
+        for (i = 0; i < 2 * n_rows; i++) {
+            size_t len = 33;
+            if (!secp256k1_eckey_pubkey_serialize(&lr_ge[i], &buf[33 * i], &len, 1)) {
+                goto done;
+            }
+        }
+        secp256k1_mlsag_sha256d(cj_b32, buf, buflen);
+        if (j + 1 < n_cols && !secp256k1_mlsag_scalar_parse(&cj, cj_b32)) {
+            goto done;
+        }
+    }
+
+    ret = memcmp(cj_b32, c, 32) == 0;
+
+done:
+    free(buf);
+    free(lr_ge);
+    free(lr);
+    free(ki);
+    return ret;
+}
+
+#endif /* SECP256K1_MODULE_MLSAG_MAIN_H */
@@ -0,0 +1,284 @@
+/**********************************************************************
+ * Copyright (c) 2020-2022 The PRivaCY Coin Developers                *
+ * Distributed under the MIT software license, see the accompanying   *
+ * file COPYING or http://www.opensource.org/licenses/mit-license.php.*
+ **********************************************************************/
+
+#ifndef SECP256K1_MODULE_MLSAG_TESTS
+#define SECP256K1_MODULE_MLSAG_TESTS
+
+#include <string.h>
+
+#include "group.h"
+#include "scalar.h"
+#include "testrand.h"
+#include "util.h"
+
+#include "include/secp256k1_mlsag.h"
+
+#define MLSAG_TEST_MAX_ROWS 4
+#define MLSAG_TEST_MAX_COLS 16
+
+static void test_mlsag_serialize(unsigned char *out33, secp256k1_gej *pj) {
+    secp256k1_ge p;
+    size_t len = 33;
+    secp256k1_ge_set_gej(&p, pj);
+    CHECK(secp256k1_eckey_pubkey_serialize(&p, out33, &len, 1));
+}
+
+/* Produce a signature for secret keys x[i] at column pi, in the layout secp256k1_mlsag_verify expects */
+static void test_mlsag_sign(unsigned char *c, const unsigned char *msg32, unsigned char *pubkeys, unsigned char *keyimages, unsigned char *s, size_t n_rows, size_t n_cols, size_t pi) {
+    secp256k1_scalar x[MLSAG_TEST_MAX_ROWS], alpha[MLSAG_TEST_MAX_ROWS], cj, sij;
+    unsigned char buf[2 * MLSAG_TEST_MAX_ROWS * 33 + 32];
+    unsigned char cj_b32[32];
+    secp256k1_gej pj;
+    secp256k1_ge hp;
+    size_t i, j, k;
+
+    for (i = 0; i < n_rows; i++) {
+        for (j = 0; j < n_cols; j++) {
+            secp256k1_scalar key;
+            random_scalar_order_test(&key);
+            if (j == pi) {
+                x[i] = key;
+            }
+            secp256k1_ecmult_gen(&ctx->ecmult_gen_ctx, &pj, &key);
+            test_mlsag_serialize(&pubkeys[33 * (i * n_cols + j)], &pj);
+        }
+        /* I_i = x_i * Hp(P_i,pi) */
+        secp256k1_mlsag_hash_to_ge(&hp, &pubkeys[33 * (i * n_cols + pi)]);
+        secp256k1_gej_set_ge(&pj, &hp);
+        secp256k1_ecmult(&ctx->ecmult_ctx, &pj, &pj, &x[i], NULL);
+        test_mlsag_serialize(&keyimages[33 * i], &pj);
+    }
+
+    /* Column pi commits to alpha * G and alpha * Hp(P) */
+    for (i = 0; i < n_rows; i++) {
+        random_scalar_order_test(&alpha[i]);
+        secp256k1_ecmult_gen(&ctx->ecmult_gen_ctx, &pj, &alpha[i]);
+        test_mlsag_serialize(&buf[66 * i], &pj);
+        secp256k1_mlsag_hash_to_ge(&hp, &pubkeys[33 * (i * n_cols + pi)]);
+        secp256k1_gej_set_ge(&pj, &hp);
+        secp256k1_ecmult(&ctx->ecmult_ctx, &pj, &pj, &alpha[i], NULL);
+        test_mlsag_serialize(&buf[66 * i + 33], &pj);
+    }
+    memcpy(&buf[66 * n_rows], msg32, 32);
+    secp256k1_mlsag_sha256d(cj_b32, buf, 66 * n_rows + 32);
+
+    /* Close the ring through the other columns with random responses */
+    for (k = 1; k < n_cols; k++) {
+        j = (pi + k) % n_cols;
+        if (j == 0) {
+            memcpy(c, cj_b32, 32);
+        }
+        CHECK(secp256k1_mlsag_scalar_parse(&cj, cj_b32));
+        for (i = 0; i < n_rows; i++) {
+            secp256k1_ge p, ki;
+            secp256k1_gej a[2];
+            secp256k1_scalar na[2];
+            random_scalar_order_test(&sij);
+            secp256k1_scalar_get_b32(&s[32 * (i * n_cols + j)], &sij);
+            CHECK(secp256k1_eckey_pubkey_parse(&p, &pubkeys[33 * (i * n_cols + j)], 33));
+            secp256k1_gej_set_ge(&pj, &p);
+            secp256k1_ecmult(&ctx->ecmult_ctx, &pj, &pj, &cj, &sij);
+            test_mlsag_serialize(&buf[66 * i], &pj);
+            secp256k1_mlsag_hash_to_ge(&hp, &pubkeys[33 * (i * n_cols + j)]);
+            CHECK(secp256k1_eckey_pubkey_parse(&ki, &keyimages[33 * i], 33));
+            secp256k1_gej_set_ge(&a[0], &hp);
+            secp256k1_gej_set_ge(&a[1], &ki);
+            na[0] = sij;
+            na[1] = cj;
+            secp256k1_mlsag_ecmult2(&ctx->ecmult_ctx, &pj, a, na);
+            test_mlsag_serialize(&buf[66 * i + 33], &pj);
+        }
+        secp256k1_mlsag_sha256d(cj_b32, buf, 66 * n_rows + 32);
+    }
+    if (pi == 0) {
+        memcpy(c, cj_b32, 32);
+    }
+
+    /* s_pi = alpha - c_pi * x */
+    CHECK(secp256k1_mlsag_scalar_parse(&cj, cj_b32));
+    for (i = 0; i < n_rows; i++) {
+        secp256k1_scalar_mul(&sij, &cj, &x[i]);
+        secp256k1_scalar_negate(&sij, &sij);
+        secp256k1_scalar_add(&sij, &sij, &alpha[i]);
+        secp256k1_scalar_get_b32(&s[32 * (i * n_cols + pi)], &sij);
+    }
+}
+
+static void test_mlsag_sign_verify(size_t n_rows, size_t n_cols) {
+    unsigned char c[32];
+    unsigned char msg32[32];
+    unsigned char pubkeys[MLSAG_TEST_MAX_ROWS * MLSAG_TEST_MAX_COLS * 33];
+    unsigned char keyimages[MLSAG_TEST_MAX_ROWS * 33];
+    unsigned char s[MLSAG_TEST_MAX_ROWS * MLSAG_TEST_MAX_COLS * 32];
+    secp256k1_pubkey2 hps[MLSAG_TEST_MAX_ROWS * MLSAG_TEST_MAX_COLS];
+    size_t pi = secp256k1_rand_int(n_cols);
+    size_t idx;
+
+    secp256k1_rand256(msg32);
+    test_mlsag_sign(c, msg32, pubkeys, keyimages, s, n_rows, n_cols, pi);
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, pubkeys, NULL, keyimages, s, n_rows, n_cols) == 1);
+
+    /* Precomputed Hp(P) gives the same result */
+    for (idx = 0; idx < n_rows * n_cols; idx++) {
+        CHECK(secp256k1_mlsag_hash_to_point(ctx, &hps[idx], &pubkeys[33 * idx]) == 1);
+    }
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, pubkeys, hps, keyimages, s, n_rows, n_cols) == 1);
+    idx = secp256k1_rand_int(n_rows * n_cols);
+    CHECK(secp256k1_mlsag_hash_to_point(ctx, &hps[idx], &pubkeys[33 * ((idx + 1) % (n_rows * n_cols))]) == 1);
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, pubkeys, hps, keyimages, s, n_rows, n_cols) == 0);
+
+    /* Any other message fails */
+    msg32[secp256k1_rand_int(32)] ^= 1 << secp256k1_rand_int(8);
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, pubkeys, NULL, keyimages, s, n_rows, n_cols) == 0);
+    secp256k1_rand256(msg32);
+    test_mlsag_sign(c, msg32, pubkeys, keyimages, s, n_rows, n_cols, pi);
+
+    /* Tampered challenge or response */
+    c[31] ^= 1;
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, pubkeys, NULL, keyimages, s, n_rows, n_cols) == 0);
+    c[31] ^= 1;
+    idx = secp256k1_rand_int(n_rows * n_cols);
+    s[32 * idx + 31] ^= 1;
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, pubkeys, NULL, keyimages, s, n_rows, n_cols) == 0);
+    s[32 * idx + 31] ^= 1;
+
+    /* Key image of another key */
+    idx = secp256k1_rand_int(n_rows);
+    keyimages[33 * idx] ^= 1;
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, pubkeys, NULL, keyimages, s, n_rows, n_cols) == 0);
+    keyimages[33 * idx] ^= 1;
+
+    /* Zero response */
+    idx = secp256k1_rand_int(n_rows * n_cols);
+    memset(&s[32 * idx], 0, 32);
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, pubkeys, NULL, keyimages, s, n_rows, n_cols) == 0);
+}
+
+static void test_mlsag_hash_to_point(void) {
+    unsigned char pub33[33];
+    unsigned char out33[33];
+    secp256k1_pubkey2 hp;
+    secp256k1_ge ge;
+    secp256k1_gej gej;
+    secp256k1_scalar key;
+    size_t len = 33;
+
+    random_scalar_order_test(&key);
+    secp256k1_ecmult_gen(&ctx->ecmult_gen_ctx, &gej, &key);
+    test_mlsag_serialize(pub33, &gej);
+    CHECK(secp256k1_mlsag_hash_to_point(ctx, &hp, pub33) == 1);
+    CHECK(secp256k1_ec_pubkey_serialize2(ctx, out33, &len, &hp, SECP256K1_EC_COMPRESSED) == 1);
+    /* The parity of the input is kept */
+    CHECK(out33[0] == pub33[0]);
+    secp256k1_mlsag_hash_to_ge(&ge, pub33);
+    secp256k1_gej_set_ge(&gej, &ge);
+    test_mlsag_serialize(pub33, &gej);
+    CHECK(memcmp(out33, pub33, 33) == 0);
+}
+
+/* A signature made by CWallet::makeRingCT, which hashes to points with PointHashingSuccessively
+ * and walks the ring with the byte-oriented tweak API: 2 rows, ring size 4, signed at column 2.
+ * x0 is the secret key of row 0 at that column. */
+static void test_mlsag_wallet_vector(void) {
+    static const unsigned char c[32] = {
+        0xbb, 0x08, 0x80, 0xe6, 0x27, 0xe7, 0x55, 0xe1, 0x85, 0x64, 0xe7, 0xce, 0x19, 0x34, 0x05, 0x28, 0x7f, 0x23, 0x83, 0x81, 0x68, 0xa9, 0x35, 0x96, 0x2f, 0xf2, 0xde, 0x24, 0x1b, 0x9a, 0xbd, 0x23
+    };
+    static const unsigned char msg32[32] = {
+        0xdb, 0xf9, 0x25, 0x8a, 0x9d, 0xd5, 0xa7, 0xf1, 0xe6, 0xff, 0xc2, 0xac, 0x0e, 0xe2, 0x73, 0x11, 0x7f, 0xc9, 0x8f, 0x0d, 0x25, 0x4b, 0x58, 0x9d, 0x58, 0xfa, 0x67, 0x91, 0x66, 0x77, 0x6e, 0x21
+    };
+    static const unsigned char pubkeys[8][33] = {
+        {0x02, 0xc8, 0xed, 0xd9, 0x60, 0xaa, 0xa2, 0x08, 0x10, 0x7d, 0x4b, 0x3f, 0xda, 0x87, 0x9a, 0x37, 0x02, 0x8b, 0xc2, 0x47, 0x3e, 0xcd, 0x2f, 0x61, 0x5f, 0xae, 0xee, 0xd0, 0xc9, 0x46, 0x0f, 0x8a, 0xc4},
+        {0x02, 0xf2, 0xb3, 0x3e, 0x36, 0x67, 0x0f, 0x99, 0xf7, 0x03, 0x15, 0x8c, 0x98, 0xe6, 0xff, 0xf4, 0x9c, 0xed, 0x6f, 0x92, 0x80, 0x6d, 0xa4, 0x1f, 0xba, 0x20, 0xce, 0x26, 0x2c, 0x2a, 0xc8, 0xc9, 0x3f},
+        {0x03, 0xcc, 0x01, 0xc1, 0x37, 0x94, 0x8f, 0x37, 0xdb, 0x99, 0x82, 0xda, 0xfa, 0x3b, 0x63, 0x9c, 0x0e, 0x38, 0xda, 0x25, 0x75, 0xf2, 0x01, 0x7e, 0x93, 0xd4, 0xb5, 0xbb, 0xad, 0x59, 0xc9, 0xa4, 0xb7},
+        {0x02, 0x68, 0x4c, 0x37, 0x30, 0x4b, 0xc7, 0xf5, 0x81, 0x1a, 0x48, 0x79, 0x4b, 0x31, 0xae, 0x40, 0x27, 0x6a, 0x36, 0x54, 0x5e, 0x53, 0x46, 0xb0, 0xdf, 0xa4, 0xd1, 0x1c, 0x05, 0x09, 0x50, 0x2a, 0xb5},
+        {0x02, 0xea, 0x0c, 0x7c, 0x75, 0x0c, 0x52, 0xfa, 0x04, 0x92, 0x5f, 0x5d, 0xcb, 0x7e, 0x79, 0x04, 0x64, 0x91, 0x99, 0x74, 0x80, 0xf7, 0x68, 0x40, 0x3a, 0x3d, 0x5b, 0xf1, 0xc0, 0xd8, 0x60, 0x19, 0x1d},
+        {0x02, 0x37, 0x4b, 0x87, 0xfc, 0xe2, 0x37, 0xf1, 0xc5, 0x67, 0x6d, 0x9e, 0xb0, 0xc4, 0xb3, 0x0f, 0xbe, 0xac, 0xa7, 0xc4, 0x82, 0x22, 0x31, 0xc4, 0xb9, 0x1b, 0x53, 0x84, 0x9e, 0x05, 0x2b, 0xe6, 0x69},
+        {0x03, 0x21, 0x7c, 0xd4, 0x82, 0x7f, 0xaa, 0x74, 0x6b, 0xfd, 0xdd, 0x53, 0xbe, 0xf7, 0x87, 0xa0, 0x46, 0xc4, 0xd0, 0xa9, 0x77, 0x31, 0xb6, 0x6b, 0xd1, 0xab, 0x41, 0x30, 0x68, 0x45, 0x3e, 0x59, 0x1b},
+        {0x03, 0x65, 0xd9, 0x90, 0xdc, 0x8a, 0x3e, 0xa9, 0x9b, 0xcf, 0x79, 0x9c, 0x9f, 0xbd, 0xce, 0x5c, 0x85, 0x55, 0x34, 0x34, 0xee, 0xdd, 0x74, 0x14, 0xc5, 0xcf, 0xf0, 0xb7, 0x65, 0x04, 0x07, 0x96, 0x96}
+    };
+    static const unsigned char keyimages[2][33] = {
+        {0x02, 0xf6, 0x77, 0x1b, 0xf6, 0xd3, 0x90, 0x6a, 0x7c, 0xb3, 0xa1, 0xee, 0x95, 0xe1, 0x14, 0x27, 0x75, 0xf4, 0x84, 0xe9, 0xd5, 0x13, 0x25, 0x44, 0x41, 0x9c, 0xc9, 0x49, 0x40, 0xbd, 0xe1, 0x54, 0x31},
+        {0x02, 0xf6, 0x63, 0xb6, 0x92, 0x97, 0x0b, 0x45, 0x42, 0xf0, 0xe5, 0xa0, 0xff, 0xde, 0x0f, 0x18, 0x98, 0x8e, 0x5a, 0x2f, 0xaa, 0x06, 0x3d, 0x17, 0x7e, 0xf4, 0xb9, 0x1e, 0xa3, 0x82, 0x64, 0x11, 0x69}
+    };
+    static const unsigned char s[8][32] = {
+        {0x91, 0xe3, 0x56, 0xd9, 0x36, 0xe3, 0x9d, 0x66, 0xdb, 0x08, 0x2b, 0x0f, 0x54, 0x17, 0xb6, 0x42, 0xbb, 0x69, 0xf6, 0x06, 0x3e, 0x39, 0x3d, 0xf4, 0x66, 0xb8, 0xbc, 0x88, 0xbf, 0xb7, 0x5e, 0x36},
+        {0x95, 0x23, 0x53, 0x7d, 0xf1, 0x90, 0x5a, 0xfd, 0x6c, 0x14, 0x98, 0xae, 0x47, 0xd7, 0x28, 0x32, 0xe2, 0x0e, 0x7b, 0x9b, 0xe3, 0xa4, 0x4b, 0x55, 0x9e, 0xf7, 0x9c, 0xd4, 0x52, 0xea, 0x6b, 0xd2},
+        {0xc2, 0xb3, 0x04, 0x32, 0x80, 0x66, 0x2a, 0x71, 0x29, 0x71, 0x87, 0x99, 0xe5, 0xe0, 0xb8, 0x10, 0xa1, 0xfd, 0xff, 0x9e, 0xed, 0x42, 0x7d, 0x5e, 0xdf, 0xa7, 0x40, 0x0c, 0xf2, 0x03, 0xfb, 0x0d},
+        {0xb3, 0x98, 0x8a, 0xfd, 0xe5, 0x02, 0x49, 0x29, 0x4a, 0x53, 0xf1, 0xd4, 0x13, 0xc8, 0x9b, 0x44, 0x1a, 0x50, 0x09, 0x14, 0xa6, 0x09, 0xed, 0x44, 0x59, 0x9f, 0x1e, 0xb5, 0x06, 0x31, 0xf3, 0x2c},
+        {0x48, 0xc5, 0x5d, 0x94, 0xe6, 0x78, 0x4d, 0x9d, 0xb8, 0x9c, 0xfb, 0xfb, 0x4d, 0x7c, 0x8b, 0x7c, 0xfe, 0x95, 0xf9, 0xca, 0x26, 0x79, 0x2d, 0x20, 0x63, 0x02, 0x2f, 0x1b, 0xb1, 0xd9, 0xfc, 0x29},
+        {0xd3, 0x2b, 0xe7, 0x7f, 0xb1, 0x81, 0x34, 0x57, 0x8a, 0x11, 0x3e, 0x89, 0x34, 0xc7, 0xf9, 0x58, 0x26, 0x8b, 0x67, 0xfa, 0x0b, 0x8c, 0xac, 0x70, 0xd6, 0x94, 0x2a, 0x63, 0x4e, 0x07, 0x26, 0xaa},
+        {0x78, 0xe3, 0x34, 0xb4, 0x1b, 0xf1, 0xf6, 0x9c, 0xe3, 0x2c, 0xa1, 0x73, 0xf1, 0x01, 0xb4, 0xf6, 0xb9, 0xf6, 0x20, 0x0a, 0x4e, 0xab, 0x97, 0x6c, 0xca, 0xcc, 0xf4, 0xbe, 0x14, 0xfd, 0xa7, 0x51},
+        {0xb9, 0xc5, 0x19, 0xbc, 0xc6, 0x0d, 0x5a, 0x3a, 0x98, 0x1a, 0x74, 0x8e, 0x13, 0x69, 0x43, 0x86, 0xd8, 0x43, 0xbd, 0xf8, 0xa1, 0x92, 0x41, 0xc0, 0x9c, 0x50, 0x37, 0x24, 0x23, 0x1c, 0xfc, 0xc7}
+    };
+    static const unsigned char x0[32] = {
+        0xb2, 0xfe, 0x94, 0x6e, 0xd2, 0x37, 0x33, 0xd7, 0x25, 0xe4, 0x97, 0xc8, 0x30, 0x87, 0x36, 0x44, 0xf7, 0xff, 0x0d, 0x69, 0xc3, 0xc2, 0x0b, 0x5e, 0xf9, 0xdf, 0x2d, 0xef, 0x38, 0x4d, 0x02, 0xf9
+    };
+    unsigned char msg[32];
+    unsigned char sig[8 * 32];
+    unsigned char out33[33];
+    secp256k1_pubkey2 hps[8];
+    secp256k1_scalar key;
+    secp256k1_gej pj;
+    secp256k1_ge hp;
+    size_t idx;
+    int overflow;
+
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, &pubkeys[0][0], NULL, &keyimages[0][0], &s[0][0], 2, 4) == 1);
+    for (idx = 0; idx < 8; idx++) {
+        CHECK(secp256k1_mlsag_hash_to_point(ctx, &hps[idx], pubkeys[idx]) == 1);
+    }
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, &pubkeys[0][0], hps, &keyimages[0][0], &s[0][0], 2, 4) == 1);
+
+    /* The key image of the wallet is x * Hp(P) */
+    secp256k1_scalar_set_b32(&key, x0, &overflow);
+    CHECK(!overflow);
+    secp256k1_mlsag_hash_to_ge(&hp, pubkeys[2]);
+    secp256k1_gej_set_ge(&pj, &hp);
+    secp256k1_ecmult(&ctx->ecmult_ctx, &pj, &pj, &key, NULL);
+    test_mlsag_serialize(out33, &pj);
+    CHECK(memcmp(out33, keyimages[0], 33) == 0);
+
+    memcpy(msg, msg32, 32);
+    msg[0] ^= 1;
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg, &pubkeys[0][0], NULL, &keyimages[0][0], &s[0][0], 2, 4) == 0);
+    memcpy(sig, s, sizeof(sig));
+    sig[32 * 2 + 31] ^= 1;
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, &pubkeys[0][0], NULL, &keyimages[0][0], sig, 2, 4) == 0);
+}
+
+static void test_mlsag_api(void) {
+    unsigned char c[32];
+    unsigned char msg32[32];
+    unsigned char pubkeys[2 * 33];
+    unsigned char keyimages[2 * 33];
+    unsigned char s[2 * 32];
+
+    secp256k1_rand256(msg32);
+    test_mlsag_sign(c, msg32, pubkeys, keyimages, s, 1, 2, 1);
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, pubkeys, NULL, keyimages, s, 1, 2) == 1);
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, pubkeys, NULL, keyimages, s, 0, 2) == 0);
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, pubkeys, NULL, keyimages, s, 1, 0) == 0);
+    /* A zero challenge can not be used as a scalar */
+    memset(c, 0, 32);
+    CHECK(secp256k1_mlsag_verify(ctx, c, msg32, pubkeys, NULL, keyimages, s, 1, 2) == 0);
+}
+
+void run_mlsag_tests(void) {
+    int i;
+    test_mlsag_api();
+    test_mlsag_wallet_vector();
+    for (i = 0; i < count; i++) {
+        test_mlsag_hash_to_point();
+        test_mlsag_sign_verify(1, 2);
+        test_mlsag_sign_verify(2, 11);
+        test_mlsag_sign_verify(MLSAG_TEST_MAX_ROWS, MLSAG_TEST_MAX_COLS);
+    }
+}
+
+#undef MLSAG_TEST_MAX_ROWS
+#undef MLSAG_TEST_MAX_COLS
+
+#endif /* SECP256K1_MODULE_MLSAG_TESTS */
@@ -0,0 +1,107 @@
+/**********************************************************************
+ * Copyright (c) 2020-2022 The PRivaCY Coin Developers                *
+ * Distributed under the MIT software license, see the accompanying   *
+ * file COPYING or http://www.opensource.org/licenses/mit-license.php.*
+ **********************************************************************/
+
+#ifndef SECP256K1_MODULE_STEALTH_MAIN_H
+#define SECP256K1_MODULE_STEALTH_MAIN_H
+
+#include "group.h"
+#include "scalar.h"
+#include "hash.h"
+#include "eckey.h"
+#include "ecmult.h"
+#include "ecmult_gen.h"
+
+#include "include/secp256k1_stealth.h"
+
+int secp256k1_stealth_destinations(const secp256k1_context2* ctx, unsigned char *destinations, const unsigned char *view, const unsigned char *spend_pubkey33, const unsigned char *tx_pubkeys, size_t n) {
+    secp256k1_scalar a;
+    secp256k1_ge b;
+    secp256k1_gej *pj;
+    secp256k1_ge *p;
+    unsigned char *valid;
+    size_t k;
+    int overflow = 0;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(secp256k1_ecmult_gen_context_is_built(&ctx->ecmult_gen_ctx));
+    ARG_CHECK(destinations != NULL);
+    ARG_CHECK(view != NULL);
+    ARG_CHECK(spend_pubkey33 != NULL);
+    ARG_CHECK(tx_pubkeys != NULL);
+
+    secp256k1_scalar_set_b32(&a, view, &overflow);
+    if (overflow || secp256k1_scalar_is_zero(&a) || !secp256k1_eckey_pubkey_parse(&b, spend_pubkey33, 33)) {
+        return 0;
+    }
+    memset(destinations, 0, 33 * n);
+    if (n == 0) {
+        return 1;
+    }
+
+    pj = (secp256k1_gej *)checked_malloc(&ctx->error_callback, n * sizeof(*pj));
+    p = (secp256k1_ge *)checked_malloc(&ctx->error_callback, n * sizeof(*p));
+    valid = (unsigned char *)checked_malloc(&ctx->error_callback, n);
+
+    /* a * R_k for every output; the view scalar is the same for all of them */
+    for (k = 0; k < n; k++) {
+        secp256k1_ge r;
+        valid[k] = secp256k1_eckey_pubkey_parse(&r, &tx_pubkeys[33 * k], 33);
+        if (valid[k]) {
+            secp256k1_gej_set_ge(&pj[k], &r);
+            secp256k1_ecmult(&ctx->ecmult_ctx, &pj[k], &pj[k], &a, NULL);
+            valid[k] = !secp256k1_gej_is_infinity(&pj[k]);
+        }
+        if (!valid[k]) {
+            secp256k1_gej_set_infinity(&pj[k]);
+        }
+    }
+    /* One field inversion for all shared secrets */
+    secp256k1_ge_set_all_gej_var(p, pj, n, &ctx->error_callback);
+
+    /* SHA256d(a * R_k) * G + B */
+    for (k = 0; k < n; k++) {
+        unsigned char ar[33];
+        unsigned char hs[32];
+        size_t len = 33;
+        secp256k1_sha256 sha;
+        secp256k1_scalar h;
+
+        if (valid[k]) {
+            secp256k1_eckey_pubkey_serialize(&p[k], ar, &len, 1);
+            secp256k1_sha256_initialize(&sha);
+            secp256k1_sha256_write(&sha, ar, 33);
+            secp256k1_sha256_finalize(&sha, hs);
+            secp256k1_sha256_initialize(&sha);
+            secp256k1_sha256_write(&sha, hs, 32);
+            secp256k1_sha256_finalize(&sha, hs);
+            secp256k1_scalar_set_b32(&h, hs, &overflow);
+            valid[k] = !overflow;
+        }
+        if (valid[k]) {
+            secp256k1_ecmult_gen(&ctx->ecmult_gen_ctx, &pj[k], &h);
+            secp256k1_gej_add_ge_var(&pj[k], &pj[k], &b, NULL);
+            valid[k] = !secp256k1_gej_is_infinity(&pj[k]);
+        }
+        if (!valid[k]) {
+            secp256k1_gej_set_infinity(&pj[k]);
+        }
+    }
+    secp256k1_ge_set_all_gej_var(p, pj, n, &ctx->error_callback);
+    for (k = 0; k < n; k++) {
+        size_t len = 33;
+        if (valid[k]) {
+            secp256k1_eckey_pubkey_serialize(&p[k], &destinations[33 * k], &len, 1);
+        }
+    }
+
+    free(valid);
+    free(p);
+    free(pj);
+    return 1;
+}
+
+#endif /* SECP256K1_MODULE_STEALTH_MAIN_H */
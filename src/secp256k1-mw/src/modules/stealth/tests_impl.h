@@ -0,0 +1,127 @@
+/**********************************************************************
+ * Copyright (c) 2020-2022 The PRivaCY Coin Developers                *
+ * Distributed under the MIT software license, see the accompanying   *
+ * file COPYING or http://www.opensource.org/licenses/mit-license.php.*
+ **********************************************************************/
+
+#ifndef SECP256K1_MODULE_STEALTH_TESTS
+#define SECP256K1_MODULE_STEALTH_TESTS
+
+#include <string.h>
+
+#include "testrand.h"
+#include "util.h"
+
+#include "include/secp256k1_stealth.h"
+
+#define STEALTH_TEST_MAX_OUTPUTS 16
+
+static void test_stealth_random_pubkey(unsigned char *out33) {
+    unsigned char key[32];
+    secp256k1_pubkey2 pub;
+    size_t len = 33;
+    secp256k1_scalar s;
+    random_scalar_order_test(&s);
+    secp256k1_scalar_get_b32(key, &s);
+    CHECK(secp256k1_ec_pubkey_create2(ctx, &pub, key));
+    CHECK(secp256k1_ec_pubkey_serialize2(ctx, out33, &len, &pub, SECP256K1_EC_COMPRESSED));
+}
+
+/* The destination one output at a time through the public key API */
+static void test_stealth_destination_reference(unsigned char *out33, const unsigned char *view, const unsigned char *spend_pubkey33, const unsigned char *tx_pubkey33) {
+    secp256k1_pubkey2 ar, dest;
+    unsigned char ar33[33];
+    unsigned char hs[32];
+    size_t len = 33;
+    secp256k1_sha256 sha;
+
+    CHECK(secp256k1_ec_pubkey_parse2(ctx, &ar, tx_pubkey33, 33));
+    CHECK(secp256k1_ec_pubkey_tweak_mul2(ctx, &ar, view));
+    CHECK(secp256k1_ec_pubkey_serialize2(ctx, ar33, &len, &ar, SECP256K1_EC_COMPRESSED));
+    secp256k1_sha256_initialize(&sha);
+    secp256k1_sha256_write(&sha, ar33, 33);
+    secp256k1_sha256_finalize(&sha, hs);
+    secp256k1_sha256_initialize(&sha);
+    secp256k1_sha256_write(&sha, hs, 32);
+    secp256k1_sha256_finalize(&sha, hs);
+    CHECK(secp256k1_ec_pubkey_parse2(ctx, &dest, spend_pubkey33, 33));
+    CHECK(secp256k1_ec_pubkey_tweak_add2(ctx, &dest, hs));
+    CHECK(secp256k1_ec_pubkey_serialize2(ctx, out33, &len, &dest, SECP256K1_EC_COMPRESSED));
+}
+
+static void test_stealth_destinations(size_t n) {
+    unsigned char view[32];
+    unsigned char spend33[33];
+    unsigned char tx_pubkeys[STEALTH_TEST_MAX_OUTPUTS * 33];
+    unsigned char destinations[STEALTH_TEST_MAX_OUTPUTS * 33];
+    unsigned char expected[33];
+    unsigned char zero[33];
+    secp256k1_scalar s;
+    size_t k, bad;
+
+    random_scalar_order_test(&s);
+    secp256k1_scalar_get_b32(view, &s);
+    test_stealth_random_pubkey(spend33);
+    for (k = 0; k < n; k++) {
+        test_stealth_random_pubkey(&tx_pubkeys[33 * k]);
+    }
+
+    CHECK(secp256k1_stealth_destinations(ctx, destinations, view, spend33, tx_pubkeys, n) == 1);
+    for (k = 0; k < n; k++) {
+        test_stealth_destination_reference(expected, view, spend33, &tx_pubkeys[33 * k]);
+        CHECK(memcmp(&destinations[33 * k], expected, 33) == 0);
+    }
+
+    /* A transaction public key that does not parse only affects its own entry */
+    memset(zero, 0, 33);
+    bad = secp256k1_rand_int(n);
+    tx_pubkeys[33 * bad] = 0x05;
+    CHECK(secp256k1_stealth_destinations(ctx, destinations, view, spend33, tx_pubkeys, n) == 1);
+    for (k = 0; k < n; k++) {
+        if (k == bad) {
+            CHECK(memcmp(&destinations[33 * k], zero, 33) == 0);
+        } else {
+            test_stealth_destination_reference(expected, view, spend33, &tx_pubkeys[33 * k]);
+            CHECK(memcmp(&destinations[33 * k], expected, 33) == 0);
+        }
+    }
+}
+
+static void test_stealth_api(void) {
+    unsigned char view[32];
+    unsigned char spend33[33];
+    unsigned char tx_pubkey33[33];
+    unsigned char destination[33];
+
+    memset(view, 0, 32);
+    view[31] = 1;
+    test_stealth_random_pubkey(spend33);
+    test_stealth_random_pubkey(tx_pubkey33);
+    CHECK(secp256k1_stealth_destinations(ctx, destination, view, spend33, tx_pubkey33, 1) == 1);
+    CHECK(secp256k1_stealth_destinations(ctx, destination, view, spend33, tx_pubkey33, 0) == 1);
+
+    /* Zero and out-of-range view keys */
+    memset(view, 0, 32);
+    CHECK(secp256k1_stealth_destinations(ctx, destination, view, spend33, tx_pubkey33, 1) == 0);
+    memset(view, 0xff, 32);
+    CHECK(secp256k1_stealth_destinations(ctx, destination, view, spend33, tx_pubkey33, 1) == 0);
+
+    /* Invalid spend key */
+    view[0] = 1;
+    spend33[0] = 0x05;
+    CHECK(secp256k1_stealth_destinations(ctx, destination, view, spend33, tx_pubkey33, 1) == 0);
+}
+
+void run_stealth_tests(void) {
+    int i;
+    test_stealth_api();
+    for (i = 0; i < count; i++) {
+        test_stealth_destinations(1);
+        test_stealth_destinations(2);
+        test_stealth_destinations(STEALTH_TEST_MAX_OUTPUTS);
+    }
+}
+
+#undef STEALTH_TEST_MAX_OUTPUTS
+
+#endif /* SECP256K1_MODULE_STEALTH_TESTS */
@@ -640,6 +640,14 @@ int secp256k1_ec_pubkey_combine2(const secp256k1_context2* ctx, secp256k1_pubkey
 # include "modules/bulletproofs/main_impl.h"
 #endif
 
+#ifdef ENABLE_MODULE_MLSAG
+# include "modules/mlsag/main_impl.h"
+#endif
+
+#ifdef ENABLE_MODULE_STEALTH
+# include "modules/stealth/main_impl.h"
+#endif
+
 #ifdef ENABLE_MODULE_WHITELIST
 # include "modules/whitelist/main_impl.h"
 #endif
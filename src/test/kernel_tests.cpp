@@ -0,0 +1,126 @@
+// Copyright (c) 2020-2022 The PRivaCY Coin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "kernel.h"
+#include "test/test_prcycoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+// Stake input with a fixed modifier and uniqueness, so that the kernel hashes can be recomputed
+class CTestStakeInput : public CStakeInput
+{
+public:
+    CTestStakeInput(uint64_t nModifierIn, uint32_t nIdIn, CAmount nValueIn) : nModifier(nModifierIn), nId(nIdIn), nValue(nValueIn)
+    {
+        pindexFrom = nullptr;
+    }
+
+    CBlockIndex* GetIndexFrom() override { return pindexFrom; }
+    bool CreateTxIn(CWallet* pwallet, CTxIn& txIn, uint256 hashTxOut = 0) override { return false; }
+    bool GetTxFrom(CTransaction& tx) override { return false; }
+    CAmount GetValue() override { return nValue; }
+    bool CreateTxOuts(CWallet* pwallet, std::vector<CTxOut>& vout, CAmount nTotal) override { return false; }
+    bool GetModifier(uint64_t& nStakeModifier) override
+    {
+        nStakeModifier = nModifier;
+        return true;
+    }
+    CDataStream GetUniqueness() override
+    {
+        CDataStream ss(SER_NETWORK, 0);
+        ss << nId;
+        return ss;
+    }
+
+private:
+    uint64_t nModifier;
+    uint32_t nId;
+    CAmount nValue;
+};
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, TestingSetup)
+
+// The first timestamp and input CheckStake accepts within the drift window, in the order CKernelSearch tries them
+static bool FindKernelWithCheckStake(std::vector<CTestStakeInput>& vInputs, const std::vector<bool>& vActive, unsigned int nBits,
+                                     unsigned int nTimeBlockFrom, unsigned int nTimeTx, unsigned int nTimeMin,
+                                     size_t& nInputFound, unsigned int& nTimeFound, uint256& hashFound)
+{
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+    for (unsigned int nTryTime = nTimeTx + 1; nTryTime <= nTimeTx + STAKE_HASH_DRIFT; nTryTime++) {
+        if (nTryTime <= nTimeMin)
+            continue;
+        for (size_t i = 0; i < vInputs.size(); i++) {
+            if (!vActive[i])
+                continue;
+            uint64_t nModifier = 0;
+            vInputs[i].GetModifier(nModifier);
+            unsigned int nTime = nTryTime;
+            uint256 hash;
+            if (CheckStake(vInputs[i].GetUniqueness(), vInputs[i].GetValue(), nModifier, bnTargetPerCoinDay, nTimeBlockFrom, nTime, hash)) {
+                nInputFound = i;
+                nTimeFound = nTryTime;
+                hashFound = hash;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(kernel_search_matches_checkstake)
+{
+    const unsigned int nTimeTx = 1600000000;
+    const unsigned int nTimeBlockFrom = nTimeTx - Params().StakeMinAge() - 3600;
+    // a hit roughly every 32 tries for these values, and none at all for the last one
+    const unsigned int vBits[] = {0x1c200000, 0x1c080000, 0x03000001};
+    const unsigned int vTimeMin[] = {0, nTimeTx + STAKE_HASH_DRIFT / 2};
+
+    for (unsigned int nBits : vBits) {
+        for (unsigned int nTimeMin : vTimeMin) {
+            std::vector<CTestStakeInput> vInputs;
+            for (uint32_t i = 0; i < 4; i++)
+                vInputs.emplace_back(0x1234567890abcdefULL + i * 7919, i, (i + 1) * 1000 * COIN);
+            std::vector<bool> vActive(vInputs.size(), true);
+
+            CKernelSearch search(nTimeTx);
+            for (CTestStakeInput& input : vInputs)
+                BOOST_CHECK(search.AddInput(&input, nTimeBlockFrom));
+
+            // Removing the input that was found must move the search to the next kernel CheckStake accepts
+            for (size_t nRound = 0; nRound < vInputs.size(); nRound++) {
+                size_t nExpectedInput = 0;
+                unsigned int nExpectedTime = 0;
+                uint256 hashExpected;
+                bool fExpected = FindKernelWithCheckStake(vInputs, vActive, nBits, nTimeBlockFrom, nTimeTx, nTimeMin,
+                                                          nExpectedInput, nExpectedTime, hashExpected);
+
+                CStakeInput* stakeFound = nullptr;
+                unsigned int nTimeFound = 0;
+                uint256 hashFound;
+                bool fFound = search.Search(nBits, nTimeMin, stakeFound, nTimeFound, hashFound);
+                BOOST_CHECK_EQUAL(fFound, fExpected);
+                if (!fFound || !fExpected)
+                    break;
+                BOOST_CHECK(stakeFound == &vInputs[nExpectedInput]);
+                BOOST_CHECK_EQUAL(nTimeFound, nExpectedTime);
+                BOOST_CHECK(hashFound == hashExpected);
+
+                search.RemoveInput(stakeFound);
+                vActive[nExpectedInput] = false;
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(kernel_search_skips_young_inputs)
+{
+    const unsigned int nTimeTx = 1600000000;
+    CTestStakeInput input(1, 0, 1000 * COIN);
+    CKernelSearch search(nTimeTx);
+    BOOST_CHECK(!search.AddInput(&input, nTimeTx - Params().StakeMinAge() + 1));
+    BOOST_CHECK_EQUAL(search.size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
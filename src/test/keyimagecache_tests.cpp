@@ -0,0 +1,119 @@
+// Copyright (c) 2020-2022 The PRivaCY Coin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "keyimagecache.h"
+#include "txdb.h"
+#include "test/test_prcycoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(keyimagecache_tests, TestingSetup)
+
+static CKeyImage MakeKeyImage()
+{
+    CKey key;
+    key.MakeNewKey(true);
+    return key.GetPubKey();
+}
+
+// Write the dirty entries of cache to db, as FlushStateToDisk does
+static void Flush(CKeyImageCache& cache, CBlockTreeDB& db)
+{
+    std::vector<std::pair<CKeyImage, std::vector<uint256> > > vKeyImages;
+    cache.GetDirty(vKeyImages);
+    BOOST_CHECK(db.WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, std::vector<const CBlockIndex*>(),
+        vKeyImages, std::vector<std::pair<COutPoint, CDiskRingMember> >()));
+}
+
+BOOST_AUTO_TEST_CASE(keyimage_cache_connect_disconnect)
+{
+    CBlockTreeDB db(1 << 20, true);
+    CKeyImageCache cache(&db);
+    const CKeyImage keyImage = MakeKeyImage();
+    const uint256 hashBlockA = GetRandHash();
+    const uint256 hashBlockB = GetRandHash();
+    std::vector<uint256> bhs;
+
+    // Misses are cached too
+    BOOST_CHECK(!cache.GetSpends(keyImage, bhs));
+    BOOST_CHECK(bhs.empty());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+
+    // Connecting a block twice records it once
+    cache.AddSpend(keyImage, hashBlockA);
+    cache.AddSpend(keyImage, hashBlockA);
+    BOOST_CHECK(cache.GetSpends(keyImage, bhs));
+    BOOST_CHECK(bhs == std::vector<uint256>(1, hashBlockA));
+
+    // Disconnecting an unrelated block leaves the spend, disconnecting the spending block undoes it
+    cache.RemoveSpend(keyImage, hashBlockB);
+    BOOST_CHECK(cache.GetSpends(keyImage, bhs));
+    cache.RemoveSpend(keyImage, hashBlockA);
+    BOOST_CHECK(!cache.GetSpends(keyImage, bhs));
+
+    // Reconnecting it on one branch and spending again on another keeps both blocks
+    cache.AddSpend(keyImage, hashBlockA);
+    cache.AddSpend(keyImage, hashBlockB);
+    BOOST_CHECK(cache.GetSpends(keyImage, bhs));
+    BOOST_CHECK_EQUAL(bhs.size(), 2U);
+    BOOST_CHECK(bhs[0] == hashBlockA && bhs[1] == hashBlockB);
+
+    // Nothing reached the database
+    BOOST_CHECK(!db.ReadKeyImages(keyImage, bhs));
+}
+
+BOOST_AUTO_TEST_CASE(keyimage_cache_flush)
+{
+    CBlockTreeDB db(1 << 20, true);
+    CKeyImageCache cache(&db);
+    const CKeyImage keyImageSpent = MakeKeyImage();
+    const CKeyImage keyImageUnspent = MakeKeyImage();
+    const uint256 hashBlock = GetRandHash();
+    std::vector<uint256> bhs;
+
+    cache.AddSpend(keyImageSpent, hashBlock);
+    BOOST_CHECK(!cache.GetSpends(keyImageUnspent, bhs));
+
+    // Dirty entries are not dropped before they are written
+    const size_t nUsage = cache.DynamicMemoryUsage();
+    cache.Uncache();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+    BOOST_CHECK(cache.GetSpends(keyImageSpent, bhs));
+
+    // Only the spent key image is written, and only once
+    std::vector<std::pair<CKeyImage, std::vector<uint256> > > vDirty;
+    cache.GetDirty(vDirty);
+    BOOST_CHECK_EQUAL(vDirty.size(), 1U);
+    BOOST_CHECK(vDirty[0].first == keyImageSpent);
+    BOOST_CHECK(vDirty[0].second == std::vector<uint256>(1, hashBlock));
+    BOOST_CHECK(db.WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, std::vector<const CBlockIndex*>(),
+        vDirty, std::vector<std::pair<COutPoint, CDiskRingMember> >()));
+    vDirty.clear();
+    cache.GetDirty(vDirty);
+    BOOST_CHECK(vDirty.empty());
+
+    // Once written, the entry can be dropped and read back
+    cache.Uncache();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK(cache.DynamicMemoryUsage() < nUsage);
+    BOOST_CHECK(cache.GetSpends(keyImageSpent, bhs));
+    BOOST_CHECK(bhs == std::vector<uint256>(1, hashBlock));
+
+    // A spend disconnected after the flush erases the record at the next one
+    cache.RemoveSpend(keyImageSpent, hashBlock);
+    BOOST_CHECK(db.ReadKeyImages(keyImageSpent, bhs));
+    Flush(cache, db);
+    BOOST_CHECK(!db.ReadKeyImages(keyImageSpent, bhs));
+
+    // And reconnecting it writes it again
+    cache.AddSpend(keyImageSpent, hashBlock);
+    Flush(cache, db);
+    cache.Uncache();
+    CKeyImageCache cacheReloaded(&db);
+    BOOST_CHECK(cacheReloaded.GetSpends(keyImageSpent, bhs));
+    BOOST_CHECK(bhs == std::vector<uint256>(1, hashBlock));
+    BOOST_CHECK(!cacheReloaded.GetSpends(keyImageUnspent, bhs));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,57 @@
+// Copyright (c) 2020-2022 The PRivaCY Coin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "lrucache.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(lrucache_tests)
+
+BOOST_AUTO_TEST_CASE(lrucache_evicts_least_recently_used)
+{
+    lru_cache<int, int> cache(3);
+    int v;
+
+    cache.insert(1, 10);
+    cache.insert(2, 20);
+    cache.insert(3, 30);
+    BOOST_CHECK_EQUAL(cache.size(), 3U);
+
+    // touching 1 makes 2 the least recently used entry
+    BOOST_CHECK(cache.get(1, v));
+    BOOST_CHECK_EQUAL(v, 10);
+    cache.insert(4, 40);
+    BOOST_CHECK_EQUAL(cache.size(), 3U);
+    BOOST_CHECK(!cache.get(2, v));
+    BOOST_CHECK(cache.get(1, v));
+    BOOST_CHECK(cache.get(3, v));
+    BOOST_CHECK(cache.get(4, v));
+}
+
+BOOST_AUTO_TEST_CASE(lrucache_update_and_erase)
+{
+    lru_cache<int, int> cache(2);
+    int v;
+
+    cache.insert(1, 10);
+    cache.insert(2, 20);
+    // overwriting an entry refreshes it instead of growing the cache
+    cache.insert(1, 11);
+    BOOST_CHECK_EQUAL(cache.size(), 2U);
+    cache.insert(3, 30);
+    BOOST_CHECK(!cache.get(2, v));
+    BOOST_CHECK(cache.get(1, v));
+    BOOST_CHECK_EQUAL(v, 11);
+
+    cache.erase(1);
+    BOOST_CHECK(!cache.get(1, v));
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+    cache.erase(1);
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+
+    cache.clear();
+    BOOST_CHECK(cache.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
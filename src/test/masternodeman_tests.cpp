@@ -0,0 +1,315 @@
+// Copyright (c) 2020-2022 The PRivaCY Coin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-payments.h"
+#include "masternodeman.h"
+#include "script/standard.h"
+#include "test/test_prcycoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(masternodeman_tests, TestingSetup)
+
+// An enabled masternode with a recent ping, whose collateral is not looked up
+static CMasternode MakeMasternode()
+{
+    CMasternode mn;
+    mn.vin = CTxIn(COutPoint(GetRandHash(), 0));
+    CKey key;
+    key.MakeNewKey(true);
+    mn.pubKeyCollateralAddress = key.GetPubKey();
+    key.MakeNewKey(true);
+    mn.pubKeyMasternode = key.GetPubKey();
+    mn.unitTest = true;
+    mn.lastPing.vin = mn.vin;
+    mn.lastPing.blockHash = GetRandHash();
+    mn.lastPing.sigTime = GetAdjustedTime();
+    return mn;
+}
+
+static CScript PayeeOf(const CMasternode& mn)
+{
+    return GetScriptForDestination(mn.pubKeyCollateralAddress);
+}
+
+// All three lookups find the entry of mn, or none of them does
+static void CheckIndexed(CMasternodeMan& man, const CMasternode& mn, bool fIndexed)
+{
+    CMasternode* pmn = man.Find(mn.vin);
+    BOOST_CHECK_EQUAL(pmn != NULL, fIndexed);
+    if (pmn)
+        BOOST_CHECK(pmn->vin == mn.vin);
+    CPubKey pubKeyMasternode = mn.pubKeyMasternode;
+    BOOST_CHECK(man.Find(pubKeyMasternode) == pmn);
+    BOOST_CHECK(man.Find(PayeeOf(mn)) == pmn);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_indexes_follow_add_and_remove)
+{
+    CMasternodeMan man;
+    std::vector<CMasternode> vMasternodes;
+    for (int i = 0; i < 5; i++) {
+        vMasternodes.push_back(MakeMasternode());
+        BOOST_CHECK(man.Add(vMasternodes.back()));
+    }
+    BOOST_CHECK(!man.Add(vMasternodes[0]));
+    BOOST_CHECK_EQUAL(man.size(), 5);
+    for (const CMasternode& mn : vMasternodes)
+        CheckIndexed(man, mn, true);
+
+    man.Remove(vMasternodes[1].vin);
+    BOOST_CHECK_EQUAL(man.size(), 4);
+    CheckIndexed(man, vMasternodes[1], false);
+    for (size_t i = 0; i < vMasternodes.size(); i++) {
+        if (i != 1)
+            CheckIndexed(man, vMasternodes[i], true);
+    }
+
+    // A new masternode key replaces the old one in the index
+    CMasternode* pmn = man.Find(vMasternodes[2].vin);
+    BOOST_CHECK(pmn);
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubKeyOld = pmn->pubKeyMasternode;
+    pmn->pubKeyMasternode = key.GetPubKey();
+    man.UpdateIndexes(pmn->vin);
+    CPubKey pubKeyNew = key.GetPubKey();
+    BOOST_CHECK(man.Find(pubKeyNew) == pmn);
+    BOOST_CHECK(man.Find(pubKeyOld) == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_indexes_follow_check_and_remove)
+{
+    CMasternodeMan man;
+    std::vector<CMasternode> vMasternodes;
+    for (int i = 0; i < 4; i++) {
+        vMasternodes.push_back(MakeMasternode());
+        BOOST_CHECK(man.Add(vMasternodes.back()));
+    }
+
+    // Masternodes that stopped pinging are removed by the next check
+    man.Find(vMasternodes[0].vin)->lastPing = CMasternodePing();
+    man.Find(vMasternodes[3].vin)->lastPing = CMasternodePing();
+    man.CheckAndRemove();
+    BOOST_CHECK_EQUAL(man.size(), 2);
+    CheckIndexed(man, vMasternodes[0], false);
+    CheckIndexed(man, vMasternodes[1], true);
+    CheckIndexed(man, vMasternodes[2], true);
+    CheckIndexed(man, vMasternodes[3], false);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_indexes_after_cache_load)
+{
+    std::vector<CMasternode> vMasternodes;
+    for (int i = 0; i < 3; i++)
+        vMasternodes.push_back(MakeMasternode());
+    // A second entry for the collateral of the first one, with other keys
+    CMasternode mnDuplicate = MakeMasternode();
+    mnDuplicate.vin = vMasternodes[0].vin;
+    vMasternodes.push_back(mnDuplicate);
+
+    // The layout of mncache.dat
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << vMasternodes << std::map<CNetAddr, int64_t>() << std::map<CNetAddr, int64_t>() << std::map<COutPoint, int64_t>();
+    ss << (int64_t)0 << std::map<uint256, CMasternodeBroadcast>() << std::map<uint256, CMasternodePing>();
+
+    CMasternodeMan man;
+    ss >> man;
+    BOOST_CHECK_EQUAL(man.size(), 3);
+    for (int i = 0; i < 3; i++)
+        CheckIndexed(man, vMasternodes[i], true);
+    CPubKey pubKeyDuplicate = mnDuplicate.pubKeyMasternode;
+    BOOST_CHECK(man.Find(pubKeyDuplicate) == NULL);
+    BOOST_CHECK(man.Find(PayeeOf(mnDuplicate)) == NULL);
+
+    // Removing the collateral leaves nothing behind
+    man.Remove(vMasternodes[0].vin);
+    BOOST_CHECK_EQUAL(man.size(), 2);
+    CheckIndexed(man, vMasternodes[0], false);
+
+    // And the list is written back without the duplicate
+    CDataStream ssOut(SER_DISK, CLIENT_VERSION);
+    ssOut << man;
+    std::vector<CMasternode> vWritten;
+    ssOut >> vWritten;
+    BOOST_CHECK_EQUAL(vWritten.size(), 2U);
+}
+
+// The collateral outpoints of vMasternodes, given in list order, by descending score at hashBlock
+static std::vector<COutPoint> RankByScore(const std::vector<CMasternode>& vMasternodes, const uint256& hashBlock)
+{
+    std::vector<std::pair<int64_t, COutPoint> > vScores;
+    for (const CMasternode& mn : vMasternodes)
+        vScores.push_back(std::make_pair(mn.CalculateScore(hashBlock).GetCompact(false), mn.vin.prevout));
+    std::stable_sort(vScores.begin(), vScores.end(),
+        [](const std::pair<int64_t, COutPoint>& a, const std::pair<int64_t, COutPoint>& b) { return a.first > b.first; });
+    std::vector<COutPoint> vRanked;
+    for (const std::pair<int64_t, COutPoint>& score : vScores)
+        vRanked.push_back(score.second);
+    return vRanked;
+}
+
+// The cached scores must rank the masternodes as recomputing them does
+static void CheckRanks(CMasternodeMan& man, const std::vector<CMasternode>& vMasternodes, int64_t nBlockHeight, const uint256& hashBlock)
+{
+    const std::vector<COutPoint> vRanked = RankByScore(vMasternodes, hashBlock);
+    for (size_t i = 0; i < vRanked.size(); i++) {
+        BOOST_CHECK_EQUAL(man.GetMasternodeRank(CTxIn(vRanked[i]), nBlockHeight, 0, false), (int)i + 1);
+        CMasternode* pmn = man.GetMasternodeByRank(i + 1, nBlockHeight, 0, false);
+        BOOST_CHECK(pmn && pmn->vin.prevout == vRanked[i]);
+    }
+    BOOST_CHECK(man.GetMasternodeByRank(vRanked.size() + 1, nBlockHeight, 0, false) == NULL);
+
+    std::vector<std::pair<int, CMasternode> > vRanks = man.GetMasternodeRanks(nBlockHeight, 0);
+    BOOST_CHECK_EQUAL(vRanks.size(), vRanked.size());
+    for (size_t i = 0; i < vRanks.size() && i < vRanked.size(); i++)
+        BOOST_CHECK(vRanks[i].second.vin.prevout == vRanked[i]);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_scores_match_recomputed_ranks)
+{
+    const int64_t nHeightA = 1000;
+    const int64_t nHeightB = 1001;
+    mapCacheBlockHashes[nHeightA] = GetRandHash();
+    mapCacheBlockHashes[nHeightB] = GetRandHash();
+
+    CMasternodeMan man;
+    std::vector<CMasternode> vMasternodes;
+    for (int i = 0; i < 8; i++) {
+        vMasternodes.push_back(MakeMasternode());
+        BOOST_CHECK(man.Add(vMasternodes.back()));
+    }
+    CheckRanks(man, vMasternodes, nHeightA, mapCacheBlockHashes[nHeightA]);
+    CheckRanks(man, vMasternodes, nHeightB, mapCacheBlockHashes[nHeightB]);
+
+    // Adding and removing masternodes invalidates the scores of every height
+    vMasternodes.push_back(MakeMasternode());
+    BOOST_CHECK(man.Add(vMasternodes.back()));
+    CheckRanks(man, vMasternodes, nHeightA, mapCacheBlockHashes[nHeightA]);
+    man.Remove(vMasternodes[3].vin);
+    vMasternodes.erase(vMasternodes.begin() + 3);
+    CheckRanks(man, vMasternodes, nHeightA, mapCacheBlockHashes[nHeightA]);
+    CheckRanks(man, vMasternodes, nHeightB, mapCacheBlockHashes[nHeightB]);
+
+    // A different block at a ranked height is scored again
+    mapCacheBlockHashes[nHeightA] = GetRandHash();
+    CheckRanks(man, vMasternodes, nHeightA, mapCacheBlockHashes[nHeightA]);
+
+    mapCacheBlockHashes.erase(nHeightA);
+    mapCacheBlockHashes.erase(nHeightB);
+}
+
+// The last paid time of mn found by walking back through the voted blocks of the active chain
+static int64_t WalkLastPaid(const CMasternode& mn, int nMnCount)
+{
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << mn.vin;
+    ss << mn.sigTime;
+    const int64_t nOffset = ss.GetHash().GetCompact(false) % 150;
+
+    LOCK(cs_main);
+    int n = 0;
+    for (const CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->nHeight > 0; pindex = pindex->pprev) {
+        if (n++ >= nMnCount) return 0;
+        std::map<int, CMasternodeBlockPayees>::iterator it = masternodePayments.mapMasternodeBlocks.find(pindex->nHeight);
+        if (it != masternodePayments.mapMasternodeBlocks.end() && it->second.HasPayeeWithVotes(mn.vin.masternodeStealthAddress, 2))
+            return pindex->nTime + nOffset;
+    }
+    return 0;
+}
+
+// nVotes distinct masternodes vote for payee at nBlockHeight
+static void AddVotes(const std::vector<unsigned char>& payee, int nBlockHeight, int nVotes)
+{
+    for (int i = 0; i < nVotes; i++) {
+        CTxIn vinVoter(COutPoint(GetRandHash(), 0));
+        vinVoter.masternodeStealthAddress = payee;
+        CMasternodePaymentWinner winner(vinVoter);
+        winner.nBlockHeight = nBlockHeight;
+        BOOST_CHECK(masternodePayments.AddWinningMasternode(winner));
+    }
+}
+
+static void CheckLastPaid(const std::vector<CMasternode>& vMasternodes)
+{
+    const int vMnCounts[] = {1, 5, 17, 100, 999, 1400, 2000};
+    for (CMasternode mn : vMasternodes) {
+        for (int nMnCount : vMnCounts)
+            BOOST_CHECK_EQUAL(mn.GetLastPaid(nMnCount), WalkLastPaid(mn, nMnCount));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(masternode_last_paid_matches_block_walk)
+{
+    // A chain of nBlocks blocks on top of the genesis block
+    const int nBlocks = 1500;
+    CBlockIndex* pindexGenesis = WITH_LOCK(cs_main, return chainActive.Genesis());
+    std::vector<uint256> vHashes(nBlocks);
+    std::vector<CBlockIndex> vIndex(nBlocks);
+    {
+        LOCK(cs_main);
+        for (int i = 0; i < nBlocks; i++) {
+            vHashes[i] = GetRandHash();
+            CBlockIndex& index = vIndex[i];
+            index.phashBlock = &vHashes[i];
+            index.pprev = i ? &vIndex[i - 1] : pindexGenesis;
+            index.nHeight = i + 1;
+            index.nTime = pindexGenesis->nTime + 60 * (i + 1);
+            index.BuildSkip();
+            mapBlockIndex[vHashes[i]] = &index;
+        }
+        chainActive.SetTip(&vIndex.back());
+    }
+
+    std::vector<CMasternode> vMasternodes;
+    for (int i = 0; i < 4; i++) {
+        vMasternodes.push_back(MakeMasternode());
+        vMasternodes.back().vin.masternodeStealthAddress = ToByteVector(GetRandHash());
+    }
+
+    // Every fifth block has a payee with zero to two votes, and a runner-up with a single vote.
+    // The last masternode was only voted for early in the chain.
+    for (int nHeight = 105; nHeight <= nBlocks; nHeight += 5) {
+        const CMasternode& mn = vMasternodes[nHeight % 4];
+        if (nHeight % 4 == 3 && nHeight >= 400) continue;
+        AddVotes(mn.vin.masternodeStealthAddress, nHeight, nHeight % 3);
+        AddVotes(vMasternodes[(nHeight + 1) % 4].vin.masternodeStealthAddress, nHeight, 1);
+    }
+    BOOST_CHECK(vMasternodes[0].GetLastPaid(100) != 0);
+    CheckLastPaid(vMasternodes);
+
+    // The index is rebuilt when mnpayments.dat is loaded
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << masternodePayments;
+    CMasternodePayments paymentsLoaded;
+    ss >> paymentsLoaded;
+    for (const CMasternode& mn : vMasternodes) {
+        for (int nMinHeight = 1; nMinHeight <= nBlocks; nMinHeight += 97) {
+            const std::vector<unsigned char>& payee = mn.vin.masternodeStealthAddress;
+            BOOST_CHECK_EQUAL(paymentsLoaded.GetLastVotedHeight(payee, nMinHeight, nBlocks),
+                masternodePayments.GetLastVotedHeight(payee, nMinHeight, nBlocks));
+            BOOST_CHECK_EQUAL(paymentsLoaded.GetLastVotedHeight(payee, 1, nMinHeight),
+                masternodePayments.GetLastVotedHeight(payee, 1, nMinHeight));
+        }
+    }
+
+    // Cleaning the payment list drops the votes more than 1000 blocks behind the tip from the index
+    BOOST_CHECK(masternodePayments.GetLastVotedHeight(vMasternodes[3].vin.masternodeStealthAddress, 1, nBlocks) > 0);
+    masternodePayments.CleanPaymentList();
+    BOOST_CHECK(masternodePayments.mapMasternodeBlocks.begin()->first >= nBlocks - 1000);
+    BOOST_CHECK_EQUAL(masternodePayments.GetLastVotedHeight(vMasternodes[3].vin.masternodeStealthAddress, 1, nBlocks), -1);
+    CheckLastPaid(vMasternodes);
+
+    masternodePayments.Clear();
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(pindexGenesis);
+        for (int i = 0; i < nBlocks; i++) {
+            mapBlockIndex.erase(vHashes[i]);
+            mapCacheBlockHashes.erase(i + 1);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
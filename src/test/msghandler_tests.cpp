@@ -0,0 +1,156 @@
+// Copyright (c) 2020-2022 The PRivaCY Coin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net.h"
+#include "sync.h"
+#include "utiltime.h"
+
+#include "test/test_prcycoin.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(msghandler_tests, BasicTestingSetup)
+
+// Records, per peer, the order in which the message handler threads processed its queued messages
+static Mutex cs_handledMessages;
+static std::map<NodeId, std::vector<int64_t> > mapHandledMessages;
+static std::set<NodeId> setNodesInProcess;
+static bool fConcurrentPeerProcessing = false;
+
+static bool ProcessQueuedTestMessage(CNode* pnode)
+{
+    if (pnode->vRecvMsg.empty())
+        return true;
+    {
+        LOCK(cs_handledMessages);
+        if (!setNodesInProcess.insert(pnode->id).second)
+            fConcurrentPeerProcessing = true;
+    }
+    // give another thread the chance to pick the same peer
+    MilliSleep(1);
+    {
+        LOCK(cs_handledMessages);
+        mapHandledMessages[pnode->id].push_back(pnode->vRecvMsg.front().nTime);
+        setNodesInProcess.erase(pnode->id);
+    }
+    pnode->vRecvMsg.pop_front();
+    return true;
+}
+
+// Waits until another peer is being processed as well, or gives up after a second
+static size_t nMaxNodesInProcess = 0;
+
+static bool ProcessOverlappingTestMessage(CNode* pnode)
+{
+    if (pnode->vRecvMsg.empty())
+        return true;
+    {
+        LOCK(cs_handledMessages);
+        setNodesInProcess.insert(pnode->id);
+        nMaxNodesInProcess = std::max(nMaxNodesInProcess, setNodesInProcess.size());
+    }
+    for (int nWait = 0; nWait < 100; nWait++) {
+        {
+            LOCK(cs_handledMessages);
+            if (nMaxNodesInProcess > 1)
+                break;
+        }
+        MilliSleep(10);
+    }
+    {
+        LOCK(cs_handledMessages);
+        setNodesInProcess.erase(pnode->id);
+    }
+    pnode->vRecvMsg.pop_front();
+    return true;
+}
+
+static std::vector<CNode*> AddTestNodes(int nPeers, int nMessages)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+
+    std::vector<CNode*> vTestNodes;
+    for (int i = 0; i < nPeers; i++) {
+        CNode* pnode = new CNode(INVALID_SOCKET, addr, "", true);
+        pnode->AddRef();
+        for (int j = 0; j < nMessages; j++) {
+            // an empty, complete message carrying its position in the queue
+            CNetMessage msg(SER_NETWORK, PROTOCOL_VERSION);
+            msg.in_data = true;
+            msg.hdr.nMessageSize = 0;
+            msg.nTime = j;
+            pnode->vRecvMsg.push_back(msg);
+        }
+        vTestNodes.push_back(pnode);
+    }
+    LOCK(cs_vNodes);
+    vNodes.insert(vNodes.end(), vTestNodes.begin(), vTestNodes.end());
+    return vTestNodes;
+}
+
+// Runs four message handler threads until the queues of vTestNodes are empty
+static void RunMessageHandlers(const std::vector<CNode*>& vTestNodes, bool (*ProcessTestMessages)(CNode*))
+{
+    boost::signals2::connection conn = GetNodeSignals().ProcessMessages.connect(ProcessTestMessages);
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++)
+        threads.create_thread(&ThreadMessageHandler);
+
+    for (int nWait = 0; nWait < 1000; nWait++) {
+        bool fDone = true;
+        for (CNode* pnode : vTestNodes) {
+            LOCK(pnode->cs_vRecvMsg);
+            fDone &= pnode->vRecvMsg.empty();
+        }
+        if (fDone)
+            break;
+        MilliSleep(10);
+    }
+    threads.interrupt_all();
+    threads.join_all();
+    conn.disconnect();
+
+    LOCK(cs_vNodes);
+    vNodes.clear();
+}
+
+BOOST_AUTO_TEST_CASE(message_handler_threads_keep_peer_order)
+{
+    const int nMessages = 20;
+    std::vector<CNode*> vTestNodes = AddTestNodes(8, nMessages);
+    RunMessageHandlers(vTestNodes, &ProcessQueuedTestMessage);
+
+    BOOST_CHECK(!fConcurrentPeerProcessing);
+    for (CNode* pnode : vTestNodes) {
+        const std::vector<int64_t>& vHandled = mapHandledMessages[pnode->id];
+        BOOST_CHECK_EQUAL(vHandled.size(), (size_t)nMessages);
+        for (size_t j = 0; j < vHandled.size(); j++)
+            BOOST_CHECK_EQUAL(vHandled[j], (int64_t)j);
+        pnode->Release();
+        delete pnode;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(message_handler_threads_process_peers_concurrently)
+{
+    // With a single handler thread the first peer would give up waiting before the second one is picked up
+    std::vector<CNode*> vTestNodes = AddTestNodes(2, 1);
+    RunMessageHandlers(vTestNodes, &ProcessOverlappingTestMessage);
+
+    BOOST_CHECK_EQUAL(nMaxNodesInProcess, (size_t)2);
+    for (CNode* pnode : vTestNodes) {
+        BOOST_CHECK(pnode->vRecvMsg.empty());
+        pnode->Release();
+        delete pnode;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
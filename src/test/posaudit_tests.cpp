@@ -0,0 +1,146 @@
+// Copyright (c) 2020-2022 The PRivaCY Coin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "main.h"
+#include "test/test_prcycoin.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+extern std::set<CBlockIndex*> setDirtyBlockIndex;
+extern CCheckQueue<CRingCTCheck> ringctcheckqueue;
+
+BOOST_FIXTURE_TEST_SUITE(posaudit_tests, TestingSetup)
+
+// The results of AuditPoSBlocks must be those of auditing the blocks one by one with IsPoSBlockAudited
+static void CheckAuditMatchesPerBlock(const std::vector<CBlockIndex*>& vIndex, const std::vector<bool>& vExpected)
+{
+    std::vector<bool> vAudited;
+    AuditPoSBlocks(vIndex, vAudited);
+    BOOST_CHECK_EQUAL(vAudited.size(), vIndex.size());
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        BOOST_CHECK_EQUAL(vAudited[i], vExpected[i]);
+        BOOST_CHECK_EQUAL(vAudited[i], IsPoSBlockAudited(vIndex[i]));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(audit_pos_blocks_matches_per_block_audit)
+{
+    CBlockIndex* pindexGenesis = WITH_LOCK(cs_main, return chainActive.Genesis());
+    BOOST_CHECK(pindexGenesis);
+
+    // A PoS block that was audited before, one whose data is not on disk, and one that is not PoS
+    const uint256 hashAudited = uint256S("0x01");
+    const uint256 hashMissing = uint256S("0x02");
+    CBlockIndex indexAudited;
+    indexAudited.phashBlock = &hashAudited;
+    indexAudited.pprev = pindexGenesis;
+    indexAudited.nHeight = 1;
+    indexAudited.SetProofOfStake();
+    indexAudited.nStatus |= BLOCK_POS_AUDITED;
+
+    CBlockIndex indexMissing;
+    indexMissing.phashBlock = &hashMissing;
+    indexMissing.pprev = pindexGenesis;
+    indexMissing.nHeight = 1;
+    indexMissing.SetProofOfStake();
+
+    std::vector<CBlockIndex*> vIndex = {&indexAudited, nullptr, &indexMissing, pindexGenesis, &indexAudited};
+    const int nScriptCheckThreadsPrev = nScriptCheckThreads;
+    const bool fReauditPoSPrev = fReauditPoS;
+
+    for (int nThreads : {0, 3}) {
+        nScriptCheckThreads = nThreads;
+        fReauditPoS = false;
+        CheckAuditMatchesPerBlock(vIndex, {true, false, false, false, true});
+
+        // -reauditpos ignores the recorded result, and this block can not be read back
+        fReauditPoS = true;
+        CheckAuditMatchesPerBlock(vIndex, {false, false, false, false, false});
+    }
+
+    nScriptCheckThreads = nScriptCheckThreadsPrev;
+    fReauditPoS = fReauditPoSPrev;
+
+    // A failed audit leaves the status alone
+    BOOST_CHECK(!(indexMissing.nStatus & BLOCK_POS_AUDITED));
+    BOOST_CHECK(indexAudited.nStatus & BLOCK_POS_AUDITED);
+
+    std::vector<bool> vAudited;
+    AuditPoSBlocks(std::vector<CBlockIndex*>(), vAudited);
+    BOOST_CHECK(vAudited.empty());
+}
+
+BOOST_AUTO_TEST_CASE(audit_skips_blocks_connected_with_full_checks)
+{
+    CBlockIndex* pindexGenesis = WITH_LOCK(cs_main, return chainActive.Genesis());
+    const bool fReauditPoSPrev = fReauditPoS;
+    fReauditPoS = false;
+
+    // Two PoS blocks whose data is not on disk, so an audit that reads them fails
+    const uint256 hashChecked = uint256S("0x01");
+    const uint256 hashUnchecked = uint256S("0x02");
+    CBlockIndex indexChecked;
+    indexChecked.phashBlock = &hashChecked;
+    indexChecked.pprev = pindexGenesis;
+    indexChecked.nHeight = 1;
+    indexChecked.SetProofOfStake();
+    CBlockIndex indexUnchecked = indexChecked;
+    indexUnchecked.phashBlock = &hashUnchecked;
+
+    {
+        LOCK(cs_main);
+        RecordPoSBlockChecks(&indexChecked, true);
+        RecordPoSBlockChecks(&indexUnchecked, false);
+        RecordPoSBlockChecks(pindexGenesis, true);
+    }
+    BOOST_CHECK(indexChecked.nStatus & BLOCK_POS_AUDITED);
+    BOOST_CHECK(!(indexUnchecked.nStatus & BLOCK_POS_AUDITED));
+    BOOST_CHECK(!(pindexGenesis->nStatus & BLOCK_POS_AUDITED));
+
+    // The auditor takes the recorded result of the block connected with full checks
+    // and audits the other one
+    CheckAuditMatchesPerBlock({&indexChecked, &indexUnchecked}, {true, false});
+
+    // Unless -reauditpos is set
+    fReauditPoS = true;
+    CheckAuditMatchesPerBlock({&indexChecked, &indexUnchecked}, {false, false});
+
+    fReauditPoS = fReauditPoSPrev;
+    WITH_LOCK(cs_main, setDirtyBlockIndex.erase(&indexChecked));
+}
+
+BOOST_AUTO_TEST_CASE(audit_runs_alongside_connect_block_checks)
+{
+    CBlockIndex* pindexGenesis = WITH_LOCK(cs_main, return chainActive.Genesis());
+    const int nScriptCheckThreadsPrev = nScriptCheckThreads;
+    nScriptCheckThreads = 3;
+
+    // The miner audits without cs_main, while ConnectBlock builds its RingCT control under cs_main
+    boost::thread auditThread([pindexGenesis] {
+        std::vector<bool> vAudited;
+        for (int i = 0; i < 1000; i++)
+            AuditPoSBlocks({pindexGenesis}, vAudited);
+    });
+    boost::thread connectThread([] {
+        for (int i = 0; i < 1000; i++) {
+            LOCK(cs_main);
+            CCheckQueueControl<CRingCTCheck> control(&ringctcheckqueue);
+            control.Wait();
+        }
+    });
+
+    const bool fAuditDone = auditThread.try_join_for(boost::chrono::seconds(60));
+    const bool fConnectDone = connectThread.try_join_for(boost::chrono::seconds(60));
+    if (!fAuditDone || !fConnectDone) {
+        auditThread.detach();
+        connectThread.detach();
+    }
+    BOOST_REQUIRE_MESSAGE(fAuditDone && fConnectDone, "AuditPoSBlocks and ConnectBlock deadlocked on the RingCT check queue");
+
+    nScriptCheckThreads = nScriptCheckThreadsPrev;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
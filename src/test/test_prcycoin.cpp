@@ -7,6 +7,7 @@
 
 #include "test_prcycoin.h"
 
+#include "keyimagecache.h"
 #include "main.h"
 #include "random.h"
 #include "script/sigcache.h"
@@ -52,6 +53,7 @@ TestingSetup::TestingSetup()
         fs::create_directories(pathTemp);
         mapArgs["-datadir"] = pathTemp.string();
         pblocktree = new CBlockTreeDB(1 << 20, true);
+        pkeyImageCache = new CKeyImageCache(pblocktree);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
         pcoinsTip = new CCoinsViewCache(pcoinsdbview);
         InitBlockIndex();
@@ -80,6 +82,7 @@ TestingSetup::~TestingSetup()
         UnloadBlockIndex();
         delete pcoinsTip;
         delete pcoinsdbview;
+        delete pkeyImageCache;
         delete pblocktree;
 #ifdef ENABLE_WALLET
         bitdb.Flush(true);
@@ -11,6 +11,9 @@
 #include "poa.h"
 #include "uint256.h"
 
+#include "utilstrencodings.h"
+
+#include <algorithm>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -25,7 +28,9 @@ static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 static const char DB_INT = 'I';
-static const char DB_KEYIMAGE = 'k';
+static const char DB_KEYIMAGE_OLD = 'k';
+static const char DB_KEYIMAGE = 'K';
+static const char DB_RINGMEMBER = 'r';
 
 
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
@@ -153,7 +158,9 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
     return true;
 }
 
-bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
+bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo,
+                                  const std::vector<std::pair<CKeyImage, std::vector<uint256> > >& keyImages,
+                                  const std::vector<std::pair<COutPoint, CDiskRingMember> >& ringMembers) {
     CDBBatch batch;
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
@@ -162,6 +169,15 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
+    for (const auto& entry : keyImages) {
+        if (entry.second.empty())
+            batch.Erase(std::make_pair(DB_KEYIMAGE, entry.first));
+        else
+            batch.Write(std::make_pair(DB_KEYIMAGE, entry.first), entry.second);
+    }
+    for (const auto& entry : ringMembers) {
+        batch.Write(std::make_pair(DB_RINGMEMBER, entry.first), entry.second);
+    }
     return WriteBatch(batch, true);
 }
 
@@ -179,36 +195,92 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadRingMember(const COutPoint& outpoint, CDiskRingMember& member)
+{
+    return Read(std::make_pair(DB_RINGMEMBER, outpoint), member);
+}
+
 
-bool CBlockTreeDB::ReadKeyImage(const std::string& keyImage, uint256& bh)
+bool CBlockTreeDB::ReadKeyImages(const CKeyImage& keyImage, std::vector<uint256>& bhs)
 {
-    return Read(std::make_pair(DB_KEYIMAGE, keyImage), bh);
+    return Read(std::make_pair(DB_KEYIMAGE, keyImage), bhs);
 }
 
-bool CBlockTreeDB::ReadKeyImages(const std::string& keyImage, std::vector<uint256>& bhs)
+/** Parse an old-format key image entry: the GetHex() of the key image, optionally followed by a decimal suffix */
+static bool ParseOldKeyImageKey(const std::string& str, CKeyImage& keyImage)
 {
-    uint256 bh;
-    if (!Read(std::make_pair(DB_KEYIMAGE, keyImage), bh)) return false;
-    bhs.push_back(bh);
-    int i = 1;
-    while(ReadKeyImage(keyImage + std::to_string(i), bh)) {
-        bhs.push_back(bh);
-        i++;
+    for (unsigned int len : {33u, 65u}) {
+        if (str.size() < 2 * len)
+            break;
+        const std::string strSuffix = str.substr(2 * len);
+        if (!std::all_of(strSuffix.begin(), strSuffix.end(), [](char c) { return c >= '0' && c <= '9'; }))
+            continue;
+        std::vector<unsigned char> vch = ParseHex(str.substr(0, 2 * len));
+        if (vch.size() != len)
+            continue;
+        // GetHex() writes the bytes in reverse order
+        std::reverse(vch.begin(), vch.end());
+        keyImage.Set(vch.begin(), vch.end());
+        if (keyImage.size() == len)
+            return true;
     }
-    return true;
+    return false;
 }
 
-bool CBlockTreeDB::WriteKeyImage(const std::string& keyImage, const uint256& bh)
+bool CBlockTreeDB::MigrateKeyImages()
 {
-    uint256 blockHash;
-    if (!ReadKeyImage(keyImage, blockHash)) {
-        return Write(std::make_pair(DB_KEYIMAGE, keyImage), bh);
-    }
-    int i = 1;
-    while (ReadKeyImage(keyImage + std::to_string(i), blockHash)) {
-        i++;
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(DB_KEYIMAGE_OLD);
+    if (!pcursor->Valid())
+        return true;
+
+    LogPrintf("Upgrading key image index...\n");
+    size_t nMigrated = 0;
+    std::map<CKeyImage, std::vector<uint256> > mapKeyImages;
+    std::vector<std::string> vOldKeys;
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char, std::string> key;
+        bool fDone = !pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_KEYIMAGE_OLD;
+        if (!fDone) {
+            uint256 bh;
+            CKeyImage keyImage;
+            if (!pcursor->GetValue(bh))
+                return error("%s : failed to read value", __func__);
+            if (ParseOldKeyImageKey(key.second, keyImage)) {
+                std::vector<uint256>& bhs = mapKeyImages[keyImage];
+                if (std::find(bhs.begin(), bhs.end(), bh) == bhs.end())
+                    bhs.push_back(bh);
+            } else {
+                LogPrintf("%s : dropping malformed key image entry %s\n", __func__, key.second);
+            }
+            vOldKeys.push_back(key.second);
+            pcursor->Next();
+        }
+        if (fDone || vOldKeys.size() >= 10000) {
+            CDBBatch batch;
+            for (auto& entry : mapKeyImages) {
+                std::vector<uint256> bhs;
+                if (Read(std::make_pair(DB_KEYIMAGE, entry.first), bhs)) {
+                    for (const uint256& bh : bhs)
+                        if (std::find(entry.second.begin(), entry.second.end(), bh) == entry.second.end())
+                            entry.second.push_back(bh);
+                }
+                batch.Write(std::make_pair(DB_KEYIMAGE, entry.first), entry.second);
+            }
+            for (const std::string& strKey : vOldKeys)
+                batch.Erase(std::make_pair(DB_KEYIMAGE_OLD, strKey));
+            if (!WriteBatch(batch, true))
+                return error("%s : failed to write key image index", __func__);
+            nMigrated += vOldKeys.size();
+            mapKeyImages.clear();
+            vOldKeys.clear();
+        }
+        if (fDone)
+            break;
     }
-    return Write(std::make_pair(DB_KEYIMAGE, keyImage + std::to_string(i)), bh);
+    LogPrintf("Upgraded %u key image entries\n", nMigrated);
+    return true;
 }
 
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
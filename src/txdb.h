@@ -82,22 +82,25 @@ private:
 
 public:
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
-    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo,
+                        const std::vector<std::pair<CKeyImage, std::vector<uint256> > >& keyImages,
+                        const std::vector<std::pair<COutPoint, CDiskRingMember> >& ringMembers);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo& fileinfo);
     bool ReadLastBlockFile(int& nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool& fReindex);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
+    bool ReadRingMember(const COutPoint& outpoint, CDiskRingMember& member);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
     bool LoadBlockIndexGuts();
 
-    bool ReadKeyImage(const std::string& keyImage, uint256& bh);
-    bool ReadKeyImages(const std::string& keyImage, std::vector<uint256>& bhs);
-
-    bool WriteKeyImage(const std::string& keyImage, const uint256& height);
+    /** Hashes of all flushed blocks spending keyImage; unflushed spends live in CKeyImageCache */
+    bool ReadKeyImages(const CKeyImage& keyImage, std::vector<uint256>& bhs);
+    /** Convert key image entries from the old hex-string format to the binary index */
+    bool MigrateKeyImages();
 };
 #endif // BITCOIN_TXDB_H
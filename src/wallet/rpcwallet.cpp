@@ -2728,6 +2728,7 @@ UniValue createprivacysubaddress(const UniValue& params, bool fHelp)
             account.viewAccount = viewAccount;
             account.spendAccount = spendAccount;
             walletdb.AppendStealthAccountList(label);
+            pwalletMain->MarkStealthAccountsDirty();
             break;
         }
     }
@@ -2802,17 +2803,20 @@ UniValue decodestealthaddress(const UniValue& params, bool fHelp)
 
 UniValue sendtostealthaddress(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() < 2 || params.size() > 3)
+    if (fHelp || params.size() < 2 || params.size() > 4)
         throw std::runtime_error(
-                "sendtostealthaddress \"prcystealthaddress\" amount\n"
+                "sendtostealthaddress \"prcystealthaddress\" amount ( lock_output async )\n"
                 "\nSend an amount to a given prcy stealth address address. The amount is a real and is rounded to the nearest 0.00000001\n" +
                 HelpRequiringPassphrase() +
                 "\nArguments:\n"
                 "1. \"prcystealthaddress\"  (string, required) The prcycoin stealth address to send to.\n"
                 "2. \"amount\"              (numeric, required) The amount in PRCY to send. eg 0.1\n"
                 "3. \"lock_output\"         (bool, optional, default=false) Whether to lock the output or not.\n"
+                "4. \"async\"               (bool, optional, default=false) Queue the send and return a job id for getsendjob instead of waiting for the transaction.\n"
                 "\nResult:\n"
                 "\"transactionid\"  (string) The transaction id.\n"
+                "\nResult (async):\n"
+                "n                (numeric) The id of the queued send.\n"
                 "\nExamples:\n" +
                 HelpExampleCli("sendtostealthaddress", "\"Pap5WCV4SjVMGLyYf98MEX82ErBEMVpg9ViQ1up3aBib6Fz4841SahrRXG6eSNSLBSNvEiGuQiWKXJC3RDfmotKv15oCrh6N2Ym\" 0.1") + HelpExampleCli("sendtostealthaddress", "\"Pap5WCV4SjVMGLyYf98MEX82ErBEMVpg9ViQ1up3aBib6Fz4841SahrRXG6eSNSLBSNvEiGuQiWKXJC3RDfmotKv15oCrh6N2Ym\" 0.1 \"donation\" \"seans outpost\"") + HelpExampleRpc("sendtostealthaddress", "\"Pap5WCV4SjVMGLyYf98MEX82ErBEMVpg9ViQ1up3aBib6Fz4841SahrRXG6eSNSLBSNvEiGuQiWKXJC3RDfmotKv15oCrh6N2Ym\", 0.1, \"donation\", \"seans outpost\""));
 
@@ -2832,34 +2836,58 @@ UniValue sendtostealthaddress(const UniValue& params, bool fHelp)
     if (params.size() > 2)
         lockOutput = params[2].get_bool();
 
+    if (params.size() > 3 && params[3].get_bool()) {
+        CPubKey viewKey, spendKey;
+        bool hasPaymentID;
+        uint64_t paymentID;
+        if (!CWallet::DecodeStealthAddress(stealthAddr, viewKey, spendKey, hasPaymentID, paymentID))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid stealth address");
+        return pwalletMain->QueueSendToStealthAddress(stealthAddr, nAmount, lockOutput);
+    }
+
     if (!pwalletMain->SendToStealthAddress(stealthAddr, nAmount, wtx)) {
         throw JSONRPCError(RPC_WALLET_ERROR,
                            "Cannot create transaction.");
     }
 
-    std::string myAddress;
-    pwalletMain->ComputeStealthPublicAddress("masteraccount", myAddress);
-    int indexOut = -1;
-    if (stealthAddr == myAddress) {
-        if (lockOutput) {
-            for (int i=0; i < (int)wtx.vout.size(); i++) {
-                UniValue obj(UniValue::VOBJ);
-                CTxOut& out = wtx.vout[i];
-                CAmount value = pwalletMain->getCTxOutValue(wtx, out);
-                if (value == nAmount) {
-                    indexOut = i;
-
-                    // Lock output
-                    COutPoint collateralOut(wtx.GetHash(), indexOut);
-                    pwalletMain->LockCoin(collateralOut);
-                    LogPrintf("Output transaction: %s:%i has been locked\n", wtx.GetHash().GetHex().c_str(), indexOut);
-                }
-            }
-        }
-    }
+    if (lockOutput)
+        pwalletMain->LockSentOutput(stealthAddr, nAmount, wtx);
     return wtx.GetHash().GetHex();
 }
 
+UniValue getsendjob(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+                "getsendjob jobid\n"
+                "\nReturns the state of a send queued with sendtostealthaddress in asynchronous mode.\n"
+                "\nArguments:\n"
+                "1. jobid    (numeric, required) The id returned by sendtostealthaddress.\n"
+                "\nResult:\n"
+                "{\n"
+                "  \"jobid\": n,                 (numeric) The id of the send\n"
+                "  \"status\": \"status\",        (string) queued, running, sent or failed\n"
+                "  \"txid\": \"transactionid\",   (string) The transaction id, once sent\n"
+                "  \"error\": \"message\"         (string) Why the send failed, if it did\n"
+                "}\n"
+                "\nExamples:\n" +
+                HelpExampleCli("getsendjob", "1") + HelpExampleRpc("getsendjob", "1"));
+
+    int64_t nJobId = params[0].get_int64();
+    CSendJob job;
+    if (!pwalletMain->GetSendJob(nJobId, job))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown send job");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("jobid", nJobId));
+    ret.push_back(Pair("status", job.GetStatusString()));
+    if (job.status == CSendJob::SENT)
+        ret.push_back(Pair("txid", job.txid.GetHex()));
+    if (job.status == CSendJob::FAILED)
+        ret.push_back(Pair("error", job.strError));
+    return ret;
+}
+
 UniValue sendalltostealthaddress(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
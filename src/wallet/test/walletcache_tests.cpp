@@ -0,0 +1,152 @@
+// Copyright (c) 2020-2022 The PRivaCY Coin Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "keyimagecache.h"
+#include "main.h"
+#include "validationinterface.h"
+#include "wallet/wallet.h"
+#include "wallet/walletdb.h"
+#include "test/test_prcycoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+extern CWallet* pwalletMain;
+
+BOOST_FIXTURE_TEST_SUITE(walletcache_tests, TestingSetup)
+
+// A key of the wallet whose outputs are worth nAmount, as if their amounts had been decoded
+static CScript AddWalletKey(CAmount nAmount)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(pwalletMain->AddKeyPubKey(key, key.GetPubKey()));
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    CKey blind;
+    blind.MakeNewKey(true);
+    LOCK(pwalletMain->cs_wallet);
+    pwalletMain->amountMap[scriptPubKey] = nAmount;
+    pwalletMain->blindMap[scriptPubKey] = blind;
+    return scriptPubKey;
+}
+
+// A transaction paying scriptPubKey, confirmed in hashBlock unless that is null, and final unless nLockTime is set
+static CWalletTx MakeWalletTx(const CScript& scriptPubKey, const uint256& hashBlock, uint32_t nLockTime = 0)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    if (nLockTime)
+        mtx.vin[0].nSequence = 0;
+    mtx.vout.resize(1);
+    mtx.vout[0].scriptPubKey = scriptPubKey;
+    mtx.nLockTime = nLockTime;
+    CWalletTx wtx(pwalletMain, CTransaction(mtx));
+    if (!hashBlock.IsNull()) {
+        wtx.hashBlock = hashBlock;
+        wtx.nIndex = 1;
+    }
+    return wtx;
+}
+
+static void AddWalletTx(const CWalletTx& wtx)
+{
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+    CWalletDB walletdb(pwalletMain->strWalletFile);
+    BOOST_CHECK(pwalletMain->AddToWallet(wtx, false, &walletdb));
+}
+
+BOOST_AUTO_TEST_CASE(balances_follow_wallet_transactions)
+{
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalances().nTrusted, 0);
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalances().nUnconfirmed, 0);
+
+    // Adding a transaction invalidates the cached balances
+    const CScript scriptTrusted = AddWalletKey(5 * COIN);
+    const uint256 hashGenesis = WITH_LOCK(cs_main, return chainActive.Genesis()->GetBlockHash());
+    AddWalletTx(MakeWalletTx(scriptTrusted, hashGenesis));
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalances().nTrusted, 5 * COIN);
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalance(), 5 * COIN);
+
+    // A time locked transaction is unconfirmed; its credit is recomputed by every pass
+    const CScript scriptLocked = AddWalletKey(3 * COIN);
+    AddWalletTx(MakeWalletTx(scriptLocked, UINT256_ZERO, 1000000));
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalances().nUnconfirmed, 3 * COIN);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedBalance(), 3 * COIN);
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalances().nTrusted, 5 * COIN);
+
+    // Amounts can not be decoded while the wallet is locked
+    const SecureString strPassphrase("balances");
+    BOOST_CHECK(pwalletMain->EncryptWallet(strPassphrase));
+    BOOST_CHECK(pwalletMain->IsLocked());
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalances().nUnconfirmed, 0);
+    BOOST_CHECK(pwalletMain->Unlock(strPassphrase));
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalances().nUnconfirmed, 3 * COIN);
+    BOOST_CHECK(pwalletMain->Lock());
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalances().nUnconfirmed, 0);
+}
+
+BOOST_AUTO_TEST_CASE(balances_follow_reorganizations)
+{
+    CBlockIndex* pindexGenesis = WITH_LOCK(cs_main, return chainActive.Genesis());
+    const uint256 hashBlock = uint256S("0x01");
+    CBlockIndex indexBlock;
+    indexBlock.phashBlock = &hashBlock;
+    indexBlock.pprev = pindexGenesis;
+    indexBlock.nHeight = 1;
+    {
+        LOCK(cs_main);
+        mapBlockIndex[hashBlock] = &indexBlock;
+        chainActive.SetTip(&indexBlock);
+    }
+
+    const CScript scriptPubKey = AddWalletKey(7 * COIN);
+    const CWalletTx wtx = MakeWalletTx(scriptPubKey, hashBlock);
+    AddWalletTx(wtx);
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalances().nTrusted, 7 * COIN);
+
+    // Disconnecting the block notifies the wallet of its transactions, like DisconnectTip does
+    WITH_LOCK(cs_main, chainActive.SetTip(pindexGenesis));
+    SyncWithWallets(wtx, NULL);
+    BOOST_CHECK_EQUAL(pwalletMain->GetBalances().nTrusted, 0);
+
+    WITH_LOCK(cs_main, mapBlockIndex.erase(hashBlock));
+}
+
+BOOST_AUTO_TEST_CASE(spendable_outputs_after_disconnect)
+{
+    const CScript scriptPubKey = AddWalletKey(4 * COIN);
+    CBlockIndex* pindexGenesis = WITH_LOCK(cs_main, return chainActive.Genesis());
+    const CWalletTx wtx = MakeWalletTx(scriptPubKey, pindexGenesis->GetBlockHash());
+    AddWalletTx(wtx);
+
+    std::vector<COutput> vCoins;
+    BOOST_CHECK(pwalletMain->AvailableCoins(vCoins));
+    BOOST_CHECK_EQUAL(vCoins.size(), 1U);
+
+    // Spending the output in a connected block prunes it from the index
+    CKey key;
+    key.MakeNewKey(true);
+    const CKeyImage keyImage = key.GetPubKey();
+    {
+        LOCK(pwalletMain->cs_wallet);
+        pwalletMain->outpointToKeyImages[wtx.GetHash().GetHex() + "0"] = keyImage;
+    }
+    pkeyImageCache->AddSpend(keyImage, pindexGenesis->GetBlockHash());
+    BOOST_CHECK(pwalletMain->AvailableCoins(vCoins));
+    BOOST_CHECK(vCoins.empty());
+
+    // Disconnecting that block undoes the spend, and DisconnectTip has the index rebuilt
+    pkeyImageCache->RemoveSpend(keyImage, pindexGenesis->GetBlockHash());
+    BOOST_CHECK(pwalletMain->AvailableCoins(vCoins));
+    BOOST_CHECK(vCoins.empty());
+    pwalletMain->MarkSpendableOutputsDirty();
+    BOOST_CHECK(pwalletMain->AvailableCoins(vCoins));
+    BOOST_CHECK_EQUAL(vCoins.size(), 1U);
+    if (!vCoins.empty()) {
+        BOOST_CHECK(vCoins[0].tx->GetHash() == wtx.GetHash());
+        BOOST_CHECK_EQUAL(vCoins[0].i, 0);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -14,6 +14,7 @@
 #include "coincontrol.h"
 #include "guiinterfaceutil.h"
 #include "kernel.h"
+#include "keyimagecache.h"
 #include "invalid.h"
 #include "masternode-budget.h"
 #include "masternode-payments.h"
@@ -30,12 +31,14 @@
 
 #include "secp256k1.h"
 #include <assert.h>
+#include <condition_variable>
 #include <boost/algorithm/string.hpp>
 
 #include "ecdhutil.h"
 #include "secp256k1_bulletproofs.h"
 #include "secp256k1_commitment.h"
 #include "secp256k1_generator.h"
+#include "secp256k1_stealth.h"
 #include "txdb.h"
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -586,10 +589,12 @@ bool CWallet::Lock()
     if (!SetCrypted())
         return false;
 
+    MarkStealthAccountsDirty();
     {
         LOCK(cs_KeyStore);
         vMasterKey.clear();
     }
+    MarkBalancesDirty();
 
     NotifyStatusChanged(this);
     return true;
@@ -651,6 +656,7 @@ bool CWallet::Unlock(const CKeyingMaterial& vMasterKeyIn)
 
         fDecryptionThoroughlyChecked = true;
     }
+    MarkBalancesDirty();
     NotifyStatusChanged(this);
     return true;
 }
@@ -713,6 +719,43 @@ void CWallet::SetBestChain(const CBlockLocator& loc)
 {
     CWalletDB walletdb(strWalletFile);
     walletdb.WriteBestBlock(loc);
+    WriteOutputAmounts();
+}
+
+/**
+ * Write the amounts and blinds decoded since the last call in one batch. Encrypted wallets keep them
+ * in memory only, as they would reveal on disk what the commitments hide.
+ */
+void CWallet::WriteOutputAmounts()
+{
+    LOCK(cs_wallet);
+    if (!fFileBacked || IsCrypted() || setUnsavedOutputAmounts.empty()) {
+        setUnsavedOutputAmounts.clear();
+        return;
+    }
+    CWalletDB walletdb(strWalletFile);
+    walletdb.TxnBegin();
+    for (const CScript& scriptPubKey : setUnsavedOutputAmounts) {
+        std::map<CScript, CAmount>::const_iterator itAmount = amountMap.find(scriptPubKey);
+        std::map<CScript, CKey>::const_iterator itBlind = blindMap.find(scriptPubKey);
+        if (itAmount != amountMap.end() && itBlind != blindMap.end())
+            walletdb.WriteOutputAmount(scriptPubKey, itAmount->second, itBlind->second);
+    }
+    walletdb.TxnCommit();
+    setUnsavedOutputAmounts.clear();
+}
+
+//! Forget the decoded amounts of the outputs of a transaction that leaves the wallet
+void CWallet::EraseOutputAmounts(const CTransaction& tx, CWalletDB& walletdb)
+{
+    AssertLockHeld(cs_wallet);
+    for (const CTxOut& out : tx.vout) {
+        if (!amountMap.erase(out.scriptPubKey))
+            continue;
+        blindMap.erase(out.scriptPubKey);
+        setUnsavedOutputAmounts.erase(out.scriptPubKey);
+        walletdb.EraseOutputAmount(out.scriptPubKey);
+    }
 }
 
 bool CWallet::SetMinVersion(enum WalletFeature nVersion, CWalletDB* pwalletdbIn, bool fExplicit)
@@ -877,7 +920,7 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n)
 
     std::string outString = outpoint.hash.GetHex() + std::to_string(outpoint.n);
     CKeyImage ki = outpointToKeyImages[outString];
-    if (IsSpentKeyImage(ki.GetHex(), UINT256_ZERO)) {
+    if (IsSpentKeyImage(ki, UINT256_ZERO)) {
         return true;
     }
 
@@ -907,6 +950,7 @@ void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
     range = mapTxSpends.equal_range(outpoint);
     SyncMetaData(range);
     inSpendQueueOutpoints.erase(outpoint);
+    MarkBalancesDirty();
 }
 
 std::string CWallet::GetTransactionType(const CTransaction& tx)
@@ -1094,6 +1138,10 @@ bool CWallet::EncryptWallet(const SecureString& strWalletPassphrase)
                 return false;
             }
             pwalletdbEncryption->WriteMasterKey(nMasterKeyMaxID, kMasterKey);
+            // decoded amounts are only kept on disk for unencrypted wallets
+            for (const std::pair<const CScript, CAmount>& entry : amountMap)
+                pwalletdbEncryption->EraseOutputAmount(entry.first);
+            setUnsavedOutputAmounts.clear();
         }
 
         // must get current HD chain before EncryptKeys
@@ -1167,7 +1215,15 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (PAIRTYPE(const uint256, CWalletTx) & item : mapWallet)
             item.second.MarkDirty();
+        fSpendableOutputsRebuild = true;
     }
+    MarkBalancesDirty();
+}
+
+void CWallet::MarkSpendableOutputsDirty()
+{
+    LOCK(cs_wallet);
+    fSpendableOutputsRebuild = true;
 }
 
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb)
@@ -1177,7 +1233,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
     CBlockIndex* p = mapBlockIndex[hashBlock];
     if (p) {
         for (CTxIn in : wtxIn.vin) {
-            pblocktree->WriteKeyImage(in.keyImage.GetHex(), hashBlock);
+            pkeyImageCache->AddSpend(in.keyImage, hashBlock);
         }
     }
 
@@ -1207,6 +1263,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         wtx.BindWallet(this);
         wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         AddToSpends(hash);
+        setSpendableOutputsPending.insert(hash);
+        MarkBalancesDirty();
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -1250,6 +1308,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        setSpendableOutputsPending.insert(hash);
+        MarkBalancesDirty();
         //LogPrintf("MarkDirty %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
         // Notify UI of new or updated transaction
@@ -1271,13 +1331,16 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
  * pblock is optional, but should be provided if the transaction is known to be in a block.
  * If fUpdate is true, existing transactions will be updated.
  */
-bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate)
+bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate, const std::vector<std::pair<unsigned int, CKey> >* pStealthOutputs)
 {
     {
         AssertLockHeld(cs_wallet);
         bool fExisted = mapWallet.count(tx.GetHash()) != 0;
         if (fExisted && !fUpdate) return false;
-        IsTransactionForMe(tx);
+        if (pStealthOutputs)
+            addStealthOutputs(tx, *pStealthOutputs);
+        else
+            IsTransactionForMe(tx);
         if (pblock && mapBlockIndex.count(pblock->GetHash()) == 1) {
             if (!IsLocked()) {
                 try {
@@ -1317,6 +1380,7 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
         if (mapWallet.count(prevout.hash))
             mapWallet[prevout.hash].MarkDirty();
     }
+    MarkBalancesDirty();
 }
 
 void CWallet::EraseFromWallet(const uint256& hash)
@@ -1325,8 +1389,14 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
-            CWalletDB(strWalletFile).EraseTx(hash);
+        std::map<uint256, CWalletTx>::iterator it = mapWallet.find(hash);
+        if (it != mapWallet.end()) {
+            CWalletDB walletdb(strWalletFile);
+            EraseOutputAmounts(it->second, walletdb);
+            mapWallet.erase(it);
+            walletdb.EraseTx(hash);
+            MarkBalancesDirty();
+        }
         LogPrintf("%s: Erased wtx %s from wallet\n", __func__, hash.GetHex());
     }
     return;
@@ -1852,8 +1922,12 @@ void CWallet::DeleteTransactions(std::vector<uint256> &removeTxs)
     CWalletDB walletdb(strWalletFile, "r+", false);
 
     for (int i = 0; i< removeTxs.size(); i++) {
-        if (mapWallet.erase(removeTxs[i])) {
+        std::map<uint256, CWalletTx>::iterator it = mapWallet.find(removeTxs[i]);
+        if (it != mapWallet.end()) {
+            EraseOutputAmounts(it->second, walletdb);
+            mapWallet.erase(it);
             walletdb.EraseTx(removeTxs[i]);
+            MarkBalancesDirty();
             LogPrint(BCLog::DELETETX,"DeleteTx - Deleting tx %s, %i.\n", removeTxs[i].ToString(),i);
         } else {
             LogPrint(BCLog::DELETETX,"DeleteTx - Deleting tx %failed.\n", removeTxs[i].ToString());
@@ -2011,6 +2085,75 @@ void CWallet::DeleteWalletTransactions(const CBlockIndex* pindex)
     }
 }
 
+/**
+ * Find the outputs of vtx paid to one of the stealth accounts of keys and derive
+ * their spending keys. The destinations of all outputs are computed in one batch
+ * per account. Only reads its arguments, so rescans run it without holding cs_wallet.
+ */
+static bool FindStealthOutputs(const std::vector<const CTransaction*>& vtx, const CStealthScanKeys& keys, std::vector<std::vector<std::pair<unsigned int, CKey> > >& vStealthOutputs)
+{
+    vStealthOutputs.assign(vtx.size(), std::vector<std::pair<unsigned int, CKey> >());
+
+    // Outputs as (transaction, output) with their transaction public keys
+    std::vector<std::pair<size_t, unsigned int> > vOutputs;
+    std::vector<unsigned char> txPubs;
+    for (size_t t = 0; t < vtx.size(); t++) {
+        for (unsigned int n = 0; n < vtx[t]->vout.size(); n++) {
+            const CTxOut& out = vtx[t]->vout[n];
+            if (out.IsEmpty() || out.txPub.size() != 33) {
+                continue;
+            }
+            vOutputs.push_back(std::make_pair(t, n));
+            txPubs.insert(txPubs.end(), out.txPub.begin(), out.txPub.end());
+        }
+    }
+    if (vOutputs.empty())
+        return true;
+
+    std::vector<unsigned char> destinations(33 * vOutputs.size());
+    for (size_t i = 0; i < keys.spends.size(); i++) {
+        //P' = Hs(aR)G+B, a = view private, B = spend pub, R = tx public key
+        if (!secp256k1_stealth_destinations(GetContext(), &destinations[0], keys.views[i].begin(), keys.spendPubKeys[i].begin(), &txPubs[0], vOutputs.size())) {
+            return false;
+        }
+        for (size_t k = 0; k < vOutputs.size(); k++) {
+            const CTxOut& out = vtx[vOutputs[k].first]->vout[vOutputs[k].second];
+            CPubKey expectedDes(&destinations[33 * k], &destinations[33 * k] + 33);
+            if (!expectedDes.IsValid() || GetScriptForDestination(expectedDes) != out.scriptPubKey)
+                continue;
+
+            //Compute private key to spend
+            //x = Hs(aR) + b, b = spend private key
+            unsigned char aR[33];
+            memcpy(aR, &txPubs[33 * k], 33);
+            if (!secp256k1_ec_pubkey_tweak_mul(aR, 33, keys.views[i].begin()))
+                return false;
+            uint256 HS = Hash(aR, aR + 33);
+            unsigned char HStemp[32];
+            unsigned char spendTemp[32];
+            memcpy(HStemp, HS.begin(), 32);
+            memcpy(spendTemp, keys.spends[i].begin(), 32);
+            if (!secp256k1_ec_privkey_tweak_add(HStemp, spendTemp))
+                throw std::runtime_error("Failed to do secp256k1_ec_privkey_tweak_add");
+            CKey privKey;
+            privKey.Set(HStemp, HStemp + 32, true);
+            vStealthOutputs[vOutputs[k].first].push_back(std::make_pair(vOutputs[k].second, privKey));
+        }
+    }
+    return true;
+}
+
+/** A block read and scanned for stealth outputs ahead of being added to the wallet */
+struct CRescanBlock {
+    CBlock block;
+    //! Stealth outputs found per transaction of block, valid if fScanned
+    std::vector<std::vector<std::pair<unsigned int, CKey> > > vStealthOutputs;
+    bool fScanned;
+    bool fReady;
+
+    CRescanBlock() : fScanned(false), fReady(false) {}
+};
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -2022,6 +2165,9 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, b
     int ret = 0;
     int64_t nNow = GetTime();
     CBlockIndex* pindex = pindexStart;
+    std::vector<CBlockIndex*> vBlocks;
+    CStealthScanKeys keys;
+    double dProgressStart, dProgressTip;
     {
         LOCK2(cs_main, cs_wallet);
         if (pindexStart == chainActive.Genesis()) {
@@ -2033,36 +2179,129 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, b
                 pindex = chainActive.Next(pindex);
             }
         }
+        if (IsLocked())
+            return ret;
+        if (loadStealthScanKeys())
+            keys = stealthScanKeys;
+        for (CBlockIndex* pindexScan = pindex; pindexScan; pindexScan = chainActive.Next(pindexScan))
+            vBlocks.push_back(pindexScan);
 
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        while (!IsLocked() && pindex) {
+        dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+    }
+
+    // Worker threads read blocks ahead and do the view key ECDH of every output
+    // without holding cs_main or cs_wallet. This thread adds the results to the
+    // wallet in chain order, as spends are only recognized once the outputs they
+    // spend are in the wallet.
+    int nThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    if (nThreads <= 0)
+        nThreads += boost::thread::hardware_concurrency();
+    nThreads = std::max(1, std::min(nThreads, MAX_RESCAN_THREADS));
+    const size_t nWindow = 16 * nThreads;
+    std::vector<CRescanBlock> vSlots(nWindow);
+    Mutex csRescan;
+    std::condition_variable condRescan;
+    size_t nNextRead = 0;
+    size_t nNextCommit = 0;
+    bool fStop = false;
+
+    auto scanBlocks = [&]() {
+        util::ThreadRename("prcycoin-rescan");
+        while (true) {
+            size_t nPos;
+            {
+                WAIT_LOCK(csRescan, lock);
+                condRescan.wait(lock, [&] { return fStop || nNextRead >= vBlocks.size() || nNextRead < nNextCommit + nWindow; });
+                if (fStop || nNextRead >= vBlocks.size())
+                    return;
+                nPos = nNextRead++;
+            }
+            // The slot of nPos is free: block nPos - nWindow has been committed
+            CRescanBlock& slot = vSlots[nPos % nWindow];
+            slot.block.SetNull();
+            slot.fScanned = ReadBlockFromDisk(slot.block, vBlocks[nPos]);
+            std::vector<const CTransaction*> vtx;
+            for (const CTransaction& tx : slot.block.vtx)
+                vtx.push_back(&tx);
+            try {
+                slot.fScanned = slot.fScanned && FindStealthOutputs(vtx, keys, slot.vStealthOutputs);
+            } catch (const std::exception&) {
+                // Fall back to scanning the block under cs_wallet
+                slot.fScanned = false;
+            }
+            {
+                LOCK(csRescan);
+                slot.fReady = true;
+            }
+            condRescan.notify_all();
+        }
+    };
+    boost::thread_group rescanThreads;
+    for (int i = 0; i < nThreads; i++)
+        rescanThreads.create_thread(scanBlocks);
+    auto stopThreads = [&]() {
+        {
+            LOCK(csRescan);
+            fStop = true;
+        }
+        condRescan.notify_all();
+        rescanThreads.join_all();
+    };
+
+    try {
+        for (size_t nPos = 0; nPos < vBlocks.size(); nPos++) {
+            pindex = vBlocks[nPos];
             if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
                 ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
 
             if (fromStartup && ShutdownRequested()) {
-                return -1;
+                ret = -1;
+                break;
             }
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            for (CTransaction& tx : block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
+            CRescanBlock& slot = vSlots[nPos % nWindow];
+            {
+                WAIT_LOCK(csRescan, lock);
+                condRescan.wait(lock, [&] { return slot.fReady; });
+            }
+            {
+                LOCK2(cs_main, cs_wallet);
+                if (IsLocked())
+                    break;
+                // Blocks disconnected since the list was taken are skipped, those connected instead reach the wallet through SyncTransaction
+                if (chainActive.Contains(pindex)) {
+                    for (size_t i = 0; i < slot.block.vtx.size(); i++) {
+                        if (AddToWalletIfInvolvingMe(slot.block.vtx[i], &slot.block, fUpdate, slot.fScanned ? &slot.vStealthOutputs[i] : NULL))
+                            ret++;
+                    }
+                }
             }
-            pindex = chainActive.Next(pindex);
+            {
+                LOCK(csRescan);
+                slot.fReady = false;
+                nNextCommit = nPos + 1;
+            }
+            condRescan.notify_all();
+
             if (GetTime() >= nNow + 60) {
                 nNow = GetTime();
                 LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
             }
             if (ShutdownRequested()) {
                 LogPrintf("Rescan aborted at block %d. Please rescanwallettransactions %f from the Debug Console to continue.\n", pindex->nHeight, pindex->nHeight);
+                stopThreads();
                 return false;
             }
         }
-        ShowProgress(_("Rescanning... Please do not interrupt this process as it could lead to a corrupt wallet."), 100); // hide progress dialog in GUI
+    } catch (...) {
+        stopThreads();
+        throw;
     }
+    stopThreads();
+    if (ret != -1)
+        ShowProgress(_("Rescanning... Please do not interrupt this process as it could lead to a corrupt wallet."), 100); // hide progress dialog in GUI
     return ret;
 }
 
@@ -2177,149 +2416,102 @@ void CWallet::ResendWalletTransactions()
  * @{
  */
 
-CAmount CWallet::GetBalance()
+CWalletBalances CWallet::GetBalances() const
 {
-    CAmount nTotal = 0;
+    {
+        LOCK(cs_balances);
+        // IsTrusted depends on mempool membership, which can change without the wallet noticing
+        if (fBalancesCached && nCachedBalancesGeneration == nBalancesGeneration &&
+            nCachedMempoolUpdated == mempool.GetTransactionsUpdated())
+            return cachedBalances;
+    }
+
+    // Read the counters before the pass, so that a change made during it leaves the result stale
+    const uint64_t nGeneration = nBalancesGeneration;
+    const unsigned int nMempoolUpdated = mempool.GetTransactionsUpdated();
+    CWalletBalances balances;
     {
         LOCK2(cs_main, cs_wallet);
         for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
             const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted()) {
+            const bool fTrusted = pcoin->IsTrusted();
+            const int nDepth = pcoin->GetDepthInMainChain();
+            if (fTrusted) {
                 CAmount ac = pcoin->GetAvailableCredit();
-                nTotal += ac;
+                balances.nTrusted += ac;
+                if (!((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0 && pcoin->IsInMainChain()))
+                    balances.nMature += ac;
+                balances.nWatchOnly += pcoin->GetAvailableWatchOnlyCredit();
+                if (!fLiteMode && nDepth > 0) {
+                    balances.nLocked += pcoin->GetLockedCredit();
+                    balances.nUnlocked += pcoin->GetUnlockedCredit();
+                }
             }
+            if (!IsFinalTx(*pcoin) || (!fTrusted && nDepth == 0)) {
+                balances.nUnconfirmed += pcoin->GetAvailableCredit(false);
+                balances.nUnconfirmedWatchOnly += pcoin->GetAvailableWatchOnlyCredit();
+            }
+            balances.nImmature += pcoin->GetImmatureCredit(false);
+            balances.nImmatureWatchOnly += pcoin->GetImmatureWatchOnlyCredit();
         }
     }
+
+    LOCK(cs_balances);
+    cachedBalances = balances;
+    nCachedBalancesGeneration = nGeneration;
+    nCachedMempoolUpdated = nMempoolUpdated;
+    fBalancesCached = true;
+    return balances;
+}
+
+CAmount CWallet::GetBalance()
+{
+    CAmount nTotal = GetBalances().nTrusted;
     dirtyCachedBalance = nTotal;
     return nTotal;
 }
 
 CAmount CWallet::GetSpendableBalance()
 {
-    CAmount nLockedBalance = 0;
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted()) {
-                if (!((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0 && pcoin->IsInMainChain())) {
-                    nTotal += pcoin->GetAvailableCredit();
-                }
-            }
-        }
-    }
-
-    nLockedBalance = GetLockedCoins();
-    nTotal = nTotal - nLockedBalance;
-    return nTotal;
+    const CWalletBalances balances = GetBalances();
+    return balances.nMature - balances.nLocked;
 }
 
 
 CAmount CWallet::GetUnlockedCoins() const
 {
-    if (fLiteMode) return 0;
-
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetUnlockedCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nUnlocked;
 }
 
 CAmount CWallet::GetLockedCoins() const
 {
-    if (fLiteMode) return 0;
-
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
-                nTotal += pcoin->GetLockedCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nLocked;
 }
 
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableCredit(false);
-        }
-    }
-    return nTotal;
+    return GetBalances().nUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit(false);
-        }
-    }
-    return nTotal;
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nWatchOnly;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nUnconfirmedWatchOnly;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nImmatureWatchOnly;
 }
 
 /**
@@ -2435,67 +2627,128 @@ bool CWallet::AvailableCoins(
 {
     if (IsLocked()) return false;
     vCoins.clear();
-    const bool fCoinsSelected = (coinControl != nullptr) && coinControl->HasSelected();
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+        UpdateSpendableOutputs();
+
+        std::set<std::pair<CAmount, COutPoint> >::const_iterator itBegin = setSpendableOutputs.begin();
+        std::set<std::pair<CAmount, COutPoint> >::const_iterator itEnd = setSpendableOutputs.end();
+        if (nCoinType == ONLY_5000) {
+            const CAmount nCollateral = Params().MNCollateralAmt();
+            itBegin = setSpendableOutputs.lower_bound(std::make_pair(nCollateral, COutPoint(UINT256_ZERO, 0)));
+            itEnd = setSpendableOutputs.lower_bound(std::make_pair(nCollateral + 1, COutPoint(UINT256_ZERO, 0)));
+        }
+
+        // Availability of each transaction, as its depth or -1
+        std::map<uint256, int> mapTxDepth;
+        std::vector<COutPoint> vSpent;
+        for (std::set<std::pair<CAmount, COutPoint> >::const_iterator it = itBegin; it != itEnd; ++it) {
+            const CAmount value = it->first;
+            const COutPoint& outpoint = it->second;
+            const uint256& wtxid = outpoint.hash;
+            const unsigned int i = outpoint.n;
+
+            std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(wtxid);
+            if (mi == mapWallet.end()) {
+                vSpent.push_back(outpoint);
+                continue;
+            }
+            const CWalletTx* pcoin = &(*mi).second;
 
             // Check if the tx is selectable
-            int nDepth;
-            if (!CheckTXAvailability(pcoin, fOnlyConfirmed, fUseIX, nDepth))
+            std::map<uint256, int>::iterator itDepth = mapTxDepth.find(wtxid);
+            if (itDepth == mapTxDepth.end()) {
+                int nDepth;
+                if (!CheckTXAvailability(pcoin, fOnlyConfirmed, fUseIX, nDepth))
+                    nDepth = -1;
+                itDepth = mapTxDepth.insert(std::make_pair(wtxid, nDepth)).first;
+            }
+            const int nDepth = itDepth->second;
+            if (nDepth < 0)
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                if (pcoin->vout[i].IsEmpty()) {
+            if (nCoinType != ONLY_5000) {
+                if (IsCollateralized(outpoint)) {
                     continue;
                 }
-                bool found = false;
-                CAmount value = getCTxOutValue(*pcoin, pcoin->vout[i]);
-                if (nCoinType == ONLY_5000) {
-                    found = value == Params().MNCollateralAmt();
-                } else {
-                    COutPoint outpoint(pcoin->GetHash(), i);
-                    if (IsCollateralized(outpoint)) {
-                        continue;
-                    }
-                    if (inSpendQueueOutpoints.count(outpoint)) {
-                        continue;
-                    }
-                    found = true;
-                }
-                if (!found) continue;
-
-                isminetype mine = IsMine(pcoin->vout[i]);
-                if (mine == ISMINE_NO)
-                    continue;
-                if (mine == ISMINE_WATCH_ONLY)
-                    continue;
-                if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_5000)
-                    continue;
-                if (value <= 0 && !fIncludeZeroValue)
-                    continue;
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs &&
-                        !coinControl->IsSelected(wtxid, i))
-                    continue;
-
-                bool fIsSpendable = false;
-                if ((mine & ISMINE_SPENDABLE) != ISMINE_NO)
-                    fIsSpendable = true;
-
-                if (IsSpent(wtxid, i)) {
+                if (inSpendQueueOutpoints.count(outpoint)) {
                     continue;
                 }
+                if (IsLockedCoin(wtxid, i))
+                    continue;
+            }
+            if (value <= 0 && !fIncludeZeroValue)
+                continue;
+            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs &&
+                    !coinControl->IsSelected(wtxid, i))
+                continue;
 
-                vCoins.emplace_back(COutput(pcoin, i, nDepth, fIsSpendable));
+            if (IsSpent(wtxid, i)) {
+                vSpent.push_back(outpoint);
+                continue;
             }
+
+            // Only spendable outputs are indexed
+            vCoins.emplace_back(COutput(pcoin, i, nDepth, true));
         }
+
+        // Spends are only undone by disconnecting blocks, which rebuilds the index
+        for (const COutPoint& outpoint : vSpent)
+            EraseSpendableOutput(outpoint);
     }
     return true;
 }
 
+void CWallet::EraseSpendableOutput(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs_wallet);
+    std::map<COutPoint, CAmount>::iterator it = mapSpendableOutputs.find(outpoint);
+    if (it == mapSpendableOutputs.end())
+        return;
+    setSpendableOutputs.erase(std::make_pair(it->second, outpoint));
+    mapSpendableOutputs.erase(it);
+}
+
+void CWallet::UpdateSpendableOutputs()
+{
+    AssertLockHeld(cs_wallet);
+    if (fSpendableOutputsRebuild) {
+        setSpendableOutputs.clear();
+        mapSpendableOutputs.clear();
+        setSpendableOutputsPending.clear();
+        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            setSpendableOutputsPending.insert(it->first);
+        fSpendableOutputsRebuild = false;
+    }
+
+    for (const uint256& hash : setSpendableOutputsPending) {
+        // Drop what was indexed for an earlier version of the transaction
+        std::map<COutPoint, CAmount>::iterator itOut = mapSpendableOutputs.lower_bound(COutPoint(hash, 0));
+        while (itOut != mapSpendableOutputs.end() && itOut->first.hash == hash) {
+            setSpendableOutputs.erase(std::make_pair(itOut->second, itOut->first));
+            mapSpendableOutputs.erase(itOut++);
+        }
+
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+        if (mi == mapWallet.end())
+            continue;
+        const CWalletTx& wtx = (*mi).second;
+        for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+            if (wtx.vout[i].IsEmpty())
+                continue;
+            isminetype mine = IsMine(wtx.vout[i]);
+            if (mine == ISMINE_NO || mine == ISMINE_WATCH_ONLY)
+                continue;
+            const COutPoint outpoint(hash, i);
+            const CAmount value = getCTxOutValue(wtx, wtx.vout[i]);
+            mapSpendableOutputs.insert(std::make_pair(outpoint, value));
+            setSpendableOutputs.insert(std::make_pair(value, outpoint));
+        }
+    }
+    setSpendableOutputsPending.clear();
+}
+
 std::map<CBitcoinAddress, std::vector<COutput> > CWallet::AvailableCoinsByAddress(bool fConfirmed, CAmount maxCoinValue)
 {
     std::vector<COutput> vCoins;
@@ -2954,6 +3207,7 @@ void CWallet::resetPendingOutPoints()
                 }
             }
         }
+        MarkBalancesDirty();
     }
 }
 
@@ -3081,6 +3335,67 @@ int CWallet::ComputeFee(size_t numIn, size_t numOut, size_t ringSize)
     return nFeeNeeded;
 }
 
+/**
+ * Proves the aggregate range proof of the outputs of a transaction on a thread of its own. The
+ * proof only depends on the output amounts and blinds, which makeRingCT leaves alone, so the
+ * ring signature is built meanwhile.
+ */
+class CBulletProofTask
+{
+public:
+    static const size_t MAX_VOUT = 5;
+
+    explicit CBulletProofTask(const CTransaction& tx) : fProved(false)
+    {
+        if (tx.vout.empty() || tx.vout.size() > MAX_VOUT)
+            return;
+        for (const CTxOut& out : tx.vout) {
+            values.push_back(out.nValue);
+            blinds.push_back(out.maskValue.inMemoryRawBind);
+        }
+        thread = boost::thread(&CBulletProofTask::Prove, this);
+    }
+
+    ~CBulletProofTask()
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+
+    //! Wait for the proof and add it to tx
+    bool Finish(CTransaction& tx)
+    {
+        if (thread.joinable())
+            thread.join();
+        if (!fProved)
+            return false;
+        tx.bulletproofs.insert(tx.bulletproofs.end(), proof.begin(), proof.end());
+        return true;
+    }
+
+private:
+    std::vector<uint64_t> values;
+    std::vector<CKey> blinds;
+    std::vector<unsigned char> proof;
+    bool fProved;
+    boost::thread thread;
+
+    void Prove()
+    {
+        unsigned char proofBuf[2000];
+        size_t len = sizeof(proofBuf);
+        unsigned char nonce[32];
+        GetRandBytes(nonce, 32);
+        const unsigned char* blind_ptr[MAX_VOUT];
+        for (size_t i = 0; i < blinds.size(); i++)
+            blind_ptr[i] = blinds[i].begin();
+        CScratchSpace scratch;
+        fProved = secp256k1_bulletproof_rangeproof_prove(GetContext(), scratch.get(), GetGenerator(), proofBuf, &len, values.data(), NULL, blind_ptr, values.size(), &secp256k1_generator_const_h, 64, nonce, NULL, 0);
+        if (fProved)
+            proof.assign(proofBuf, proofBuf + len);
+    }
+};
+
 bool CWallet::CreateTransactionBulletProof(const CKey& txPrivDes, const CPubKey& recipientViewKey, CScript scriptPubKey, const CAmount& nValue, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet, std::string& strFailReason, const CCoinControl* coinControl, AvailableCoinsType coin_type, bool useIX, CAmount nFeePay, int ringSize, bool sendtoMyself)
 {
     std::vector<std::pair<CScript, CAmount> > vecSend;
@@ -3262,11 +3577,15 @@ bool CWallet::CreateTransactionBulletProof(const CKey& txPrivDes, const CPubKey&
                 *static_cast<CTransaction*>(&wtxNew) = CTransaction(txNew);
                 break;
             }
+            std::unique_ptr<CBulletProofTask> proofTask;
+            if (ret)
+                proofTask.reset(new CBulletProofTask(wtxNew));
+
             if (ret && !makeRingCT(wtxNew, ringSize, strFailReason)) {
                 ret = false;
             }
 
-            if (ret && !generateBulletProofAggregate(wtxNew)) {
+            if (ret && !proofTask->Finish(wtxNew)) {
                 strFailReason = _("Failed to generate bulletproof");
                 ret = false;
             }
@@ -3286,6 +3605,7 @@ bool CWallet::CreateTransactionBulletProof(const CKey& txPrivDes, const CPubKey&
                     inSpendQueueOutpoints[inSpendQueueOutpointsPerSession[i]] = true;
                 }
                 inSpendQueueOutpointsPerSession.clear();
+                MarkBalancesDirty();
 
                 uint256 hash = wtxNew.GetHash();
                 int maxTxPrivKeys = txPrivKeys.size() > wtxNew.vout.size() ? wtxNew.vout.size() : txPrivKeys.size();
@@ -3498,29 +3818,6 @@ bool CWallet::CreateTransaction(const std::vector<std::pair<CScript, CAmount> >&
     return true;
 }
 
-bool CWallet::generateBulletProofAggregate(CTransaction& tx)
-{
-    unsigned char proof[2000];
-    size_t len = 2000;
-    const size_t MAX_VOUT = 5;
-    unsigned char nonce[32];
-    GetRandBytes(nonce, 32);
-    unsigned char blinds[MAX_VOUT][32];
-    uint64_t values[MAX_VOUT];
-    size_t i = 0;
-    const unsigned char* blind_ptr[MAX_VOUT];
-    if (tx.vout.size() > MAX_VOUT) return false;
-    memset(blinds, 0, tx.vout.size() * 32);
-    for (i = 0; i < tx.vout.size(); i++) {
-        memcpy(&blinds[i][0], tx.vout[i].maskValue.inMemoryRawBind.begin(), 32);
-        blind_ptr[i] = blinds[i];
-        values[i] = tx.vout[i].nValue;
-    }
-    int ret = secp256k1_bulletproof_rangeproof_prove(GetContext(), GetScratch(), GetGenerator(), proof, &len, values, NULL, blind_ptr, tx.vout.size(), &secp256k1_generator_const_h, 64, nonce, NULL, 0);
-    std::copy(proof, proof + len, std::back_inserter(tx.bulletproofs));
-    return ret;
-}
-
 bool CWallet::makeRingCT(CTransaction& wtxNew, int ringSize, std::string& strFailReason)
 {
     LogPrintf("Making RingCT using ring size=%d\n", ringSize);
@@ -3973,47 +4270,171 @@ bool CWallet::MakeShnorrSignatureTxIn(CTxIn& txin, uint256 cts)
     return true;
 }
 
-bool CWallet::selectDecoysAndRealIndex(CTransaction& tx, int& myIndex, int ringSize)
+void CDecoyPool::Add(const COutPoint& outpoint, const uint256& hashBlock, size_t nMaxSize, uint32_t nRand)
 {
-    LogPrintf("Selecting coinbase decoys for transaction\n");
-    if (coinbaseDecoysPool.size() <= 100) {
-        for (int i = chainActive.Height() - Params().COINBASE_MATURITY(); i > 0; i--) {
-            if (coinbaseDecoysPool.size() > 100) break;
-            CBlockIndex* p = chainActive[i];
+    if (Contains(outpoint)) return;
+    if (!vEntries.empty() && vEntries.size() >= nMaxSize) {
+        Entry& replaced = vEntries[nRand % vEntries.size()];
+        size_t nPos = mapPositions[replaced.first];
+        mapPositions.erase(replaced.first);
+        replaced = std::make_pair(outpoint, hashBlock);
+        mapPositions[outpoint] = nPos;
+        return;
+    }
+    mapPositions[outpoint] = vEntries.size();
+    vEntries.push_back(std::make_pair(outpoint, hashBlock));
+}
+
+void CDecoyPool::Erase(const COutPoint& outpoint)
+{
+    std::map<COutPoint, size_t>::iterator it = mapPositions.find(outpoint);
+    if (it == mapPositions.end()) return;
+    size_t nPos = it->second;
+    mapPositions.erase(it);
+    // Move the last entry into the hole so the vector stays dense
+    if (nPos != vEntries.size() - 1) {
+        vEntries[nPos] = vEntries.back();
+        mapPositions[vEntries[nPos].first] = nPos;
+    }
+    vEntries.pop_back();
+}
+
+void CDecoyPool::EraseBlock(const uint256& hashBlock)
+{
+    for (size_t nPos = 0; nPos < vEntries.size();) {
+        // Erase() moves the last entry into nPos, so only advance past entries that stay
+        if (vEntries[nPos].second == hashBlock)
+            Erase(vEntries[nPos].first);
+        else
+            nPos++;
+    }
+}
+
+//! Coinbase outputs of a block that may become decoys once they are mature
+static std::vector<COutPoint> GetCoinbaseDecoyCandidates(const CBlock& block)
+{
+    std::vector<COutPoint> vCandidates;
+    //dont select poa as decoy
+    if (block.posBlocksAudited.size() > 0) return vCandidates;
+    const CTransaction& coinbase = block.vtx[block.IsProofOfStake() ? 1 : 0];
+    for (size_t i = 0; i < coinbase.vout.size(); i++) {
+        if (!coinbase.vout[i].IsNull() && !coinbase.vout[i].commitment.empty() && coinbase.vout[i].nValue > 0 && !coinbase.vout[i].IsEmpty()) {
+            vCandidates.push_back(COutPoint(coinbase.GetHash(), i));
+        }
+    }
+    return vCandidates;
+}
+
+void CWallet::AddBlockDecoys(const CBlock& block)
+{
+    LOCK2(cs_main, cs_wallet);
+    const uint256 hashBlock = block.GetHash();
+    int userTxStartIdx = 1;
+    if (block.IsProofOfStake()) {
+        userTxStartIdx = 2;
+        userDecoysPool.Erase(block.vtx[1].vin[0].prevout);
+        coinbaseDecoysPool.Erase(block.vtx[1].vin[0].prevout);
+    }
+
+    for (int i = userTxStartIdx; i < (int)block.vtx.size(); i++) {
+        for (int j = 0; j < (int)block.vtx[i].vout.size(); j++) {
+            if (!block.vtx[i].vout[j].commitment.empty() && (secp256k1_rand32() % 100) <= CWallet::PROBABILITY_NEW_COIN_SELECTED) {
+                //add new user transaction to the pool
+                userDecoysPool.Add(COutPoint(block.vtx[i].GetHash(), j), hashBlock, CWallet::MAX_DECOY_POOL, secp256k1_rand32());
+            }
+        }
+    }
+
+    // Keep the coinbase candidates of this block until they mature, so they need not be read back from disk
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    if (mi != mapBlockIndex.end() && mi->second) {
+        mapImmatureCoinbaseDecoys[mi->second->nHeight] = std::make_pair(hashBlock, GetCoinbaseDecoyCandidates(block));
+    }
+
+    int nMatureHeight = chainActive.Height() - Params().COINBASE_MATURITY();
+    if (nMatureHeight > 0) {
+        CBlockIndex* p = chainActive[nMatureHeight];
+        std::vector<COutPoint> vMature;
+        std::map<int, std::pair<uint256, std::vector<COutPoint> > >::const_iterator it = mapImmatureCoinbaseDecoys.find(nMatureHeight);
+        if (it != mapImmatureCoinbaseDecoys.end() && it->second.first == p->GetBlockHash()) {
+            vMature = it->second.second;
+        } else {
+            // Blocks connected before startup or replaced by a reorganization are not in the buckets
             CBlock b;
-            if (ReadBlockFromDisk(b, p)) {
-                int coinbaseIdx = 0;
-                if (p->IsProofOfStake()) {
-                    coinbaseIdx = 1;
+            if (ReadBlockFromDisk(b, p)) vMature = GetCoinbaseDecoyCandidates(b);
+        }
+        for (const COutPoint& outpoint : vMature) {
+            if ((secp256k1_rand32() % 100) <= CWallet::PROBABILITY_NEW_COIN_SELECTED) {
+                //add new coinbase transaction to the pool
+                coinbaseDecoysPool.Add(outpoint, p->GetBlockHash(), CWallet::MAX_DECOY_POOL, secp256k1_rand32());
+            }
+        }
+        mapImmatureCoinbaseDecoys.erase(mapImmatureCoinbaseDecoys.begin(), mapImmatureCoinbaseDecoys.upper_bound(nMatureHeight));
+    }
+    LogPrintf("%s: Coinbase decoys = %d, user decoys = %d\n", __func__, coinbaseDecoysPool.size(), userDecoysPool.size());
+}
+
+void CWallet::RemoveBlockDecoys(const CBlock& block, int nHeight)
+{
+    LOCK2(cs_main, cs_wallet);
+    // The outputs of a disconnected block no longer exist
+    userDecoysPool.EraseBlock(block.GetHash());
+    coinbaseDecoysPool.EraseBlock(block.GetHash());
+    mapImmatureCoinbaseDecoys.erase(nHeight);
+
+    // The coinbase outputs that matured with this block are immature again
+    int nMatureHeight = nHeight - Params().COINBASE_MATURITY();
+    if (nMatureHeight > 0 && chainActive[nMatureHeight])
+        coinbaseDecoysPool.EraseBlock(chainActive[nMatureHeight]->GetBlockHash());
+}
+
+void CWallet::FillCoinbaseDecoysPool()
+{
+    int nHeight;
+    int nStopHeight;
+    {
+        LOCK2(cs_main, cs_wallet);
+        if (coinbaseDecoysPool.size() > MIN_COINBASE_DECOY_POOL) return;
+        // Resume below the blocks read by the previous fill, from the tip again once it reached the genesis block
+        nHeight = chainActive.Height() - Params().COINBASE_MATURITY();
+        if (nCoinbaseDecoysFillHeight > 0 && nCoinbaseDecoysFillHeight <= nHeight)
+            nHeight = nCoinbaseDecoysFillHeight;
+        nStopHeight = std::max(0, nHeight - MAX_COINBASE_DECOY_FILL_BLOCKS);
+    }
+    for (; nHeight > nStopHeight; nHeight--) {
+        CBlockIndex* p;
+        {
+            LOCK2(cs_main, cs_wallet);
+            if (coinbaseDecoysPool.size() > MIN_COINBASE_DECOY_POOL) break;
+            p = chainActive[nHeight];
+        }
+        if (!p) continue;
+        // Read the block without holding the locks, so that sends are not held up by the disk
+        CBlock b;
+        if (!ReadBlockFromDisk(b, p)) continue;
+        LOCK2(cs_main, cs_wallet);
+        for (const COutPoint& newOutPoint : GetCoinbaseDecoyCandidates(b)) {
+            if ((secp256k1_rand32() % 100) <= CWallet::PROBABILITY_NEW_COIN_SELECTED) {
+                if (coinbaseDecoysPool.Contains(newOutPoint)) {
+                    continue;
                 }
-                //dont select poa as decoy
-                if (b.posBlocksAudited.size() > 0) continue;
-                CTransaction& coinbase = b.vtx[coinbaseIdx];
-
-                for (size_t i = 0; i < coinbase.vout.size(); i++) {
-                    if (!coinbase.vout[i].IsNull() && !coinbase.vout[i].commitment.empty() && coinbase.vout[i].nValue > 0 && !coinbase.vout[i].IsEmpty()) {
-                        if ((secp256k1_rand32() % 100) <= CWallet::PROBABILITY_NEW_COIN_SELECTED) {
-                            COutPoint newOutPoint(coinbase.GetHash(), i);
-                            if (coinbaseDecoysPool.count(newOutPoint) == 1) {
-                                continue;
-                            }
-                            if (!ValidOutPoint(newOutPoint)) {
-                                break;
-                            }
-                            //add new coinbase transaction to the pool
-                            if (coinbaseDecoysPool.size() >= CWallet::MAX_DECOY_POOL) {
-                                int selected = secp256k1_rand32() % CWallet::MAX_DECOY_POOL;
-                                std::map<COutPoint, uint256>::const_iterator it = std::next(coinbaseDecoysPool.begin(), selected);
-                                coinbaseDecoysPool[newOutPoint] = p->GetBlockHash();
-                            } else {
-                                coinbaseDecoysPool[newOutPoint] = p->GetBlockHash();
-                            }
-                        }
-                    }
+                if (!ValidOutPoint(newOutPoint)) {
+                    break;
                 }
+                //add new coinbase transaction to the pool
+                coinbaseDecoysPool.Add(newOutPoint, p->GetBlockHash(), CWallet::MAX_DECOY_POOL, secp256k1_rand32());
             }
         }
     }
+    LOCK(cs_wallet);
+    nCoinbaseDecoysFillHeight = nHeight;
+}
+
+bool CWallet::selectDecoysAndRealIndex(CTransaction& tx, int& myIndex, int ringSize)
+{
+    LogPrintf("Selecting coinbase decoys for transaction\n");
+    // The pools are only read here; blocks are read from disk by the background fill, never under the send locks
+    LOCK2(cs_main, cs_wallet);
     //Choose decoys
     myIndex = -1;
     for (size_t i = 0; i < tx.vin.size(); i++) {
@@ -4059,13 +4480,13 @@ bool CWallet::selectDecoysAndRealIndex(CTransaction& tx, int& myIndex, int ringS
                 while (numDecoys < ringSize) {
                     bool duplicated = false;
                     bool invalid = false;
-                    std::map<COutPoint, uint256>::const_iterator it = std::next(coinbaseDecoysPool.begin(), secp256k1_rand32() % coinbaseDecoysPool.size());
-                    if (mapBlockIndex.count(it->second) < 1) continue;
-                    CBlockIndex* atTheblock = mapBlockIndex[it->second];
+                    const CDecoyPool::Entry& decoy = coinbaseDecoysPool[secp256k1_rand32() % coinbaseDecoysPool.size()];
+                    if (mapBlockIndex.count(decoy.second) < 1) continue;
+                    CBlockIndex* atTheblock = mapBlockIndex[decoy.second];
                     if (!atTheblock || !chainActive.Contains(atTheblock)) continue;
                     if (!chainActive.Contains(atTheblock)) continue;
                     if (1 + chainActive.Height() - atTheblock->nHeight < DecoyConfirmationMinimum) continue;
-                    COutPoint outpoint = it->first;
+                    COutPoint outpoint = decoy.first;
                     for (size_t d = 0; d < tx.vin[i].decoys.size(); d++) {
                         if (tx.vin[i].decoys[d] == outpoint) {
                             duplicated = true;
@@ -4085,13 +4506,13 @@ bool CWallet::selectDecoysAndRealIndex(CTransaction& tx, int& myIndex, int ringS
                 }
             } else if ((int)coinbaseDecoysPool.size() >= ringSize) {
                 for (size_t j = 0; j < coinbaseDecoysPool.size(); j++) {
-                    std::map<COutPoint, uint256>::const_iterator it = std::next(coinbaseDecoysPool.begin(), j);
-                    if (mapBlockIndex.count(it->second) < 1) continue;
-                    CBlockIndex* atTheblock = mapBlockIndex[it->second];
+                    const CDecoyPool::Entry& decoy = coinbaseDecoysPool[j];
+                    if (mapBlockIndex.count(decoy.second) < 1) continue;
+                    CBlockIndex* atTheblock = mapBlockIndex[decoy.second];
                     if (!atTheblock || !chainActive.Contains(atTheblock)) continue;
                     if (!chainActive.Contains(atTheblock)) continue;
                     if (1 + chainActive.Height() - atTheblock->nHeight < DecoyConfirmationMinimum) continue;
-                    COutPoint outpoint = it->first;
+                    COutPoint outpoint = decoy.first;
                     if (!ValidOutPoint(outpoint)) {
                         break;
                     }
@@ -4104,19 +4525,23 @@ bool CWallet::selectDecoysAndRealIndex(CTransaction& tx, int& myIndex, int ringS
                 return false;
             }
         } else {
-            std::map<COutPoint, uint256> decoySet = userDecoysPool;
-            decoySet.insert(coinbaseDecoysPool.begin(), coinbaseDecoysPool.end());
-            if ((int)decoySet.size() >= ringSize * 5) {
+            // User outputs and coinbase outputs are disjoint, so both pools are sampled as one set without copying
+            const size_t nUserDecoys = userDecoysPool.size();
+            const size_t nDecoySet = nUserDecoys + coinbaseDecoysPool.size();
+            auto decoyAt = [&](size_t nPos) -> const CDecoyPool::Entry& {
+                return nPos < nUserDecoys ? userDecoysPool[nPos] : coinbaseDecoysPool[nPos - nUserDecoys];
+            };
+            if ((int)nDecoySet >= ringSize * 5) {
                 while (numDecoys < ringSize) {
                     bool duplicated = false;
                     bool invalid = false;
-                    std::map<COutPoint, uint256>::const_iterator it = std::next(decoySet.begin(), secp256k1_rand32() % decoySet.size());
-                    if (mapBlockIndex.count(it->second) < 1) continue;
-                    CBlockIndex* atTheblock = mapBlockIndex[it->second];
+                    const CDecoyPool::Entry& decoy = decoyAt(secp256k1_rand32() % nDecoySet);
+                    if (mapBlockIndex.count(decoy.second) < 1) continue;
+                    CBlockIndex* atTheblock = mapBlockIndex[decoy.second];
                     if (!atTheblock || !chainActive.Contains(atTheblock)) continue;
                     if (!chainActive.Contains(atTheblock)) continue;
                     if (1 + chainActive.Height() - atTheblock->nHeight < DecoyConfirmationMinimum) continue;
-                    COutPoint outpoint = it->first;
+                    COutPoint outpoint = decoy.first;
                     for (size_t d = 0; d < tx.vin[i].decoys.size(); d++) {
                         if (tx.vin[i].decoys[d] == outpoint) {
                             duplicated = true;
@@ -4134,15 +4559,15 @@ bool CWallet::selectDecoysAndRealIndex(CTransaction& tx, int& myIndex, int ringS
                     tx.vin[i].decoys.push_back(outpoint);
                     numDecoys++;
                 }
-            } else if ((int)decoySet.size() >= ringSize) {
-                for (size_t j = 0; j < decoySet.size(); j++) {
-                    std::map<COutPoint, uint256>::const_iterator it = std::next(decoySet.begin(), j);
-                    if (mapBlockIndex.count(it->second) < 1) continue;
-                    CBlockIndex* atTheblock = mapBlockIndex[it->second];
+            } else if ((int)nDecoySet >= ringSize) {
+                for (size_t j = 0; j < nDecoySet; j++) {
+                    const CDecoyPool::Entry& decoy = decoyAt(j);
+                    if (mapBlockIndex.count(decoy.second) < 1) continue;
+                    CBlockIndex* atTheblock = mapBlockIndex[decoy.second];
                     if (!atTheblock || !chainActive.Contains(atTheblock)) continue;
                     if (!chainActive.Contains(atTheblock)) continue;
                     if (1 + chainActive.Height() - atTheblock->nHeight < DecoyConfirmationMinimum) continue;
-                    COutPoint outpoint = it->first;
+                    COutPoint outpoint = decoy.first;
                     if (!ValidOutPoint(outpoint)) {
                         break;
                     }
@@ -4288,10 +4713,12 @@ bool CWallet::CreateCoinStake(
     CAmount nCredit;
     CScript scriptPubKeyKernel;
     bool fKernelFound = false;
-    int nAttempts = 0;
+
+    // Lay out the kernel of every input once, then sweep the timestamps across all of them
+    nTxNewTime = GetAdjustedTime();
+    CKernelSearch kernelSearch(nTxNewTime);
     for (std::unique_ptr<CStakeInput>& stakeInput : listInputs) {
         // Make sure the wallet is unlocked and shutdown hasn't been requested
-        nCredit = 0;
         if (IsLocked() || ShutdownRequested())
             return false;
 
@@ -4301,65 +4728,60 @@ bool CWallet::CreateCoinStake(
             LogPrintf("CreateCoinStake(): no pindexfrom\n");
             continue;
         }
+        kernelSearch.AddInput(stakeInput.get(), pindex->GetBlockTime());
+    }
 
-        // Read block header
-        CBlockHeader block = pindex->GetBlockHeader();
-        uint256 hashProofOfStake = 0;
-        nTxNewTime = GetAdjustedTime();
+    //Double check that the kernel will pass time requirements
+    const unsigned int nTimeMin = Params().IsRegTestNet() ? 0 : chainActive.Tip()->GetMedianTimePast();
+    CStakeInput* stakeInput = nullptr;
+    uint256 hashProofOfStake = 0;
+    while (!fKernelFound && kernelSearch.Search(nBits, nTimeMin, stakeInput, nTxNewTime, hashProofOfStake)) {
+        if (IsLocked() || ShutdownRequested())
+            return false;
 
-        nAttempts++;
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (Stake(stakeInput.get(), nBits, block.GetBlockTime(), nTxNewTime, hashProofOfStake)) {
-            //Double check that this will pass time requirements
-            if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast() && !Params().IsRegTestNet()) {
-                LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
-                continue;
-            }
+        // Found a kernel
+        LogPrintf("CreateCoinStake : kernel found\n");
+        nCredit = stakeInput->GetValue();
+        std::vector<CTxOut> vout;
+        if (!stakeInput->CreateTxOuts(this, vout, nCredit)) {
+            LogPrintf("%s : failed to get scriptPubKey\n", __func__);
+            kernelSearch.RemoveInput(stakeInput);
+            continue;
+        }
+        txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
 
-            // Found a kernel
-            LogPrintf("CreateCoinStake : kernel found\n");
-            nCredit += stakeInput->GetValue();
-            std::vector<CTxOut> vout;
-            if (!stakeInput->CreateTxOuts(this, vout, nCredit)) {
-                LogPrintf("%s : failed to get scriptPubKey\n", __func__);
-                continue;
-            }
-            txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
-
-            // Calculate reward
-            CAmount nReward;
-            nReward = GetBlockValue(chainActive.Height());
-            txNew.vout[1].nValue = nCredit;
-            txNew.vout[2].nValue = nReward;
-
-            // Limit size
-            unsigned int nBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5)
-                return error("CreateCoinStake : exceeded coinstake size limit");
-
-            //Masternode payment
-            if (!FillBlockPayee(txNew, 0, true)) {
-                LogPrintf("%s: Cannot fill block payee\n", __func__);
-                return false;
-            }
+        // Calculate reward
+        CAmount nReward;
+        nReward = GetBlockValue(chainActive.Height());
+        txNew.vout[1].nValue = nCredit;
+        txNew.vout[2].nValue = nReward;
 
-            uint256 hashTxOut = txNew.GetHash();
-            CTxIn in;
-            if (!stakeInput->CreateTxIn(this, in, hashTxOut)) {
-                LogPrintf("%s : failed to create TxIn\n", __func__);
-                txNew.vin.clear();
-                txNew.vout.clear();
-                continue;
-            }
-            txNew.vin.push_back(in);
+        // Limit size
+        unsigned int nBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
+        if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5)
+            return error("CreateCoinStake : exceeded coinstake size limit");
 
-            fKernelFound = true;
-            break;
+        //Masternode payment
+        if (!FillBlockPayee(txNew, 0, true)) {
+            LogPrintf("%s: Cannot fill block payee\n", __func__);
+            return false;
         }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+
+        uint256 hashTxOut = txNew.GetHash();
+        CTxIn in;
+        if (!stakeInput->CreateTxIn(this, in, hashTxOut)) {
+            LogPrintf("%s : failed to create TxIn\n", __func__);
+            // back to the coinstake marker, the outputs of the next kernel start at vout[1] again
+            txNew.vin.clear();
+            txNew.vout.assign(1, CTxOut(0, scriptEmpty));
+            kernelSearch.RemoveInput(stakeInput);
+            continue;
+        }
+        txNew.vin.push_back(in);
+
+        fKernelFound = true;
     }
-    LogPrint(BCLog::STAKING, "%s: attempted staking %d times\n", __func__, nAttempts);
+    LogPrint(BCLog::STAKING, "%s: searched %d stake inputs\n", __func__, kernelSearch.size());
     if (!fKernelFound)
         return false;
 
@@ -4494,6 +4916,14 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
         return nLoadWalletRet;
     fFirstRunRet = !vchDefaultKey.IsValid();
 
+    if (IsCrypted() && !amountMap.empty()) {
+        // Drop plaintext amounts an encrypted wallet should never have kept on disk
+        LOCK(cs_wallet);
+        CWalletDB walletdb(strWalletFile);
+        for (const std::pair<const CScript, CAmount>& entry : amountMap)
+            walletdb.EraseOutputAmount(entry.first);
+    }
+
     uiInterface.LoadWallet(this);
     ScanWalletKeyImages();
 
@@ -4738,6 +5168,7 @@ void CWallet::CreatePrivacyAccount(bool forceNew)
             }
 
             walletdb.AppendStealthAccountList("masteraccount");
+            MarkStealthAccountsDirty();
             break;
         }
     }
@@ -4995,18 +5426,21 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    MarkBalancesDirty();
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    MarkBalancesDirty();
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    MarkBalancesDirty();
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
@@ -5355,6 +5789,7 @@ bool CWallet::SendAll(std::string des, CWalletTx& wtxNew, bool inclLocked)
                                 break;
                             }
 
+                            CBulletProofTask proofTask(wtxNew);
                             if (!makeRingCT(wtxNew, ringSize, strFailReason)) {
                                 strFailReason = _("Failed to generate RingCT");
                                 ret = false;
@@ -5362,7 +5797,7 @@ bool CWallet::SendAll(std::string des, CWalletTx& wtxNew, bool inclLocked)
                                 throw std::runtime_error(strFailReason);
                             }
 
-                            if (ret && !generateBulletProofAggregate(wtxNew)) {
+                            if (ret && !proofTask.Finish(wtxNew)) {
                                 strFailReason = _("Failed to generate bulletproof");
                                 ret = false;
                                 LogPrintf("%s: %s\n", __func__, strFailReason);
@@ -5386,6 +5821,7 @@ bool CWallet::SendAll(std::string des, CWalletTx& wtxNew, bool inclLocked)
                                         inSpendQueueOutpoints[inSpendQueueOutpointsPerSession[i]] = true;
                                     }
                                     inSpendQueueOutpointsPerSession.clear();
+                                    MarkBalancesDirty();
 
                                     uint256 hash = wtxNew.GetHash();
                                     int maxTxPrivKeys = txPrivKeys.size() > wtxNew.vout.size() ? wtxNew.vout.size() : txPrivKeys.size();
@@ -5619,11 +6055,12 @@ bool CWallet::CreateSweepingTransaction(CAmount target, CAmount threshold, uint3
                             }
 
                             std::string strFailReason;
+                            CBulletProofTask proofTask(wtxNew);
                             if (!makeRingCT(wtxNew, ringSize, strFailReason)) {
                                 ret = false;
                             }
 
-                            if (ret && !generateBulletProofAggregate(wtxNew)) {
+                            if (ret && !proofTask.Finish(wtxNew)) {
                                 strFailReason = _("There is an internal error in generating bulletproofs. Please try again later.");
                                 ret = false;
                             }
@@ -5642,6 +6079,7 @@ bool CWallet::CreateSweepingTransaction(CAmount target, CAmount threshold, uint3
                                         inSpendQueueOutpoints[inSpendQueueOutpointsPerSession[i]] = true;
                                     }
                                     inSpendQueueOutpointsPerSession.clear();
+                                    MarkBalancesDirty();
 
                                     uint256 hash = wtxNew.GetHash();
                                     int maxTxPrivKeys = txPrivKeys.size() > wtxNew.vout.size() ? wtxNew.vout.size() : txPrivKeys.size();
@@ -6639,82 +7077,164 @@ bool CWallet::SendToStealthAddress(const std::string& stealthAddr, const CAmount
     return true;
 }
 
-bool CWallet::IsTransactionForMe(const CTransaction& tx)
+void CWallet::LockSentOutput(const std::string& stealthAddr, CAmount nValue, const CWalletTx& wtx)
 {
+    // Only an output to ourself can be locked
+    std::string myAddress;
+    ComputeStealthPublicAddress("masteraccount", myAddress);
+    if (stealthAddr != myAddress)
+        return;
+
     LOCK(cs_wallet);
+    for (int i = 0; i < (int)wtx.vout.size(); i++) {
+        if (getCTxOutValue(wtx, wtx.vout[i]) == nValue) {
+            COutPoint collateralOut(wtx.GetHash(), i);
+            LockCoin(collateralOut);
+            LogPrintf("Output transaction: %s:%i has been locked\n", wtx.GetHash().GetHex().c_str(), i);
+        }
+    }
+}
+
+std::string CSendJob::GetStatusString() const
+{
+    switch (status) {
+    case QUEUED:
+        return "queued";
+    case RUNNING:
+        return "running";
+    case SENT:
+        return "sent";
+    case FAILED:
+        return "failed";
+    }
+    return "unknown";
+}
+
+int64_t CWallet::QueueSendToStealthAddress(const std::string& stealthAddr, CAmount nValue, bool fLockOutput)
+{
+    int64_t nJobId;
     {
-        std::vector<CKey> spends, views;
-        if (!allMyPrivateKeys(spends, views) || spends.size() != views.size()) {
-            spends.clear();
-            views.clear();
-            CKey spend, view;
-            if (!mySpendPrivateKey(spend) || !myViewPrivateKey(view)) {
-                LogPrintf("Failed to find private keys\n");
-                return false;
+        LOCK(cs_sendJobs);
+        nJobId = ++nLastSendJobId;
+        mapSendJobs.emplace(nJobId, CSendJob(stealthAddr, nValue, fLockOutput));
+        queueSendJobs.push_back(nJobId);
+    }
+    condSendJobs.notify_one();
+    return nJobId;
+}
+
+bool CWallet::GetSendJob(int64_t nJobId, CSendJob& job)
+{
+    LOCK(cs_sendJobs);
+    std::map<int64_t, CSendJob>::const_iterator it = mapSendJobs.find(nJobId);
+    if (it == mapSendJobs.end())
+        return false;
+    job = it->second;
+    return true;
+}
+
+void CWallet::ThreadSendQueue()
+{
+    while (true) {
+        int64_t nJobId;
+        CSendJob job;
+        {
+            WAIT_LOCK(cs_sendJobs, lock);
+            while (queueSendJobs.empty()) {
+                condSendJobs.wait_for(lock, std::chrono::milliseconds(500));
+                boost::this_thread::interruption_point();
             }
-            spends.push_back(spend);
-            views.push_back(view);
+            nJobId = queueSendJobs.front();
+            queueSendJobs.pop_front();
+            CSendJob& queued = mapSendJobs[nJobId];
+            queued.status = CSendJob::RUNNING;
+            job = queued;
         }
-        for (const CTxOut& out : tx.vout) {
-            if (out.IsEmpty()) {
-                continue;
-            }
-            CPubKey txPub(out.txPub);
-            for (size_t i = 0; i < spends.size(); i++) {
-                CKey& spend = spends[i];
-                CKey& view = views[i];
-                const CPubKey& pubSpendKey = spend.GetPubKey();
-                bool ret = false;
-
-                //compute the tx destination
-                //P' = Hs(aR)G+B, a = view private, B = spend pub, R = tx public key
-                unsigned char aR[65];
-                //copy R into a
-                memcpy(aR, txPub.begin(), txPub.size());
-                if (!secp256k1_ec_pubkey_tweak_mul(aR, txPub.size(), view.begin())) {
-                    return false;
-                }
-                uint256 HS = Hash(aR, aR + txPub.size());
-                unsigned char* pHS = HS.begin();
-                unsigned char expectedDestination[65];
-                memcpy(expectedDestination, pubSpendKey.begin(), pubSpendKey.size());
-                if (!secp256k1_ec_pubkey_tweak_add(expectedDestination, pubSpendKey.size(), pHS)) {
-                    continue;
-                }
-                CPubKey expectedDes(expectedDestination, expectedDestination + 33);
-                CScript scriptPubKey = GetScriptForDestination(expectedDes);
 
-                if (scriptPubKey == out.scriptPubKey) {
-                    ret = true;
-                }
+        CWalletTx wtx;
+        std::string strError = "Cannot create transaction.";
+        bool fSent = false;
+        try {
+            fSent = SendToStealthAddress(job.strStealthAddr, job.nValue, wtx);
+            if (fSent && job.fLockOutput)
+                LockSentOutput(job.strStealthAddr, job.nValue, wtx);
+        } catch (const std::exception& e) {
+            strError = e.what();
+        }
+
+        LOCK(cs_sendJobs);
+        CSendJob& finished = mapSendJobs[nJobId];
+        if (fSent) {
+            finished.status = CSendJob::SENT;
+            finished.txid = wtx.GetHash();
+        } else {
+            finished.status = CSendJob::FAILED;
+            finished.strError = strError;
+        }
+        // Forget the oldest finished jobs
+        while (mapSendJobs.size() > MAX_SEND_JOBS && mapSendJobs.begin()->second.status >= CSendJob::SENT)
+            mapSendJobs.erase(mapSendJobs.begin());
+    }
+}
 
-                if (ret) {
-                    //Compute private key to spend
-                    //x = Hs(aR) + b, b = spend private key
-                    unsigned char HStemp[32];
-                    unsigned char spendTemp[32];
-                    memcpy(HStemp, HS.begin(), 32);
-                    memcpy(spendTemp, spend.begin(), 32);
-                    if (!secp256k1_ec_privkey_tweak_add(HStemp, spendTemp))
-                        throw std::runtime_error("Failed to do secp256k1_ec_privkey_tweak_add");
-                    CKey privKey;
-                    privKey.Set(HStemp, HStemp + 32, true);
-                    CPubKey computed = privKey.GetPubKey();
-
-                    //put in map from address to txHash used for qt wallet
-                    CKeyID tempKeyID = computed.GetID();
-                    addrToTxHashMap[CBitcoinAddress(tempKeyID).ToString()] = tx.GetHash().GetHex();
-                    AddKey(privKey);
-                    CAmount c;
-                    CKey blind;
-                    RevealTxOutAmount(tx, out, c, blind);
-                }
-            }
+bool CWallet::loadStealthScanKeys()
+{
+    AssertLockHeld(cs_wallet);
+    if (!stealthScanKeys.spends.empty())
+        return true;
+    std::vector<CKey> spends, views;
+    if (!allMyPrivateKeys(spends, views) || spends.size() != views.size()) {
+        spends.clear();
+        views.clear();
+        CKey spend, view;
+        if (!mySpendPrivateKey(spend) || !myViewPrivateKey(view)) {
+            LogPrintf("Failed to find private keys\n");
+            return false;
         }
+        spends.push_back(spend);
+        views.push_back(view);
     }
+    stealthScanKeys.spends = spends;
+    stealthScanKeys.views = views;
+    for (const CKey& spend : spends)
+        stealthScanKeys.spendPubKeys.push_back(spend.GetPubKey());
     return true;
 }
 
+void CWallet::MarkStealthAccountsDirty()
+{
+    LOCK(cs_wallet);
+    stealthScanKeys.clear();
+}
+
+void CWallet::addStealthOutputs(const CTransaction& tx, const std::vector<std::pair<unsigned int, CKey> >& vStealthOutputs)
+{
+    AssertLockHeld(cs_wallet);
+    for (const std::pair<unsigned int, CKey>& found : vStealthOutputs) {
+        const CKey& privKey = found.second;
+        CPubKey computed = privKey.GetPubKey();
+
+        //put in map from address to txHash used for qt wallet
+        CKeyID tempKeyID = computed.GetID();
+        addrToTxHashMap[CBitcoinAddress(tempKeyID).ToString()] = tx.GetHash().GetHex();
+        AddKey(privKey);
+        CAmount c;
+        CKey blind;
+        RevealTxOutAmount(tx, tx.vout[found.first], c, blind);
+    }
+}
+
+bool CWallet::IsTransactionForMe(const CTransaction& tx)
+{
+    LOCK(cs_wallet);
+    if (!loadStealthScanKeys())
+        return false;
+    std::vector<std::vector<std::pair<unsigned int, CKey> > > vStealthOutputs;
+    bool ret = FindStealthOutputs(std::vector<const CTransaction*>(1, &tx), stealthScanKeys, vStealthOutputs);
+    addStealthOutputs(tx, vStealthOutputs[0]);
+    return ret;
+}
+
 bool CWallet::AllMyPublicAddresses(std::vector<std::string>& addresses, std::vector<std::string>& accountNames)
 {
     std::string labelList;
@@ -6981,6 +7501,17 @@ bool CWallet::myViewPrivateKey(CKey& view) const
     return true;
 }
 
+/** The key an output pays to; wallet outputs pay to a public key, so no key has to be derived to find it */
+static bool GetPayToPubKeyID(const CScript& scriptPubKey, CKeyID& keyID)
+{
+    txnouttype whichType;
+    std::vector<std::vector<unsigned char> > vSolutions;
+    if (!Solver(scriptPubKey, whichType, vSolutions) || whichType != TX_PUBKEY)
+        return false;
+    keyID = CPubKey(vSolutions[0]).GetID();
+    return true;
+}
+
 bool CWallet::RevealTxOutAmount(const CTransaction& tx, const CTxOut& out, CAmount& amount, CKey& blind) const
 {
     if (IsLocked()) {
@@ -7005,35 +7536,31 @@ bool CWallet::RevealTxOutAmount(const CTransaction& tx, const CTxOut& out, CAmou
         return true;
     }
 
-    std::set<CKeyID> keyIDs;
-    GetKeys(keyIDs);
+    CKeyID keyID;
     CPubKey sharedSec;
-    for (const CKeyID& keyID : keyIDs) {
-        CKey privKey;
-        GetKey(keyID, privKey);
-        CScript scriptPubKey = GetScriptForDestination(privKey.GetPubKey());
-        if (scriptPubKey == out.scriptPubKey) {
-            CPubKey txPub(&(out.txPub[0]), &(out.txPub[0]) + 33);
-            CKey view;
-            if (myViewPrivateKey(view)) {
-                computeSharedSec(tx, out, sharedSec);
-                uint256 val = out.maskValue.amount;
-                uint256 mask = out.maskValue.mask;
-                CKey decodedMask;
-                ECDHInfo::Decode(mask.begin(), val.begin(), sharedSec, decodedMask, amount);
-                std::vector<unsigned char> commitment;
-                if (CreateCommitment(decodedMask.begin(), amount, commitment)) {
-                    //make sure the amount and commitment are matched
-                    if (commitment == out.commitment) {
-                        amountMap[out.scriptPubKey] = amount;
-                        blindMap[out.scriptPubKey] = decodedMask;
-                        blind.Set(blindMap[out.scriptPubKey].begin(), blindMap[out.scriptPubKey].end(), true);
-                        return true;
-                    } else {
-                        amount = 0;
-                        amountMap[out.scriptPubKey] = amount;
-                        return false;
-                    }
+    if (GetPayToPubKeyID(out.scriptPubKey, keyID) && CCryptoKeyStore::HaveKey(keyID)) {
+        CPubKey txPub(&(out.txPub[0]), &(out.txPub[0]) + 33);
+        CKey view;
+        if (myViewPrivateKey(view)) {
+            computeSharedSec(tx, out, sharedSec);
+            uint256 val = out.maskValue.amount;
+            uint256 mask = out.maskValue.mask;
+            CKey decodedMask;
+            ECDHInfo::Decode(mask.begin(), val.begin(), sharedSec, decodedMask, amount);
+            std::vector<unsigned char> commitment;
+            if (CreateCommitment(decodedMask.begin(), amount, commitment)) {
+                //make sure the amount and commitment are matched
+                if (commitment == out.commitment) {
+                    amountMap[out.scriptPubKey] = amount;
+                    blindMap[out.scriptPubKey] = decodedMask;
+                    blind.Set(blindMap[out.scriptPubKey].begin(), blindMap[out.scriptPubKey].end(), true);
+                    if (fFileBacked && !IsCrypted())
+                        setUnsavedOutputAmounts.insert(out.scriptPubKey);
+                    return true;
+                } else {
+                    amount = 0;
+                    amountMap[out.scriptPubKey] = amount;
+                    return false;
                 }
             }
         }
@@ -7044,18 +7571,10 @@ bool CWallet::RevealTxOutAmount(const CTransaction& tx, const CTxOut& out, CAmou
 
 bool CWallet::findCorrespondingPrivateKey(const CTxOut& txout, CKey& key) const
 {
-    std::set<CKeyID> keyIDs;
-    GetKeys(keyIDs);
-    for (const CKeyID& keyID : keyIDs) {
-        CBitcoinAddress address(keyID);
-        GetKey(keyID, key);
-        CPubKey pub = key.GetPubKey();
-        CScript script = GetScriptForDestination(pub);
-        if (script == txout.scriptPubKey) {
-            return true;
-        }
-    }
-    return false;
+    CKeyID keyID;
+    if (!GetPayToPubKeyID(txout.scriptPubKey, keyID) || !CCryptoKeyStore::HaveKey(keyID))
+        return false;
+    return GetKey(keyID, key);
 }
 
 bool CWallet::generateKeyImage(const CScript& scriptPubKey, CKeyImage& img) const
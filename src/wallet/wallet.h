@@ -27,6 +27,8 @@
 
 #include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
 #include <set>
@@ -73,6 +75,14 @@ static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWa
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 //! -custombackupthreshold default
 static const int DEFAULT_CUSTOMBACKUPTHRESHOLD = 1;
+//! -rescanthreads default (number of threads scanning blocks for stealth outputs during a rescan, 0 = auto)
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Maximum number of threads scanning blocks during a rescan
+static const int MAX_RESCAN_THREADS = 16;
+//! Seconds between background refills of the coinbase decoy pool
+static const int64_t DECOY_POOL_FILL_INTERVAL = 60;
+//! Maximum number of blocks read by one background refill of the coinbase decoy pool
+static const int MAX_COINBASE_DECOY_FILL_BLOCKS = 1000;
 
 //Default Transaction Retention N-BLOCKS
 static const int DEFAULT_TX_DELETE_INTERVAL = 10000;
@@ -236,6 +246,79 @@ enum CombineMode {
     ON,
 };
 
+/** Private keys of the stealth accounts outputs are scanned for, with their public spend keys */
+struct CStealthScanKeys {
+    std::vector<CKey> spends;
+    std::vector<CKey> views;
+    std::vector<CPubKey> spendPubKeys;
+
+    void clear()
+    {
+        spends.clear();
+        views.clear();
+        spendPubKeys.clear();
+    }
+};
+
+/** Wallet balances of every category, as computed by one pass over the wallet transactions */
+struct CWalletBalances {
+    CAmount nTrusted = 0;
+    //! Trusted balance without immature coinbase and coinstake credit, before locked coins are taken off
+    CAmount nMature = 0;
+    CAmount nUnconfirmed = 0;
+    CAmount nImmature = 0;
+    CAmount nLocked = 0;
+    CAmount nUnlocked = 0;
+    CAmount nWatchOnly = 0;
+    CAmount nUnconfirmedWatchOnly = 0;
+    CAmount nImmatureWatchOnly = 0;
+};
+
+/** A send to a stealth address queued by sendtostealthaddress in asynchronous mode */
+struct CSendJob {
+    enum Status {
+        QUEUED,
+        RUNNING,
+        SENT,
+        FAILED
+    };
+
+    std::string strStealthAddr;
+    CAmount nValue;
+    bool fLockOutput;
+    Status status;
+    uint256 txid;
+    std::string strError;
+
+    CSendJob() : nValue(0), fLockOutput(false), status(QUEUED) {}
+    CSendJob(const std::string& stealthAddr, CAmount value, bool lockOutput) : strStealthAddr(stealthAddr), nValue(value), fLockOutput(lockOutput), status(QUEUED) {}
+
+    std::string GetStatusString() const;
+};
+
+/**
+ * Outputs that may be picked as ring decoys, each with the hash of the block it was added for.
+ * The entries are kept in a vector so that a random one is picked in constant time.
+ */
+class CDecoyPool
+{
+public:
+    typedef std::pair<COutPoint, uint256> Entry;
+
+    size_t size() const { return vEntries.size(); }
+    bool Contains(const COutPoint& outpoint) const { return mapPositions.count(outpoint) > 0; }
+    const Entry& operator[](size_t nPos) const { return vEntries[nPos]; }
+    //! Add an outpoint unless it is already in the pool, replacing the entry at nRand % size() once nMaxSize is reached
+    void Add(const COutPoint& outpoint, const uint256& hashBlock, size_t nMaxSize, uint32_t nRand);
+    void Erase(const COutPoint& outpoint);
+    //! Erase the entries added for the block hashBlock
+    void EraseBlock(const uint256& hashBlock);
+
+private:
+    std::vector<Entry> vEntries;
+    std::map<COutPoint, size_t> mapPositions;
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -271,8 +354,43 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    //! Stealth account keys, loaded on first use while the wallet is unlocked
+    CStealthScanKeys stealthScanKeys;
+
+    //! Bumped whenever a wallet transaction, its depth or the spent state of its outputs may have changed
+    std::atomic<uint64_t> nBalancesGeneration{0};
+    //! Balances of the generation nCachedBalancesGeneration and mempool state nCachedMempoolUpdated, guarded by cs_balances
+    mutable Mutex cs_balances;
+    mutable CWalletBalances cachedBalances;
+    mutable uint64_t nCachedBalancesGeneration{0};
+    mutable unsigned int nCachedMempoolUpdated{0};
+    mutable bool fBalancesCached{false};
+
+    /**
+     * Outputs of wallet transactions that are ours and not known to be spent, with their decoded
+     * amounts, ordered by value. Transactions added or changed since the last AvailableCoins call
+     * wait in setSpendableOutputsPending, since amounts can only be decoded while the wallet is unlocked.
+     */
+    std::set<std::pair<CAmount, COutPoint> > setSpendableOutputs;
+    std::map<COutPoint, CAmount> mapSpendableOutputs;
+    std::set<uint256> setSpendableOutputsPending;
+    bool fSpendableOutputsRebuild{true};
+    void UpdateSpendableOutputs();
+    void EraseSpendableOutput(const COutPoint& outpoint);
+
+    //! Asynchronous sends by job id; the ids ThreadSendQueue has not picked up yet wait in queueSendJobs
+    Mutex cs_sendJobs;
+    std::condition_variable condSendJobs;
+    std::map<int64_t, CSendJob> mapSendJobs;
+    std::deque<int64_t> queueSendJobs;
+    int64_t nLastSendJobId{0};
+
 public:
     static const int32_t MAX_DECOY_POOL = 500;
+    //! The background fill reads coinbase decoys from disk until the pool holds more than this
+    static const int32_t MIN_COINBASE_DECOY_POOL = 100;
+    //! Finished asynchronous sends kept for getsendjob
+    static const size_t MAX_SEND_JOBS = 10000;
     static const int32_t PROBABILITY_NEW_COIN_SELECTED = 70;
     bool RescanAfterUnlock(int fromHeight);
     bool MintableCoins();
@@ -372,8 +490,14 @@ public:
     std::vector<COutPoint> inSpendQueueOutpointsPerSession;
     mutable std::map<CScript, CAmount> amountMap;
     mutable std::map<CScript, CKey> blindMap;
-    mutable std::map<COutPoint, uint256> userDecoysPool;	//used in transaction spending user transaction
-    mutable std::map<COutPoint, uint256> coinbaseDecoysPool; //used in transction spending coinbase
+    //! Outputs decoded since the last SetBestChain, whose amount and blind are yet to be written to the wallet file
+    mutable std::set<CScript> setUnsavedOutputAmounts;
+    mutable CDecoyPool userDecoysPool;	//used in transaction spending user transaction
+    mutable CDecoyPool coinbaseDecoysPool; //used in transction spending coinbase
+    //! Coinbase decoy candidates of recent blocks by height, with the block hash, until they are mature
+    std::map<int, std::pair<uint256, std::vector<COutPoint> > > mapImmatureCoinbaseDecoys;
+    //! Height the next background refill of the coinbase decoy pool resumes reading at, 0 to start below the tip
+    int nCoinbaseDecoysFillHeight{0};
 
     CAmount dirtyCachedBalance = 0;
 
@@ -473,9 +597,13 @@ public:
 
 
     void MarkDirty();
+    //! Make the next balance query recompute the cached balances
+    void MarkBalancesDirty() { ++nBalancesGeneration; }
+    //! Rebuild the spendable output index on the next AvailableCoins call, e.g. when spends may have been undone
+    void MarkSpendableOutputsDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
-    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
+    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate, const std::vector<std::pair<unsigned int, CKey> >* pStealthOutputs = NULL);
     void EraseFromWallet(const uint256& hash);
     void ReorderWalletTransactions(std::map<std::pair<int,int>, CWalletTx*> &mapSorted, int64_t &maxOrderPos);
     void UpdateWalletTransactionOrder(std::map<std::pair<int,int>, CWalletTx*> &mapSorted, bool resetOrder);
@@ -484,6 +612,7 @@ public:
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false, bool fromStartup = false, int height = -1);
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();
+    CWalletBalances GetBalances() const;
     CAmount GetBalance();
     CAmount GetSpendableBalance();
     CAmount GetLockedCoins() const;
@@ -565,6 +694,8 @@ public:
     CAmount GetCredit(const CTransaction& tx, const isminefilter& filter) const;
     CAmount GetChange(const CTransaction& tx) const;
     void SetBestChain(const CBlockLocator& loc);
+    void WriteOutputAmounts();
+    void EraseOutputAmounts(const CTransaction& tx, CWalletDB& walletdb);
 
     DBErrors LoadWallet(bool& fFirstRunRet);
     DBErrors ZapWalletTx(std::vector<CWalletTx>& vWtx);
@@ -621,8 +752,17 @@ public:
     static bool DecodeStealthAddress(const std::string& stealth, CPubKey& pubViewKey, CPubKey& pubSpendKey, bool& hasPaymentID, uint64_t& paymentID);
     static bool ComputeStealthDestination(const CKey& secret, const CPubKey& pubViewKey, const CPubKey& pubSpendKey, CPubKey& des);
     bool SendToStealthAddress(const std::string& stealthAddr, CAmount nValue, CWalletTx& wtxNew, bool fUseIX = false, int ringSize = 5);
+    void LockSentOutput(const std::string& stealthAddr, CAmount nValue, const CWalletTx& wtx);
+    int64_t QueueSendToStealthAddress(const std::string& stealthAddr, CAmount nValue, bool fLockOutput);
+    bool GetSendJob(int64_t nJobId, CSendJob& job);
+    void ThreadSendQueue();
+    void FillCoinbaseDecoysPool();
+    void AddBlockDecoys(const CBlock& block);
+    void RemoveBlockDecoys(const CBlock& block, int nHeight);
     bool GenerateAddress(CPubKey& pub, CPubKey& txPub, CKey& txPriv) const;
     bool IsTransactionForMe(const CTransaction& tx);
+    //! Forget the cached stealth account keys after the wallet is locked or an account is added
+    void MarkStealthAccountsDirty();
     bool ReadAccountList(std::string& accountList);
     bool ReadStealthAccount(const std::string& strAccount, CStealthAccount& account);
     bool EncodeIntegratedAddress(const CPubKey& pubViewKey, const CPubKey& pubSpendKey, uint64_t paymentID, std::string& pubAddr);
@@ -664,8 +804,9 @@ public:
 private:
     bool encodeStealthBase58(const std::vector<unsigned char>& raw, std::string& stealth);
     bool allMyPrivateKeys(std::vector<CKey>& spends, std::vector<CKey>& views);
+    bool loadStealthScanKeys();
+    void addStealthOutputs(const CTransaction& tx, const std::vector<std::pair<unsigned int, CKey> >& vStealthOutputs);
     void createMasterKey() const;
-    bool generateBulletProofAggregate(CTransaction& tx);
     bool selectDecoysAndRealIndex(CTransaction& tx, int& myIndex, int ringSize);
     bool makeRingCT(CTransaction& wtxNew, int ringSize, std::string& strFailReason);
     int walletIdxCache = 0;
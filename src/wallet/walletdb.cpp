@@ -695,6 +695,13 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
                 strErr = "Error reading wallet database: LoadDestData failed";
                 return false;
             }
+        } else if (strType == "outamount") {
+            CScript scriptPubKey;
+            ssKey >> *(CScriptBase*)(&scriptPubKey);
+            std::pair<CAmount, std::vector<unsigned char> > amountBlind;
+            ssValue >> amountBlind;
+            pwallet->amountMap[scriptPubKey] = amountBlind.first;
+            pwallet->blindMap[scriptPubKey].Set(amountBlind.second.begin(), amountBlind.second.end(), true);
         } else if (strType == "hdchain") {
             CHDChain chain;
             ssValue >> chain;
@@ -1224,6 +1231,17 @@ bool CWalletDB::ReadKeyImage(const std::string& outpointKey, CKeyImage& k)
     return Read(std::make_pair(std::string("outpointkeyimage"), outpointKey), k);
 }
 
+bool CWalletDB::WriteOutputAmount(const CScript& scriptPubKey, const CAmount& amount, const CKey& blind)
+{
+    std::vector<unsigned char> vchBlind(blind.begin(), blind.end());
+    return Write(std::make_pair(std::string("outamount"), *(const CScriptBase*)(&scriptPubKey)), std::make_pair(amount, vchBlind));
+}
+
+bool CWalletDB::EraseOutputAmount(const CScript& scriptPubKey)
+{
+    return Erase(std::make_pair(std::string("outamount"), *(const CScriptBase*)(&scriptPubKey)));
+}
+
 
 bool CWalletDB::EraseDestData(const std::string& address, const std::string& key)
 {
@@ -120,6 +120,9 @@ public:
     bool WriteKeyImage(const std::string& outpointKey, const CKeyImage& k);
     bool ReadKeyImage(const std::string& outpointKey, CKeyImage& k);
 
+    bool WriteOutputAmount(const CScript& scriptPubKey, const CAmount& amount, const CKey& blind);
+    bool EraseOutputAmount(const CScript& scriptPubKey);
+
     bool WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata& keyMeta);
     bool WriteCryptedKey(const CPubKey& vchPubKey, const std::vector<unsigned char>& vchCryptedSecret, const CKeyMetadata& keyMeta);
     bool WriteMasterKey(unsigned int nID, const CMasterKey& kMasterKey);